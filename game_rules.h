@@ -0,0 +1,321 @@
+//! 游戏规则核心：计分常量、游戏代码生成、按键与刷卡判定
+//! 全部为纯函数，不访问硬件，随机数状态由调用者传入。固件 main.c 与主机
+//! 平衡性仿真 host/balance.c 共用这一份规则，计分常量可在编译时用 -D 覆盖。
+
+#ifndef GAME_RULES_H
+#define GAME_RULES_H
+
+#include <stdint.h>
+
+// 管道编号 1~9 对应数码管第2~4位：1~3 为A段，4~6 为G段，7~9 为D段，
+// 0 表示空管道
+#define TARGET_MAX 9 // 最大管道编号
+#define PLAYER_MAX 4 // 多人模式最多玩家数（每人一个按键器）
+#ifndef GAME_TARGETS
+#define GAME_TARGETS 3 // 默认每轮抽取的管道数（含空管道），最多 TARGET_MAX-1
+#endif
+#if GAME_TARGETS < 1 || GAME_TARGETS > TARGET_MAX - 1
+#error "GAME_TARGETS 须在 1 ~ TARGET_MAX-1 之间"
+#endif
+
+// 计分
+#define SCORE_MAX 100
+#ifndef SOLO_SCORE_START
+#define SOLO_SCORE_START 100 // 单人初始分数，归零时结束
+#endif
+#ifndef SOLO_SCORE_HIT
+#define SOLO_SCORE_HIT 5 // 单人击中地鼠
+#endif
+#ifndef SOLO_SCORE_MISS
+#define SOLO_SCORE_MISS (-10) // 单人按错
+#endif
+#ifndef SOLO_SCORE_CARD_MISS
+#define SOLO_SCORE_CARD_MISS (-1) // 单人刷错卡
+#endif
+#ifndef MULTI_SCORE_WIN
+#define MULTI_SCORE_WIN 50 // 多人先到此分数者获胜
+#endif
+#ifndef MULTI_SCORE_HIT
+#define MULTI_SCORE_HIT 5 // 多人击中，己方加分
+#endif
+#ifndef MULTI_SCORE_MISS
+#define MULTI_SCORE_MISS 3 // 多人按错，己方扣分（不低于0）
+#endif
+
+// 游戏代码结构体定义
+struct game_code
+{
+  uint16_t targets;     // 地鼠位图，第 k 位为1表示管道 k 有地鼠
+  uint8_t unsolved;     // 未解答数（地鼠数，单人模式另加风扇）
+  uint8_t fan;          // 风扇状态（0/1），即需要刷的卡号
+  uint8_t fan_unsolved; // 风扇是否仍未解答
+};
+
+// 一局的规则状态
+typedef struct
+{
+  struct game_code code;
+  int score;   // 单人：分数；多人：领先者进度（0~SCORE_MAX）
+  int round;   // 当前轮次（1起）
+  int targets; // 每轮抽取的管道数
+  int multi;   // 1=多人模式（无风扇和NFC，有人到达 MULTI_SCORE_WIN 时结束）
+  int players; // 玩家数（单人为1）
+  int scores[PLAYER_MAX]; // 多人模式每名玩家的分数
+} game_rules;
+
+/**
+ * @brief 生成32位伪随机数（xorshift32）
+ * @param s 随机数状态（非零）
+ */
+static inline uint32_t rules_prng_next(uint32_t *s)
+{
+  uint32_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *s = x;
+  return x;
+}
+
+/**
+ * @brief 生成 [0, n) 内的伪随机数（乘法取高位，无拒绝循环）
+ */
+static inline uint32_t rules_prng_below(uint32_t *s, uint32_t n)
+{
+  return (uint32_t)(((uint64_t)rules_prng_next(s) * n) >> 32);
+}
+
+/**
+ * @brief 抽取 count 个互不相同的管道编号（0~9），返回位图
+ * @param s     随机数状态
+ * @param count 抽取个数（1~TARGET_MAX）
+ * @retval 地鼠位图（抽到的空管道0不计入）
+ * @note  只取一个随机数，按变进制 10,9,8,... 展开为排列，无需重抽
+ */
+static inline uint16_t random_targets(uint32_t *s, int count)
+{
+  uint32_t perms = 1;
+  for (int i = 0; i < count; i++)
+  {
+    perms *= TARGET_MAX + 1 - i;
+  }
+  uint32_t r = rules_prng_below(s, perms);
+
+  uint16_t picked = 0;
+  for (int i = 0; i < count; i++)
+  {
+    int left = TARGET_MAX + 1 - i;
+    int d = r % left; // 在未抽过的编号中取第 d 个
+    r /= left;
+    int k = 0;
+    for (;; k++)
+    {
+      if (picked & (1u << k))
+        continue;
+      if (d-- == 0)
+        break;
+    }
+    picked |= 1u << k;
+  }
+  return picked & ~1u;
+}
+
+static inline int target_count(uint16_t targets)
+{
+  int n = 0;
+  for (; targets; targets &= targets - 1)
+    n++;
+  return n;
+}
+
+/**
+ * @brief 随机生成单人游戏代码
+ * @param code  游戏代码
+ * @param s     随机数状态
+ * @param count 抽取的管道数
+ */
+static inline void random_game_code(struct game_code *code, uint32_t *s,
+                                    int count)
+{
+  if (count > TARGET_MAX - 1)
+    count = TARGET_MAX - 1;            // 未解答数只有一位数码管
+  code->fan = rules_prng_next(s) & 1; // 随机风扇状态
+  code->fan_unsolved = 1;
+  code->targets = random_targets(s, count);
+  code->unsolved = 1 + target_count(code->targets); // 地鼠数加风扇
+}
+
+// 多人游戏专用的游戏代码生成（无风扇和NFC）
+static inline void random_multi_game_code(struct game_code *code, uint32_t *s,
+                                          int count)
+{
+  if (count > TARGET_MAX)
+    count = TARGET_MAX;
+  code->fan = 0;
+  code->fan_unsolved = 0;
+  code->targets = random_targets(s, count);
+  code->unsolved = target_count(code->targets); // 只计算地鼠数量
+}
+
+/**
+ * @brief 击中并清除管道 key 上的地鼠
+ * @param code 游戏代码
+ * @param key  按键值（'1'~'9'）
+ * @retval 1=击中，0=该管道没有地鼠
+ */
+static inline int target_hit(struct game_code *code, char key)
+{
+  unsigned int k = (unsigned int)(key - '0');
+  if (k < 1 || k > TARGET_MAX || !(code->targets & (1u << k)))
+    return 0;
+  code->targets &= ~(1u << k);
+  code->unsolved--;
+  return 1;
+}
+
+/**
+ * @brief 保证score不小于0 不大于100
+ * @param score 分数
+ * @param add 增加的分数
+ */
+static inline void score_add(int *score, int add)
+{
+  if (*score + add < 0) // 如果score+add小于0，则score=0
+  {
+    *score = 0;
+  }
+  else if (*score + add > SCORE_MAX) // 如果score+add大于100，则score=100
+  {
+    *score = SCORE_MAX;
+  }
+  else // 否则score+add
+  {
+    *score += add;
+  }
+}
+
+/**
+ * @brief 游戏是否已结束
+ */
+static inline int rules_over(const game_rules *g)
+{
+  return g->multi ? g->score >= SCORE_MAX : g->score <= 0;
+}
+
+/**
+ * @brief 本轮全部解决后开始下一轮
+ * @retval 1=开始了新一轮
+ */
+static inline int rules_advance(game_rules *g, uint32_t *s)
+{
+  if (rules_over(g) || g->code.unsolved != 0)
+    return 0;
+  g->round++;
+  if (g->multi)
+    random_multi_game_code(&g->code, s, g->targets);
+  else
+    random_game_code(&g->code, s, g->targets);
+  return 1;
+}
+
+/**
+ * @brief 开局并生成第一轮
+ * @param g       规则状态
+ * @param players 玩家数：1=单人模式，2~PLAYER_MAX=多人模式
+ * @param targets 每轮抽取的管道数
+ * @param s       随机数状态
+ */
+static inline void rules_start(game_rules *g, int players, int targets,
+                               uint32_t *s)
+{
+  if (players > PLAYER_MAX)
+    players = PLAYER_MAX;
+  g->code.targets = 0;
+  g->code.unsolved = 0;
+  g->code.fan = 0;
+  g->code.fan_unsolved = 0;
+  g->multi = players > 1;
+  g->players = players;
+  g->score = g->multi ? 0 : SOLO_SCORE_START;
+  for (int i = 0; i < PLAYER_MAX; i++)
+    g->scores[i] = 0;
+  g->round = 0;
+  g->targets = targets;
+  rules_advance(g, s);
+}
+
+/**
+ * @brief 单人模式按下按键
+ * @retval 1=击中，-1=按错，0=游戏已结束
+ */
+static inline int solo_rules_key(game_rules *g, char key, uint32_t *s)
+{
+  if (rules_over(g))
+    return 0;
+  int hit = target_hit(&g->code, key);
+  score_add(&g->score, hit ? SOLO_SCORE_HIT : SOLO_SCORE_MISS);
+  rules_advance(g, s);
+  return hit ? 1 : -1;
+}
+
+/**
+ * @brief 单人模式放上卡片
+ * @retval 1=正确，-1=错误，0=不需要刷卡或游戏已结束
+ */
+static inline int solo_rules_card(game_rules *g, int card, uint32_t *s)
+{
+  if (rules_over(g) || g->code.fan_unsolved != 1)
+    return 0;
+  int ok = card == g->code.fan;
+  if (ok)
+  {
+    g->code.unsolved--;
+    g->code.fan_unsolved = 0;
+  }
+  else
+  {
+    score_add(&g->score, SOLO_SCORE_CARD_MISS);
+  }
+  rules_advance(g, s);
+  return ok ? 1 : -1;
+}
+
+/**
+ * @brief 多人模式的领先者（同分取编号小的）
+ * @retval 1~players
+ */
+static inline int multi_rules_winner(const game_rules *g)
+{
+  int best = 0;
+  for (int i = 1; i < g->players; i++)
+  {
+    if (g->scores[i] > g->scores[best])
+      best = i;
+  }
+  return best + 1;
+}
+
+/**
+ * @brief 多人模式按下按键
+ * @param player 玩家（1~players）
+ * @retval 1=得分，-1=失分，0=游戏已结束或玩家无效
+ * @note  各玩家分数独立，score 记录领先者到 MULTI_SCORE_WIN 的进度
+ */
+static inline int multi_rules_key(game_rules *g, int player, char key,
+                                  uint32_t *s)
+{
+  if (rules_over(g) || player < 1 || player > g->players)
+    return 0;
+  int hit = target_hit(&g->code, key);
+  int *score = &g->scores[player - 1];
+  *score += hit ? MULTI_SCORE_HIT : -MULTI_SCORE_MISS;
+  if (*score < 0)
+    *score = 0;
+  int lead = g->scores[multi_rules_winner(g) - 1];
+  g->score = lead >= MULTI_SCORE_WIN ? SCORE_MAX
+                                     : lead * SCORE_MAX / MULTI_SCORE_WIN;
+  rules_advance(g, s);
+  return hit ? 1 : -1;
+}
+
+#endif
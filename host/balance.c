@@ -0,0 +1,482 @@
+//! 主机平衡性仿真：用 game_rules.h 中的规则和参数化的机器人玩家跑大量对局，
+//! 统计胜率与对局长度，计分常量改动可以先在这里验证再上机
+//! 编译：gcc -std=gnu11 -O2 -pthread -I. host/balance.c -o ppp_balance
+//!       （可加 -DMULTI_SCORE_MISS=4 等覆盖计分常量）
+//! 运行：./ppp_balance [solo|multi] [局数] [线程数，0=全部核心] [随机种子]
+//!                     [p1=反应ms,抖动ms,按错%] [p2=...] [p3=...] [p4=...]
+//!                     [players=多人玩家数，2~PLAYER_MAX] [cap=单人轮数上限]
+
+#include "game_rules.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// 与固件一致的时间参数（微秒）
+#define SAMPLE_US 5000  // 按键采样周期（KEY_SAMPLE_PERIOD_MS）
+#define DEBOUNCE_SCANS 2 // 按键消抖次数（KEY_DEBOUNCE_SCANS）
+#define RENDER_US 50000 // 画面刷新周期（RENDER_PERIOD_MS）
+#define NFC_US 50000    // 读卡周期（NFC_TASK_PERIOD_MS）
+
+#define BATCH 4096       // 每次领取的局数
+#define HIST_ROUNDS 1024  // 轮数直方图，最后一格收纳超出的对局
+#define HIST_SECONDS 1024 // 时长直方图（秒），同上
+#define MAX_EVENTS 100000 // 单局事件上限，防止参数异常时死循环
+
+// 机器人玩家参数
+typedef struct
+{
+  uint32_t reaction_ms; // 平均反应时间
+  uint32_t jitter_ms;   // 反应时间随机范围（±）
+  uint32_t error_pct;   // 按错概率（%）
+  uint32_t settle_ms;   // 按键后等待画面更新的时间
+} bot_param;
+
+typedef struct
+{
+  const char *mode;
+  int multi;
+  uint64_t games;
+  int threads;
+  uint64_t seed;
+  int round_cap; // 单人模式轮数上限，到达视为存活
+  int players;   // 多人模式玩家数
+  bot_param bots[PLAYER_MAX];
+} balance_config;
+
+// 汇总结果，所有线程用原子加法合并，不加锁
+typedef struct
+{
+  atomic_uint_fast64_t games;
+  atomic_uint_fast64_t rounds;
+  atomic_uint_fast64_t presses;
+  atomic_uint_fast64_t hits;
+  atomic_uint_fast64_t cards;
+  atomic_uint_fast64_t wins[PLAYER_MAX + 1]; // [n]=player n；单人[1]=出局
+  atomic_uint_fast64_t ties; // 多名玩家在同一次采样中按下
+  atomic_uint_fast64_t ties_first[PLAYER_MAX]; // 其中各玩家先处理的次数
+  atomic_uint_fast64_t contested; // 地鼠已被对方击中但仍在显示，不计分
+  atomic_uint_fast64_t virtual_us;
+  atomic_uint_fast64_t hist_rounds[HIST_ROUNDS];
+  atomic_uint_fast64_t hist_seconds[HIST_SECONDS];
+} balance_result;
+
+// 每线程的局部统计，批量合并到 balance_result
+typedef struct
+{
+  uint64_t games, rounds, presses, hits, cards, ties, contested;
+  uint64_t virtual_us;
+  uint64_t wins[PLAYER_MAX + 1];
+  uint64_t ties_first[PLAYER_MAX];
+  uint32_t hist_rounds[HIST_ROUNDS];
+  uint32_t hist_seconds[HIST_SECONDS];
+} local_result;
+
+static balance_config cfg;
+static balance_result total;
+static atomic_uint_fast64_t next_game;
+
+static uint64_t splitmix64(uint64_t *x)
+{
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static uint32_t seed32(uint64_t *stream)
+{
+  uint32_t s = (uint32_t)splitmix64(stream);
+  return s ? s : 1;
+}
+
+// 机器人状态
+typedef struct
+{
+  const bot_param *p;
+  uint64_t free_at;  // 可以再次决策的时间
+  uint64_t press_at; // 计划按下的时间，0=无
+  char key;
+} bot;
+
+static uint64_t reaction_us(const bot_param *p, uint32_t *rng)
+{
+  int64_t ms = p->reaction_ms;
+  if (p->jitter_ms)
+    ms += (int64_t)rules_prng_below(rng, 2 * p->jitter_ms + 1) - p->jitter_ms;
+  return (uint64_t)(ms > 0 ? ms : 0) * 1000;
+}
+
+// 画面在下一次刷新时显示
+static uint64_t next_render(uint64_t t)
+{
+  return (t / RENDER_US + 1) * RENDER_US;
+}
+
+// 按键在 DEBOUNCE_SCANS 次采样后才产生事件；没有计划按键时返回最大值
+static uint64_t detect_tick(uint64_t press_us)
+{
+  return press_us ? press_us / SAMPLE_US + DEBOUNCE_SCANS : UINT64_MAX;
+}
+
+/**
+ * @brief 机器人决策：从看到的地鼠中随机挑一个，可能按错到相邻编号
+ */
+static void bot_decide(bot *b, uint16_t targets, uint64_t now, uint32_t *rng)
+{
+  int n = target_count(targets);
+  if (n == 0)
+    return;
+  uint32_t pick = rules_prng_below(rng, n);
+  int t = 1;
+  for (;; t++)
+  {
+    if ((targets & (1u << t)) && pick-- == 0)
+      break;
+  }
+  if (rules_prng_below(rng, 100) < b->p->error_pct)
+    t = t % TARGET_MAX + 1;
+  b->key = (char)('0' + t);
+  b->press_at = now + reaction_us(b->p, rng);
+}
+
+static void record_game(local_result *r, const game_rules *g, uint64_t end_us,
+                        int outcome)
+{
+  r->games++;
+  r->rounds += g->round;
+  r->virtual_us += end_us;
+  r->wins[outcome]++;
+  r->hist_rounds[g->round < HIST_ROUNDS ? g->round : HIST_ROUNDS - 1]++;
+  uint64_t sec = end_us / 1000000;
+  r->hist_seconds[sec < HIST_SECONDS ? sec : HIST_SECONDS - 1]++;
+}
+
+/**
+ * @brief 多人对局：cfg.players 个机器人抢同一批地鼠
+ */
+static void play_multi(local_result *r, uint32_t *rules_rng, uint32_t *bot_rng)
+{
+  game_rules g;
+  int players = cfg.players;
+  rules_start(&g, players, GAME_TARGETS, rules_rng);
+  bot bots[PLAYER_MAX];
+  for (int i = 0; i < players; i++)
+    bots[i] = (bot){&cfg.bots[i], 0, 0, 0};
+  uint64_t visible_at = next_render(0);
+  uint64_t now = 0;
+  uint64_t taken_until[TARGET_MAX + 1] = {0}; // 被击中的地鼠显示到何时
+  int taken_by[TARGET_MAX + 1] = {0};
+
+  for (int events = 0; !rules_over(&g) && events < MAX_EVENTS; events++)
+  {
+    uint64_t tick = UINT64_MAX;
+    for (int i = 0; i < players; i++)
+    {
+      bot *b = &bots[i];
+      if (b->press_at == 0)
+      {
+        uint64_t t = b->free_at > visible_at ? b->free_at : visible_at;
+        bot_decide(b, g.code.targets, t, bot_rng);
+      }
+      uint64_t d = detect_tick(b->press_at);
+      if (d < tick)
+        tick = d;
+    }
+    if (tick == UINT64_MAX)
+      break; // 没有可按的地鼠
+
+    // 处理最早一次采样中的所有按下；同一次采样中多人按下时，与固件采样器
+    // 一致，从第 (采样序号 % 玩家数) 个按键器开始依次读取
+    int order[PLAYER_MAX], count = 0;
+    for (int n = 0; n < players; n++)
+    {
+      int i = (int)((tick + n) % players);
+      if (detect_tick(bots[i].press_at) == tick)
+        order[count++] = i;
+    }
+    if (count > 1)
+    {
+      r->ties++;
+      r->ties_first[order[0]]++;
+    }
+
+    for (int n = 0; n < count && !rules_over(&g); n++)
+    {
+      bot *b = &bots[order[n]];
+      int round = g.round;
+      now = detect_tick(b->press_at) * SAMPLE_US;
+      // 与固件一致：对方刚击中、画面上还没消失的地鼠不计分
+      unsigned int k = (unsigned int)(b->key - '0');
+      int result = 0;
+      if (now < taken_until[k] && taken_by[k] != order[n] + 1 &&
+          !(g.code.targets & (1u << k)))
+      {
+        r->contested++;
+      }
+      else
+      {
+        result = multi_rules_key(&g, order[n] + 1, b->key, rules_rng);
+        r->presses++;
+        r->hits += result > 0;
+      }
+      if (result > 0)
+      {
+        taken_until[k] = next_render(now);
+        taken_by[k] = order[n] + 1;
+      }
+      b->free_at = b->press_at + b->p->settle_ms * 1000;
+      b->press_at = 0;
+      if (g.round != round)
+        visible_at = next_render(now);
+    }
+  }
+  record_game(r, &g, now, multi_rules_winner(&g));
+}
+
+/**
+ * @brief 单人对局：打地鼠并在只剩风扇时刷卡，直到出局或到达轮数上限
+ */
+static void play_solo(local_result *r, uint32_t *rules_rng, uint32_t *bot_rng)
+{
+  game_rules g;
+  rules_start(&g, 1, GAME_TARGETS, rules_rng);
+  bot b = {&cfg.bots[0], 0, 0, 0};
+  uint64_t visible_at = next_render(0);
+  uint64_t now = 0;
+
+  for (int events = 0;
+       !rules_over(&g) && g.round < cfg.round_cap && events < MAX_EVENTS;
+       events++)
+  {
+    uint64_t t = b.free_at > visible_at ? b.free_at : visible_at;
+    int round = g.round;
+    if (g.code.targets)
+    {
+      bot_decide(&b, g.code.targets, t, bot_rng);
+      now = detect_tick(b.press_at) * SAMPLE_US;
+      r->hits += solo_rules_key(&g, b.key, rules_rng) > 0;
+      r->presses++;
+      b.free_at = b.press_at + b.p->settle_ms * 1000;
+    }
+    else
+    {
+      // 只剩风扇：放卡，按错概率放错卡
+      int card = g.code.fan;
+      if (rules_prng_below(bot_rng, 100) < b.p->error_pct)
+        card ^= 1;
+      uint64_t place = t + reaction_us(b.p, bot_rng);
+      now = (place / NFC_US + 1) * NFC_US;
+      solo_rules_card(&g, card, rules_rng);
+      r->cards++;
+      b.free_at = now + b.p->settle_ms * 1000;
+    }
+    if (g.round != round)
+      visible_at = next_render(now);
+  }
+  record_game(r, &g, now, rules_over(&g) ? 1 : 0);
+}
+
+static void merge(local_result *r)
+{
+  atomic_fetch_add(&total.games, r->games);
+  atomic_fetch_add(&total.rounds, r->rounds);
+  atomic_fetch_add(&total.presses, r->presses);
+  atomic_fetch_add(&total.hits, r->hits);
+  atomic_fetch_add(&total.cards, r->cards);
+  atomic_fetch_add(&total.ties, r->ties);
+  atomic_fetch_add(&total.contested, r->contested);
+  atomic_fetch_add(&total.virtual_us, r->virtual_us);
+  for (int i = 0; i <= PLAYER_MAX; i++)
+    atomic_fetch_add(&total.wins[i], r->wins[i]);
+  for (int i = 0; i < PLAYER_MAX; i++)
+    atomic_fetch_add(&total.ties_first[i], r->ties_first[i]);
+  for (int i = 0; i < HIST_ROUNDS; i++)
+  {
+    if (r->hist_rounds[i])
+      atomic_fetch_add(&total.hist_rounds[i], r->hist_rounds[i]);
+  }
+  for (int i = 0; i < HIST_SECONDS; i++)
+  {
+    if (r->hist_seconds[i])
+      atomic_fetch_add(&total.hist_seconds[i], r->hist_seconds[i]);
+  }
+  memset(r, 0, sizeof(*r));
+}
+
+static void *worker(void *arg)
+{
+  uint64_t stream = cfg.seed ^ (0xD1B54A32D192ED03ull * ((uintptr_t)arg + 1));
+  local_result local;
+  memset(&local, 0, sizeof(local));
+  for (;;)
+  {
+    uint64_t first = atomic_fetch_add(&next_game, BATCH);
+    if (first >= cfg.games)
+      break;
+    uint64_t last = first + BATCH < cfg.games ? first + BATCH : cfg.games;
+    for (uint64_t i = first; i < last; i++)
+    {
+      uint32_t rules_rng = seed32(&stream);
+      uint32_t bot_rng = seed32(&stream);
+      if (cfg.multi)
+        play_multi(&local, &rules_rng, &bot_rng);
+      else
+        play_solo(&local, &rules_rng, &bot_rng);
+    }
+    merge(&local);
+  }
+  return NULL;
+}
+
+/**
+ * @brief 直方图百分位，落在最后一格（溢出格）时输出 ">=n-1"
+ * @param buf 输出缓冲区
+ */
+static const char *percentile(char *buf, size_t size,
+                              atomic_uint_fast64_t *hist, int n,
+                              uint64_t count, int pct)
+{
+  uint64_t rank = (count * pct + 99) / 100, seen = 0;
+  int i = 0;
+  for (; i < n - 1; i++)
+  {
+    seen += atomic_load(&hist[i]);
+    if (seen >= rank)
+      break;
+  }
+  snprintf(buf, size, i < n - 1 ? "%d" : ">=%d", i);
+  return buf;
+}
+
+static void parse_bot(const char *s, bot_param *p)
+{
+  sscanf(s, "%u,%u,%u", &p->reaction_ms, &p->jitter_ms, &p->error_pct);
+}
+
+int main(int argc, char **argv)
+{
+  cfg.mode = "multi";
+  cfg.games = 1000000;
+  cfg.seed = 1;
+  cfg.round_cap = 200;
+  cfg.players = 2;
+  cfg.bots[0] = (bot_param){350, 150, 5, 80};
+  cfg.bots[1] = (bot_param){400, 200, 8, 80};
+  cfg.bots[2] = (bot_param){450, 200, 8, 80};
+  cfg.bots[3] = (bot_param){500, 250, 10, 80};
+
+  int pos = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (argv[i][0] == 'p' && argv[i][1] >= '1' &&
+        argv[i][1] < '1' + PLAYER_MAX && argv[i][2] == '=')
+    {
+      parse_bot(argv[i] + 3, &cfg.bots[argv[i][1] - '1']);
+      continue;
+    }
+    if (strncmp(argv[i], "players=", 8) == 0)
+    {
+      cfg.players = atoi(argv[i] + 8);
+      continue;
+    }
+    if (strncmp(argv[i], "cap=", 4) == 0)
+    {
+      cfg.round_cap = atoi(argv[i] + 4);
+      continue;
+    }
+    switch (pos++) // 位置参数
+    {
+    case 0:
+      cfg.mode = argv[i];
+      break;
+    case 1:
+      cfg.games = strtoull(argv[i], NULL, 10);
+      break;
+    case 2:
+      cfg.threads = atoi(argv[i]);
+      break;
+    case 3:
+      cfg.seed = strtoull(argv[i], NULL, 10);
+      break;
+    }
+  }
+  cfg.multi = strcmp(cfg.mode, "solo") != 0;
+  if (cfg.players < 2 || cfg.players > PLAYER_MAX)
+  {
+    fprintf(stderr, "players must be 2~%d\n", PLAYER_MAX);
+    return 2;
+  }
+  if (cfg.threads <= 0)
+    cfg.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (cfg.threads <= 0)
+    cfg.threads = 1;
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  pthread_t *tids = calloc(cfg.threads, sizeof(pthread_t));
+  for (int i = 0; i < cfg.threads; i++)
+    pthread_create(&tids[i], NULL, worker, (void *)(uintptr_t)i);
+  for (int i = 0; i < cfg.threads; i++)
+    pthread_join(tids[i], NULL);
+  free(tids);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  uint64_t games = atomic_load(&total.games);
+  uint64_t rounds = atomic_load(&total.rounds);
+  uint64_t presses = atomic_load(&total.presses);
+  if (games == 0)
+    return 1;
+
+  printf("mode=%s games=%llu threads=%d wall=%.3fs rounds=%llu "
+         "(%.1fM rounds/min)\n",
+         cfg.multi ? "multi" : "solo", (unsigned long long)games, cfg.threads,
+         wall, (unsigned long long)rounds,
+         wall > 0 ? rounds / wall * 60 / 1e6 : 0.0);
+  for (int i = 0; i < (cfg.multi ? cfg.players : 1); i++)
+  {
+    const bot_param *p = &cfg.bots[i];
+    printf("p%d: reaction=%ums jitter=%ums error=%u%%\n", i + 1,
+           p->reaction_ms, p->jitter_ms, p->error_pct);
+  }
+  if (cfg.multi)
+  {
+    uint64_t ties = atomic_load(&total.ties);
+    printf("win");
+    for (int i = 0; i < cfg.players; i++)
+      printf(" p%d=%.2f%%", i + 1,
+             100.0 * atomic_load(&total.wins[i + 1]) / games);
+    printf("  same-sample ties=%llu (first", (unsigned long long)ties);
+    for (int i = 0; i < cfg.players; i++)
+      printf(" p%d=%.2f%%", i + 1,
+             ties ? 100.0 * atomic_load(&total.ties_first[i]) / ties : 0.0);
+    printf(") contested=%llu\n",
+           (unsigned long long)atomic_load(&total.contested));
+  }
+  else
+  {
+    printf("out=%.2f%% survived %d rounds=%.2f%% cards=%llu\n",
+           100.0 * atomic_load(&total.wins[1]) / games, cfg.round_cap,
+           100.0 * atomic_load(&total.wins[0]) / games,
+           (unsigned long long)atomic_load(&total.cards));
+  }
+  char p50[16], p95[16];
+  printf("rounds avg=%.2f p50=%s p95=%s\n", (double)rounds / games,
+         percentile(p50, sizeof(p50), total.hist_rounds, HIST_ROUNDS, games,
+                    50),
+         percentile(p95, sizeof(p95), total.hist_rounds, HIST_ROUNDS, games,
+                    95));
+  printf("length avg=%.2fs p50=%ss p95=%ss\n",
+         atomic_load(&total.virtual_us) / 1e6 / games,
+         percentile(p50, sizeof(p50), total.hist_seconds, HIST_SECONDS, games,
+                    50),
+         percentile(p95, sizeof(p95), total.hist_seconds, HIST_SECONDS, games,
+                    95));
+  printf("presses=%llu hit=%.2f%%\n", (unsigned long long)presses,
+         presses ? 100.0 * atomic_load(&total.hits) / presses : 0.0);
+  return 0;
+}
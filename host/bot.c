@@ -0,0 +1,235 @@
+//! 机器人玩家实现：每次按键器被读取时看一眼数码管，空闲时经过反应时间按下
+//! 一个仍显示着的地鼠；单人模式需要刷卡时放上与风扇对应的卡。
+
+#include "bot.h"
+#include <string.h>
+
+int ppp_main(void);        // main.c 在 PPP_HOST 下的入口
+void ppp_host_reset(void); // 恢复固件上电状态
+
+#define BOT_HOLD_MS 60   // 每次按键保持时间
+#define BOT_SETTLE_MS 80 // 按键后等待画面更新的时间
+#define BOT_CARD_MS 1000 // 放卡保持时间
+
+static PPP_TLS bot_session *run; // 当前线程正在运行的会话
+
+static uint32_t bot_rand(void)
+{
+  run->rng ^= run->rng << 13;
+  run->rng ^= run->rng >> 17;
+  run->rng ^= run->rng << 5;
+  return run->rng;
+}
+
+static uint64_t bot_delay_us(const sim_bot *bot)
+{
+  int32_t ms = (int32_t)bot->reaction_ms;
+  if (bot->jitter_ms)
+  {
+    ms += (int32_t)(bot_rand() % (2 * bot->jitter_ms + 1)) -
+          (int32_t)bot->jitter_ms;
+  }
+  return (uint64_t)(ms > 0 ? ms : 0) * 1000;
+}
+
+// 数码管数字字形（与 main.c 中 TUBE_FONT 一致）
+static const uint8_t DIGITS[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66,
+                                   0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+
+/**
+ * @brief 从数码管读出地鼠位图（第2~4位：A段=1~3，G段=4~6，D段=7~9）
+ * @note  出现A/G/D以外的段时说明正在显示提示文字，不是游戏画面
+ */
+static int read_targets(void)
+{
+  int targets = 0;
+  for (int pos = 1; pos <= 3; pos++)
+  {
+    uint8_t m = sim_tube_mask(pos);
+    if (m & ~(0x01 | 0x40 | 0x08 | 0x80))
+      return 0;
+    if (m & 0x01)
+      targets |= 1 << pos;
+    if (m & 0x40)
+      targets |= 1 << (pos + 3);
+    if (m & 0x08)
+      targets |= 1 << (pos + 6);
+  }
+  return targets;
+}
+
+/**
+ * @brief 从数码管第1位读出未解答数，无法识别返回-1
+ */
+static int read_unsolved(void)
+{
+  for (int d = 0; d < 10; d++)
+  {
+    if ((sim_tube_mask(0) & 0x7F) == DIGITS[d])
+      return d;
+  }
+  return -1;
+}
+
+static void bot_think(sim_bot *bot)
+{
+  uint64_t now = sim_time_us();
+  if (now < bot->busy_until)
+  {
+    return;
+  }
+  int targets = read_targets();
+  if (targets == 0)
+  {
+    return;
+  }
+
+  // 随机挑一个地鼠
+  int pick = bot_rand() % __builtin_popcount(targets);
+  int t = 1;
+  for (;; t++)
+  {
+    if ((targets & (1 << t)) && pick-- == 0)
+      break;
+  }
+  if (bot_rand() % 100 < bot->error_pct)
+  {
+    t = t % 9 + 1; // 按错到相邻编号
+  }
+  uint64_t at = now + bot_delay_us(bot);
+  sim_key_press(bot->keypad, '0' + t, at, BOT_HOLD_MS * 1000);
+  bot->busy_until = at + (BOT_HOLD_MS + BOT_SETTLE_MS) * 1000;
+  bot->presses++;
+}
+
+static void on_key_read(int keypad)
+{
+  if (!run->in_game || sim_tube_is_text())
+  {
+    return;
+  }
+  if (keypad < run->players)
+  {
+    bot_think(&run->bots[keypad]);
+  }
+
+  // 单人模式：未解答数多于地鼠数时说明还需要刷卡，放上与风扇对应的卡
+  uint64_t now = sim_time_us();
+  if (!run->multi && keypad == 0 && now > run->card_until + 200000 &&
+      read_unsolved() > __builtin_popcount(read_targets()))
+  {
+    uint64_t at = now + bot_delay_us(&run->bots[0]);
+    sim_nfc_place(SIM_CARD_MATCH_FAN, at, BOT_CARD_MS * 1000);
+    run->card_until = at + BOT_CARD_MS * 1000;
+  }
+}
+
+static void on_event(const char *name, int value)
+{
+  uint64_t now = sim_time_us();
+  if (strcmp(name, "tick_miss") == 0)
+  {
+    run->tick_misses++;
+    run->tick_over_us += (uint32_t)value;
+  }
+  else if (strcmp(name, "react") == 0)
+  {
+    uint32_t b = (uint32_t)value / (BOT_REACT_BUCKET_MS * 1000);
+    run->react_buckets[b < BOT_REACT_BUCKETS ? b : BOT_REACT_BUCKETS - 1]++;
+    run->react_count++;
+    run->react_sum_us += (uint32_t)value;
+  }
+  else if (strcmp(name, "key_skew") == 0)
+  {
+    run->skew_count++;
+    run->skew_sum_us += (uint32_t)value;
+    if ((uint32_t)value > run->skew_max_us)
+      run->skew_max_us = (uint32_t)value;
+  }
+  else if (strncmp(name, "input", 5) == 0 && name[5] >= '1' &&
+           name[5] < '1' + SIM_KEYPAD_MAX)
+  {
+    int p = name[5] - '1';
+    run->input_count[p]++;
+    run->input_sum_us[p] += (uint32_t)value;
+    if ((uint32_t)value > run->input_max_us[p])
+      run->input_max_us[p] = (uint32_t)value;
+  }
+  else if (strcmp(name, "welcome") == 0)
+  {
+    sim_key_press(0, '5', now + 500000, 100000); // 任意键离开欢迎界面
+  }
+  else if (strcmp(name, "chose_mode") == 0)
+  {
+    // 一局结束后回到选择模式界面时停止：结算画面已显示完，排行榜记录已由
+    // 欢迎界面写入 flash
+    if (run->finished && !run->replay && !run->endless)
+      sim_stop();
+    char mode = run->multi ? '2' : '1';
+    if (run->replay && run->finished)
+      mode = '4';
+    sim_key_press(0, mode, now + 500000, 100000);
+  }
+  else if (strcmp(name, "solo") == 0 || strcmp(name, "multi") == 0)
+  {
+    run->in_game = 1;
+    run->phase_us = now;
+  }
+  else if (strcmp(name, "solo_end") == 0 || strcmp(name, "multi_end") == 0)
+  {
+    run->in_game = 0;
+    run->result = value;
+    run->finished++;
+    run->game_us = now - run->phase_us;
+  }
+  else if (strcmp(name, "replay") == 0)
+  {
+    run->phase_us = now;
+  }
+  else if (strcmp(name, "replay_end") == 0)
+  {
+    run->replay_result = value;
+    run->replay_us = now - run->phase_us;
+    sim_stop();
+  }
+}
+
+// 默认机器人：平均反应时间、抖动、按错率
+static const uint32_t BOT_DEFAULT[SIM_KEYPAD_MAX][3] = {
+    {350, 150, 5},
+    {400, 200, 8},
+    {380, 170, 6},
+    {420, 180, 7},
+};
+
+void bot_session_init(bot_session *s, int players, uint32_t seed)
+{
+  memset(s, 0, sizeof(*s));
+  if (players < 1)
+    players = 1;
+  if (players > SIM_KEYPAD_MAX)
+    players = SIM_KEYPAD_MAX;
+  s->multi = players > 1;
+  s->players = players;
+  s->replay_result = -1;
+  s->rng = seed * 2654435761u + 1;
+  for (int i = 0; i < SIM_KEYPAD_MAX; i++)
+  {
+    s->bots[i] = (sim_bot){i, BOT_DEFAULT[i][0], BOT_DEFAULT[i][1],
+                           BOT_DEFAULT[i][2], 0, 0};
+  }
+}
+
+int bot_session_run(bot_session *s, const sim_config *cfg)
+{
+  sim_hooks hooks = {on_event, NULL, on_key_read};
+  sim_config c = *cfg;
+  if (c.keypads < (uint32_t)s->players)
+    c.keypads = s->players;
+  run = s;
+  sim_reset(&c, &hooks);
+  ppp_host_reset();
+  int stopped = sim_run(ppp_main);
+  run = NULL;
+  return stopped;
+}
@@ -0,0 +1,73 @@
+//! 机器人玩家：看仿真数码管、按反应时间按键和放卡，驱动一台仿真游戏机从开机
+//! 玩到游戏结束。单机入口 sim_main.c 与多机压力测试 fleet.c 共用。
+
+#ifndef HOST_BOT_H
+#define HOST_BOT_H
+
+#include "sim.h"
+
+#define BOT_REACT_BUCKET_MS 20 // 反应时间直方图分桶宽度
+#define BOT_REACT_BUCKETS 128  // 分桶数，最后一桶收容更慢的样本
+
+// 一名机器人玩家
+typedef struct
+{
+  int keypad;           // 使用的按键器
+  uint32_t reaction_ms; // 平均反应时间
+  uint32_t jitter_ms;   // 反应时间随机范围（±）
+  uint32_t error_pct;   // 按错概率（%）
+  uint64_t busy_until;  // 上一次按键结束并看到画面更新的时间
+  uint32_t presses;
+} sim_bot;
+
+// 一台游戏机的会话
+typedef struct
+{
+  // 配置
+  int multi;    // 1=多人模式
+  int players;  // 玩家数（单人为1）
+  int replay;   // 1=游戏结束后回放
+  int endless;  // 1=游戏结束后继续开新局，直到虚拟时间上限
+  uint32_t rng; // 机器人随机数
+  sim_bot bots[SIM_KEYPAD_MAX];
+  // 运行状态
+  uint64_t phase_us;   // 当前阶段开始时间
+  int in_game;         // 处于游戏阶段
+  uint64_t card_until; // 上次放卡结束时间
+  // 结果
+  int finished;      // 已结束的局数
+  int result;        // 最近一局的结果（轮数或胜者）
+  uint64_t game_us;  // 最近一局的用时
+  int replay_result; // 回放结果（1=一致，0=不一致，-1=无录制）
+  uint64_t replay_us; // 回放用时
+  // 固件上报的指标
+  uint32_t tick_misses;  // 调度任务超时次数
+  uint64_t tick_over_us; // 累计超出时间
+  uint32_t react_count;  // 固件测得的反应时间样本数
+  uint64_t react_sum_us;
+  uint32_t react_buckets[BOT_REACT_BUCKETS];
+  uint32_t skew_count;  // 多个按键器时，非首个读取的次数
+  uint64_t skew_sum_us; // 与本次采样第一个读取的累计偏斜
+  uint32_t skew_max_us;
+  uint32_t input_count[SIM_KEYPAD_MAX]; // 每名玩家 采样开始→游戏处理
+  uint64_t input_sum_us[SIM_KEYPAD_MAX];
+  uint32_t input_max_us[SIM_KEYPAD_MAX];
+} bot_session;
+
+/**
+ * @brief 初始化会话，每名玩家使用一个默认机器人
+ * @param s       会话
+ * @param players 玩家数：1=单人模式，2~SIM_KEYPAD_MAX=多人模式
+ * @param seed    机器人随机数种子
+ */
+void bot_session_init(bot_session *s, int players, uint32_t seed);
+
+/**
+ * @brief 复位仿真器和固件状态，开机运行到会话结束或虚拟时间上限
+ * @param s   会话（运行期间由当前线程独占）
+ * @param cfg 仿真配置（按键器数量不足玩家数时自动补足）
+ * @retval 1=会话正常结束，0=到达时间上限
+ */
+int bot_session_run(bot_session *s, const sim_config *cfg);
+
+#endif
@@ -0,0 +1,11 @@
+//! 主机仿真用延时接口，延时只推进虚拟时钟
+
+#ifndef HOST_DELAY_H
+#define HOST_DELAY_H
+
+#include "i2c.h"
+#include "sim.h"
+
+void delay_ms(unsigned int ms);
+
+#endif
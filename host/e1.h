@@ -0,0 +1,14 @@
+//! 主机仿真用 E1 数码管与彩灯接口
+
+#ifndef HOST_E1_H
+#define HOST_E1_H
+
+#include "i2c.h"
+
+i2c_slave_info e1_tube_init(void);
+void e1_tube_str_set(i2c_slave_info info, char *str);
+i2c_slave_info e1_led_init(void);
+void e1_led_rgb_set(i2c_slave_info info, unsigned char r, unsigned char g,
+                    unsigned char b);
+
+#endif
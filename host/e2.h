@@ -0,0 +1,11 @@
+//! 主机仿真用 E2 风扇接口
+
+#ifndef HOST_E2_H
+#define HOST_E2_H
+
+#include "i2c.h"
+
+i2c_slave_info e2_fan_init(void);
+void e2_fan_speed_set(i2c_slave_info info, char speed);
+
+#endif
@@ -0,0 +1,11 @@
+//! 主机仿真用 E3 窗帘接口
+
+#ifndef HOST_E3_H
+#define HOST_E3_H
+
+#include "i2c.h"
+
+i2c_slave_info e3_curtain_init(void);
+void e3_curtain_position_set(i2c_slave_info info, unsigned char position);
+
+#endif
@@ -0,0 +1,344 @@
+//! 排行榜 flash 磨损与开机扫描测试：不经过游戏画面，直接向固件的排行榜提交
+//! 随机成绩，按固件主循环的顺序整理 flash、写入记录，每隔若干局重新开机，
+//! 可在写入中途随机掉电。每次开机后核对重建的 RAM 索引：正常关机时与参考
+//! 模型逐名一致；掉电后各名次不差于掉电前已写完的记录，也不好于参考模型。
+//! 最后不整理 flash 连续写入，直到当前页写满、只剩备用页，检查写入任务不占用
+//! 备用页，之后一次整理能压缩并写完等待中的记录。
+//! 编译：gcc -std=gnu99 -O2 -DPPP_HOST -Ihost main.c host/sim.c
+//!       host/flash_wear.c -o flash_wear
+//! 运行：./flash_wear [局数] [随机种子] [掉电概率%] [flash镜像文件]
+
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// main.c 在 PPP_HOST 下的排行榜接口
+void ppp_host_reset(void);
+void lb_boot(void);
+void lb_maintain(void);
+void lb_task(void *arg);
+int lb_pending(void);
+int lb_add_score(int mode, uint16_t player, int value, const int *scores,
+                 int players, int winner);
+int lb_add_react(uint16_t player, int slot, uint16_t count, uint16_t med_ms,
+                 uint16_t min_ms, uint16_t p95_ms);
+uint16_t lb_player_id(const unsigned char *uid);
+int lb_top_get(int board, int rank, uint16_t *value, uint16_t *player);
+
+// 与 main.c 中 LB_BOARD_*、LB_TOP_N、LB_REACT_MIN 一致
+#define BOARD_NUM 3 // 单人轮数、多人分差、反应时间
+#define BOARD_REACT 2
+#define TOP_N 8
+#define REACT_MIN 5
+
+#define CARDS 24          // 玩家卡数，多于固件身份表容量
+#define GAMES_PER_BOOT 40 // 每次开机玩的局数
+#define CUT_WORDS 64      // 掉电前最多还能编程的字数
+#define FILL_GAMES 2000   // 写满 flash 最多玩的局数
+
+typedef struct
+{
+  uint16_t value;
+  uint16_t player;
+} wear_entry;
+
+typedef struct
+{
+  wear_entry e[BOARD_NUM][TOP_N];
+  int n[BOARD_NUM];
+} wear_boards;
+
+static int games = 2000;
+static int cut_pct = 0;
+static uint32_t rng = 1;
+
+static wear_boards ref;  // 参考模型：所有提交过的记录
+static wear_boards safe; // 掉电前已写完的记录
+static uint16_t card_id[CARDS]; // 卡号对应的玩家身份，0=未知
+static int mismatches;
+
+// 统计
+static int boots, cuts, records;
+static uint32_t boot_n, boot_max_us;
+static uint64_t boot_sum_us;
+static uint32_t compactions, moved, drops, compact_fails;
+static int fill_games;
+
+static uint32_t wear_rand(void)
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static int wear_better(int b, uint16_t a, uint16_t c)
+{
+  return b == BOARD_REACT ? a < c : a > c;
+}
+
+/**
+ * @brief 参考模型上榜，与固件相同：同值时先上榜的在前
+ * @retval 名次（1起），未上榜为0
+ */
+static int ref_insert(int b, uint16_t value, uint16_t player)
+{
+  wear_entry *e = ref.e[b];
+  int n = ref.n[b], i = n;
+  if (n < TOP_N)
+    ref.n[b]++;
+  else if (wear_better(b, value, e[n - 1].value))
+    i = n - 1;
+  else
+    return 0;
+  for (; i > 0 && wear_better(b, value, e[i - 1].value); i--)
+    e[i] = e[i - 1];
+  e[i] = (wear_entry){value, player};
+  return i + 1;
+}
+
+static void read_boards(wear_boards *w)
+{
+  memset(w, 0, sizeof(*w));
+  for (int b = 0; b < BOARD_NUM; b++)
+  {
+    while (w->n[b] < TOP_N &&
+           lb_top_get(b, w->n[b] + 1, &w->e[b][w->n[b]].value,
+                      &w->e[b][w->n[b]].player))
+      w->n[b]++;
+  }
+}
+
+static void mismatch(const char *what, int b, int rank)
+{
+  if (mismatches++ < 10)
+    printf("MISMATCH boot=%d %s board=%d rank=%d\n", boots, what, b, rank);
+}
+
+/**
+ * @brief 检查 hi 的每个名次都不差于 lo
+ */
+static void check_dominates(const wear_boards *hi, const wear_boards *lo,
+                            const char *what)
+{
+  for (int b = 0; b < BOARD_NUM; b++)
+  {
+    for (int i = 0; i < lo->n[b]; i++)
+    {
+      if (i >= hi->n[b] ||
+          wear_better(b, lo->e[b][i].value, hi->e[b][i].value))
+      {
+        mismatch(what, b, i + 1);
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * @brief 开机后核对索引
+ * @param clean 上次是正常关机
+ */
+static void check_boot(int clean)
+{
+  wear_boards fw;
+  read_boards(&fw);
+  if (clean && memcmp(&fw, &ref, sizeof(fw)) != 0)
+    mismatch("clean", -1, 0);
+  check_dominates(&fw, &safe, "lost");
+  check_dominates(&ref, &fw, "phantom");
+
+  // 身份在正常关机后保持不变；掉电可能丢掉最后登记的身份，重新学习
+  for (int c = 0; c < CARDS; c++)
+  {
+    if (!clean)
+      card_id[c] = 0;
+    else if (card_id[c])
+    {
+      unsigned char uid[4] = {0xC0, 0xDE, 0, (unsigned char)c};
+      if (lb_player_id(uid) != card_id[c])
+        mismatch("player", -1, c);
+    }
+  }
+  ref = fw; // 掉电时丢失的记录从参考模型中去掉
+  safe = fw;
+}
+
+/**
+ * @brief 提交一局随机的成绩，核对返回的名次
+ */
+static void wear_game(void)
+{
+  int mode = wear_rand() % 2 + 1;
+  int players = mode == 1 ? 1 : 2 + wear_rand() % 3;
+  uint16_t player = 0;
+  if (mode == 1 && wear_rand() % 4)
+  {
+    int c = wear_rand() % CARDS;
+    unsigned char uid[4] = {0xC0, 0xDE, 0, (unsigned char)c};
+    player = lb_player_id(uid);
+    if (player && card_id[c] && player != card_id[c])
+      mismatch("player", -1, c);
+    card_id[c] = player;
+  }
+
+  int scores[4] = {0};
+  int value = mode == 1 ? 1 + wear_rand() % 200 : 1 + wear_rand() % 50;
+  for (int p = 0; p < players; p++)
+    scores[p] = wear_rand() % 50;
+  int rank = lb_add_score(mode, player, value, scores, players, 1);
+  if (rank != ref_insert(mode - 1, value, player))
+    mismatch("rank", mode - 1, rank);
+  records++;
+
+  for (int p = 0; p < players; p++)
+  {
+    uint16_t count = wear_rand() % 30;
+    uint16_t med = 150 + 20 * (wear_rand() % 40);
+    uint16_t who = mode == 1 ? player : 0;
+    rank = lb_add_react(who, p, count, med, med / 2, med * 2);
+    int want = count >= REACT_MIN ? ref_insert(BOARD_REACT, med, who) : 0;
+    if (rank != want)
+      mismatch("rank", BOARD_REACT, rank);
+    records++;
+  }
+}
+
+/**
+ * @brief 不整理 flash 连续玩，直到写入任务因只剩备用页而等待，再整理一次
+ */
+static void wear_fill(void)
+{
+  uint32_t fails = compact_fails, dropped = drops;
+  int stalled = 0;
+  while (!stalled && fill_games < FILL_GAMES)
+  {
+    wear_game();
+    fill_games++;
+    for (int i = 0; i < 100 && lb_pending(); i++)
+      lb_task(NULL);
+    stalled = lb_pending() != 0;
+  }
+  if (!stalled)
+    mismatch("fill", -1, 0);
+  lb_maintain(); // 当前页已满，压缩只能使用备用页
+  for (int i = 0; i < 100 && lb_pending(); i++)
+    lb_task(NULL);
+  if (lb_pending() || compact_fails != fails || drops != dropped)
+    mismatch("spare", -1, 0);
+  safe = ref;
+}
+
+static int wear_run(void)
+{
+  int played = 0, clean = 1;
+  while (played < games)
+  {
+    ppp_host_reset();
+    lb_boot();
+    boots++;
+    check_boot(clean);
+    clean = 1;
+
+    int cut_at = -1;
+    if (cut_pct && (int)(wear_rand() % 100) < cut_pct)
+      cut_at = wear_rand() % GAMES_PER_BOOT;
+    for (int g = 0; g < GAMES_PER_BOOT && played < games; g++, played++)
+    {
+      wear_game();
+      if (g == cut_at)
+      {
+        sim_flash_power_cut(wear_rand() % CUT_WORDS);
+        clean = 0;
+        cuts++;
+      }
+      lb_maintain(); // 主循环开头
+      for (int i = 0; i < 100 && lb_pending(); i++)
+        lb_task(NULL); // 欢迎界面，没有空页时等待
+      if (!clean)
+        break;
+      if (lb_pending())
+        mismatch("stall", -1, 0);
+      safe = ref;
+    }
+    sim_flash_power_cut(-1); // 重新上电
+  }
+  ppp_host_reset();
+  lb_boot();
+  check_boot(clean);
+  wear_fill();
+  ppp_host_reset();
+  lb_boot();
+  check_boot(1);
+  return 0;
+}
+
+static void on_event(const char *name, int value)
+{
+  if (strcmp(name, "lb_boot") == 0)
+  {
+    boot_n++;
+    boot_sum_us += (uint32_t)value;
+    if ((uint32_t)value > boot_max_us)
+      boot_max_us = value;
+  }
+  else if (strcmp(name, "lb_compact") == 0)
+  {
+    compactions++;
+    moved += value;
+  }
+  else if (strcmp(name, "lb_drop") == 0)
+  {
+    drops++;
+  }
+  else if (strcmp(name, "lb_compact_fail") == 0)
+  {
+    compact_fails++;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  sim_config cfg;
+  sim_config_default(&cfg);
+  cfg.limit_us = ~0ull;
+  if (argc > 1)
+    games = atoi(argv[1]);
+  if (argc > 2)
+    rng = (uint32_t)atoi(argv[2]) * 2654435761u + 1;
+  if (argc > 3)
+    cut_pct = atoi(argv[3]);
+  if (argc > 4)
+    cfg.flash_file = argv[4];
+
+  sim_hooks hooks = {on_event, NULL, NULL};
+  sim_reset(&cfg, &hooks);
+  // 镜像文件中已有的记录作为参考模型的起点
+  ppp_host_reset();
+  lb_boot();
+  read_boards(&ref);
+  safe = ref;
+  sim_run(wear_run);
+
+  printf("games=%d records=%d boots=%d power_cuts=%d\n", games, records, boots,
+         cuts);
+  printf("compactions=%u moved=%u dropped=%u compact_fails=%u\n", compactions,
+         moved, drops, compact_fails);
+  printf("fill: games=%d\n", fill_games);
+  printf("boot scan: n=%u avg=%lluus max=%uus\n", boot_n,
+         boot_n ? (unsigned long long)(boot_sum_us / boot_n) : 0ull,
+         boot_max_us);
+  sim_flash_report();
+  static const char *const NAMES[BOARD_NUM] = {"solo", "multi", "react"};
+  for (int b = 0; b < BOARD_NUM; b++)
+  {
+    printf("%-5s", NAMES[b]);
+    for (int i = 0; i < ref.n[b]; i++)
+      printf(" %u/p%u", ref.e[b][i].value, ref.e[b][i].player);
+    printf("\n");
+  }
+  printf("check: %s (%d mismatches)\n", mismatches ? "FAIL" : "ok",
+         mismatches);
+  return mismatches != 0;
+}
@@ -0,0 +1,353 @@
+//! 主机多机压力测试：在工作窃取线程池上运行 N 台独立的仿真游戏机，每台都是
+//! 完整的固件（欢迎界面 -> 选择模式 -> 游戏）加仿真外设和机器人玩家，虚拟时钟
+//! 各自独立；汇总全场的 I2C 流量、调度超时和反应时间，并给出整条固件路径的
+//! 吞吐量。
+//! 编译：gcc -std=gnu11 -O2 -pthread -DPPP_HOST -DPPP_FLEET -Ihost main.c
+//!       host/sim.c host/bot.c host/fleet.c -o ppp_fleet
+//! 运行：./ppp_fleet [solo|multi|mix] [台数] [线程数，0=全部核心]
+//!                   [每台虚拟秒数] [随机种子] [bus=总线布局1|2|3]
+//!                   [players=多人模式玩家数2~4]
+//!       mix：单人、多人交替
+
+#include "bot.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct
+{
+  const char *mode;
+  int instances;
+  int threads;
+  uint32_t seconds; // 每台运行的虚拟时间
+  uint32_t seed;
+  int buses;
+  int players; // 多人模式玩家数
+} fleet_config;
+
+// 全场汇总，每台结束时合并
+typedef struct
+{
+  atomic_uint_fast64_t instances;
+  atomic_uint_fast64_t games;
+  atomic_uint_fast64_t presses;
+  atomic_uint_fast64_t virtual_us;
+  atomic_uint_fast64_t tick_misses;
+  atomic_uint_fast64_t tick_over_us;
+  atomic_uint_fast64_t react_count;
+  atomic_uint_fast64_t react_sum_us;
+  atomic_uint_fast64_t react_buckets[BOT_REACT_BUCKETS];
+  atomic_uint_fast64_t skew_count;
+  atomic_uint_fast64_t skew_sum_us;
+  atomic_uint_fast64_t skew_max_us;
+  atomic_uint_fast64_t input_count[SIM_KEYPAD_MAX];
+  atomic_uint_fast64_t input_sum_us[SIM_KEYPAD_MAX];
+  atomic_uint_fast64_t input_max_us[SIM_KEYPAD_MAX];
+  atomic_uint_fast64_t transactions[SIM_DEV_NUM];
+  atomic_uint_fast64_t bytes[SIM_DEV_NUM];
+  atomic_uint_fast64_t bus_us[SIM_DEV_NUM];
+  atomic_uint_fast64_t steals;
+} fleet_result;
+
+// 每个工作线程一个双端队列：自己从尾部取（后进先出），空闲线程从别人的
+// 头部窃取（先进先出）。任务是台号，运行中不会产生新任务，所有队列都取空
+// 即可退出。
+typedef struct
+{
+  pthread_mutex_t lock;
+  int *items;
+  int head; // 窃取端
+  int tail; // 所有者端
+} fleet_deque;
+
+static fleet_config cfg;
+static fleet_result total;
+static fleet_deque *deques;
+static sim_config sim_cfg;
+
+static int deque_pop(fleet_deque *q)
+{
+  int id = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->tail > q->head)
+    id = q->items[--q->tail];
+  pthread_mutex_unlock(&q->lock);
+  return id;
+}
+
+static int deque_steal(fleet_deque *q)
+{
+  int id = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->tail > q->head)
+    id = q->items[q->head++];
+  pthread_mutex_unlock(&q->lock);
+  return id;
+}
+
+/**
+ * @brief 取下一台：先取自己的队列，空了再依次窃取其他线程的
+ * @retval 台号，全部取完返回-1
+ */
+static int fleet_next(int self)
+{
+  int id = deque_pop(&deques[self]);
+  for (int i = 1; id < 0 && i < cfg.threads; i++)
+  {
+    id = deque_steal(&deques[(self + i) % cfg.threads]);
+    if (id >= 0)
+      atomic_fetch_add(&total.steals, 1);
+  }
+  return id;
+}
+
+// 一台的玩家数（1=单人模式）
+static int instance_players(int id)
+{
+  if (strcmp(cfg.mode, "mix") == 0)
+    return id & 1 ? cfg.players : 1;
+  return strcmp(cfg.mode, "solo") != 0 ? cfg.players : 1;
+}
+
+static void atomic_max(atomic_uint_fast64_t *a, uint64_t v)
+{
+  uint_fast64_t cur = atomic_load(a);
+  while (v > cur && !atomic_compare_exchange_weak(a, &cur, v))
+    ;
+}
+
+/**
+ * @brief 在当前线程上运行一台游戏机并合并结果
+ */
+static void run_instance(int id)
+{
+  sim_config c = sim_cfg;
+  c.seed = cfg.seed + (uint32_t)id;
+  bot_session s;
+  bot_session_init(&s, instance_players(id), c.seed);
+  s.endless = 1;
+  bot_session_run(&s, &c);
+
+  atomic_fetch_add(&total.instances, 1);
+  atomic_fetch_add(&total.games, s.finished);
+  for (int p = 0; p < s.players; p++)
+  {
+    atomic_fetch_add(&total.presses, s.bots[p].presses);
+    atomic_fetch_add(&total.input_count[p], s.input_count[p]);
+    atomic_fetch_add(&total.input_sum_us[p], s.input_sum_us[p]);
+    atomic_max(&total.input_max_us[p], s.input_max_us[p]);
+  }
+  atomic_fetch_add(&total.virtual_us, sim_time_us());
+  atomic_fetch_add(&total.tick_misses, s.tick_misses);
+  atomic_fetch_add(&total.tick_over_us, s.tick_over_us);
+  atomic_fetch_add(&total.react_count, s.react_count);
+  atomic_fetch_add(&total.react_sum_us, s.react_sum_us);
+  for (int i = 0; i < BOT_REACT_BUCKETS; i++)
+  {
+    if (s.react_buckets[i])
+      atomic_fetch_add(&total.react_buckets[i], s.react_buckets[i]);
+  }
+  atomic_fetch_add(&total.skew_count, s.skew_count);
+  atomic_fetch_add(&total.skew_sum_us, s.skew_sum_us);
+  atomic_max(&total.skew_max_us, s.skew_max_us);
+  const sim_bus_stat *st = sim_bus_stats();
+  for (int i = 0; i < SIM_DEV_NUM; i++)
+  {
+    atomic_fetch_add(&total.transactions[i], st[i].transactions);
+    atomic_fetch_add(&total.bytes[i], st[i].bytes);
+    atomic_fetch_add(&total.bus_us[i], st[i].bus_us);
+  }
+}
+
+static void *worker(void *arg)
+{
+  int self = (int)(uintptr_t)arg;
+  for (int id; (id = fleet_next(self)) >= 0;)
+    run_instance(id);
+  return NULL;
+}
+
+// 反应时间百分位（取所在分桶的上沿，毫秒）
+static uint32_t react_percentile(uint64_t count, int pct)
+{
+  uint64_t rank = (count * pct + 99) / 100, seen = 0;
+  int b = 0;
+  for (; b < BOT_REACT_BUCKETS - 1; b++)
+  {
+    seen += atomic_load(&total.react_buckets[b]);
+    if (seen >= rank)
+      break;
+  }
+  return (uint32_t)(b + 1) * BOT_REACT_BUCKET_MS;
+}
+
+int main(int argc, char **argv)
+{
+  cfg.mode = "mix";
+  cfg.instances = 64;
+  cfg.seconds = 300;
+  cfg.seed = 1;
+  cfg.buses = 1;
+  cfg.players = 2;
+
+  int pos = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp(argv[i], "bus=", 4) == 0)
+    {
+      cfg.buses = atoi(argv[i] + 4);
+      continue;
+    }
+    if (strncmp(argv[i], "players=", 8) == 0)
+    {
+      cfg.players = atoi(argv[i] + 8);
+      continue;
+    }
+    switch (pos++) // 位置参数
+    {
+    case 0:
+      cfg.mode = argv[i];
+      break;
+    case 1:
+      cfg.instances = atoi(argv[i]);
+      break;
+    case 2:
+      cfg.threads = atoi(argv[i]);
+      break;
+    case 3:
+      cfg.seconds = (uint32_t)atoi(argv[i]);
+      break;
+    case 4:
+      cfg.seed = (uint32_t)strtoul(argv[i], NULL, 10);
+      break;
+    }
+  }
+  if (cfg.instances <= 0)
+    return 1;
+  if (cfg.players < 2)
+    cfg.players = 2;
+  if (cfg.players > SIM_KEYPAD_MAX)
+    cfg.players = SIM_KEYPAD_MAX;
+  if (cfg.threads <= 0)
+    cfg.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (cfg.threads <= 0)
+    cfg.threads = 1;
+
+  sim_config_default(&sim_cfg);
+  sim_cfg.limit_us = (uint64_t)cfg.seconds * 1000000;
+  if (cfg.buses == 2)
+    sim_config_split_buses(&sim_cfg);
+  else if (cfg.buses >= 3)
+    sim_config_player_buses(&sim_cfg);
+
+  // 台号轮流分到各线程的队列
+  deques = calloc(cfg.threads, sizeof(fleet_deque));
+  for (int t = 0; t < cfg.threads; t++)
+  {
+    pthread_mutex_init(&deques[t].lock, NULL);
+    deques[t].items = calloc(cfg.instances / cfg.threads + 1, sizeof(int));
+  }
+  for (int id = 0; id < cfg.instances; id++)
+  {
+    fleet_deque *q = &deques[id % cfg.threads];
+    q->items[q->tail++] = id;
+  }
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  pthread_t *tids = calloc(cfg.threads, sizeof(pthread_t));
+  for (int i = 0; i < cfg.threads; i++)
+    pthread_create(&tids[i], NULL, worker, (void *)(uintptr_t)i);
+  for (int i = 0; i < cfg.threads; i++)
+    pthread_join(tids[i], NULL);
+  free(tids);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  for (int t = 0; t < cfg.threads; t++)
+  {
+    pthread_mutex_destroy(&deques[t].lock);
+    free(deques[t].items);
+  }
+  free(deques);
+
+  double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  uint64_t instances = atomic_load(&total.instances);
+  double virt = atomic_load(&total.virtual_us) / 1e6;
+  printf("mode=%s players=%d instances=%llu threads=%d bus=%d wall=%.3fs "
+         "steals=%llu\n",
+         cfg.mode, cfg.players, (unsigned long long)instances, cfg.threads,
+         cfg.buses, wall,
+         (unsigned long long)atomic_load(&total.steals));
+  printf("virtual=%.0fs (%.1fs/instance) speedup=%.0fx instances/s=%.2f\n",
+         virt, instances ? virt / instances : 0.0, wall > 0 ? virt / wall : 0.0,
+         wall > 0 ? instances / wall : 0.0);
+  printf("games=%llu presses=%llu (%.1f/min)\n",
+         (unsigned long long)atomic_load(&total.games),
+         (unsigned long long)atomic_load(&total.presses),
+         virt > 0 ? atomic_load(&total.presses) / virt * 60 : 0.0);
+
+  uint64_t misses = atomic_load(&total.tick_misses);
+  printf("tick overruns=%llu (%.2f/min) avg=%lluus\n",
+         (unsigned long long)misses, virt > 0 ? misses / virt * 60 : 0.0,
+         misses ? (unsigned long long)(atomic_load(&total.tick_over_us) /
+                                       misses)
+                : 0ull);
+
+  uint64_t n = atomic_load(&total.react_count);
+  if (n)
+  {
+    printf("react n=%llu avg=%llums med=%ums p95=%ums p99=%ums\n",
+           (unsigned long long)n,
+           (unsigned long long)(atomic_load(&total.react_sum_us) / n / 1000),
+           react_percentile(n, 50), react_percentile(n, 95),
+           react_percentile(n, 99));
+  }
+
+  uint64_t skews = atomic_load(&total.skew_count);
+  if (skews)
+  {
+    printf("key skew n=%llu avg=%lluus max=%lluus\n",
+           (unsigned long long)skews,
+           (unsigned long long)(atomic_load(&total.skew_sum_us) / skews),
+           (unsigned long long)atomic_load(&total.skew_max_us));
+  }
+
+  // 每名玩家的输入延迟（采样开始→游戏处理），玩家增多时应保持一致
+  for (int p = 0; p < SIM_KEYPAD_MAX; p++)
+  {
+    uint64_t count = atomic_load(&total.input_count[p]);
+    if (count == 0)
+      continue;
+    printf("input p%d n=%llu avg=%lluus max=%lluus\n", p + 1,
+           (unsigned long long)count,
+           (unsigned long long)(atomic_load(&total.input_sum_us[p]) / count),
+           (unsigned long long)atomic_load(&total.input_max_us[p]));
+  }
+
+  // I2C：每个外设的全场流量，总线占用率按全场虚拟时间计算
+  uint64_t bus_us[SIM_BUS_NUM] = {0};
+  printf("%-8s %3s %14s %14s %8s\n", "device", "bus", "transfers", "bytes",
+         "busy%");
+  for (int i = 0; i < SIM_DEV_NUM; i++)
+  {
+    uint64_t tx = atomic_load(&total.transactions[i]);
+    if (tx == 0)
+      continue;
+    uint64_t us = atomic_load(&total.bus_us[i]);
+    bus_us[sim_cfg.bus[i]] += us;
+    printf("%-8s %3d %14llu %14llu %7.2f%%\n", sim_dev_name(i),
+           sim_cfg.bus[i], (unsigned long long)tx,
+           (unsigned long long)atomic_load(&total.bytes[i]),
+           virt > 0 ? us / 1e4 / virt : 0.0);
+  }
+  for (int b = 0; b < SIM_BUS_NUM; b++)
+  {
+    if (bus_us[b])
+      printf("%-8s %3d %14s %14s %7.2f%%\n", "bus", b, "", "",
+             bus_us[b] / 1e4 / virt);
+  }
+  return 0;
+}
@@ -0,0 +1,47 @@
+//! 主机仿真用 I2C 接口，替代厂商库中的同名声明
+
+#ifndef HOST_I2C_H
+#define HOST_I2C_H
+
+// I2C 从设备信息
+typedef struct
+{
+  unsigned int periph; // 所在 I2C 控制器
+  unsigned char addr;  // 从设备地址
+  unsigned char flag;  // 1=设备存在
+} i2c_slave_info;
+
+// 仿真板上的 I2C 控制器
+extern const unsigned int I2C_PERIPH_NUM[2];
+
+void i2c_init(void);
+i2c_slave_info i2c_slave_detect(unsigned int i2c_periph, unsigned char addr);
+void i2c_byte_write(i2c_slave_info info, unsigned char data);
+void i2c_reg_byte_write(i2c_slave_info info, unsigned char reg,
+                        unsigned char data);
+void i2c_reg_buf_write(i2c_slave_info info, unsigned char reg,
+                       const unsigned char *buf, int len);
+void i2c_reg_buf_read(i2c_slave_info info, unsigned char reg,
+                      unsigned char *buf, int len);
+
+// 仿真器支持地址自增的多字节读写
+#define I2C_REG_BUF_WRITE(info, reg, buf, len)                                 \
+  i2c_reg_buf_write(info, reg, buf, len)
+#define I2C_REG_BUF_READ(info, reg, buf, len)                                  \
+  i2c_reg_buf_read(info, reg, buf, len)
+
+// 仿真器的异步传输后端（模拟 DMA）：启动后立即返回，传输时间在虚拟时钟中
+// 后台流逝，完成时才写入外设或读出数据；同一控制器上的同步传输先等待其完成
+int i2c_async_start(i2c_slave_info info, int read, unsigned char reg,
+                    unsigned char *buf, int len);
+int i2c_async_busy(i2c_slave_info info);
+
+// 定义 SIM_I2C_SYNC 时不提供异步后端，作业队列与 GD32F4 板上一样在推进时
+// 同步执行，用于覆盖板上实际运行的路径
+#ifndef SIM_I2C_SYNC
+#define I2C_ASYNC_START(info, read, reg, buf, len)                             \
+  i2c_async_start(info, read, reg, buf, len)
+#define I2C_ASYNC_BUSY(info) i2c_async_busy(info)
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+//! 按键器译码核对：在仿真按键器的键值RAM中逐一按下每一位（3行×13列），分别
+//! 用固件的键值RAM译码（S1_KEY_MAP，连续读路径）和厂商 s1_key_value_get 的
+//! 译码模型读出，逐位比较，并检查厂商的每个键值恰好对应一位。
+//! 编译：gcc -std=gnu99 -O2 -DPPP_HOST -Ihost main.c host/sim.c
+//!       host/key_map.c -o key_map
+//! 运行：./key_map
+
+#include "delay.h"
+#include "s1.h"
+#include "sim.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// main.c 在 PPP_HOST 下的按键接口
+void ppp_host_reset(void);
+char s1_key_ram_decode(const uint8_t *ram);
+int s1_key_map_check(i2c_slave_info info, char key);
+
+#define KEY_ROWS 3  // KS0~KS2
+#define KEY_COLS 13 // K1~K13
+#define KEY_RAM 0x40
+#define PRESS_MS 10
+
+static int mismatches, mapped;
+static char keys_seen[KEY_ROWS * KEY_COLS];
+static int keys_n;
+
+static int key_map_main(void)
+{
+  ppp_host_reset();
+  i2c_slave_info info = s1_key_init();
+  for (int r = 0; r < KEY_ROWS; r++)
+  {
+    for (int c = 0; c < KEY_COLS; c++)
+    {
+      sim_key_bit(0, r, c, sim_time_us(), PRESS_MS * 1000);
+      uint8_t ram[6];
+      i2c_reg_buf_read(info, KEY_RAM, ram, sizeof(ram));
+      char fw = s1_key_ram_decode(ram);
+      char vendor = s1_key_value_get(info);
+      if (fw != vendor || !s1_key_map_check(info, vendor))
+      {
+        if (mismatches++ < 10)
+          printf("MISMATCH KS%d K%d: map=%c vendor=%c\n", r, c + 1,
+                 fw ? fw : '-', vendor ? vendor : '-');
+      }
+      if (vendor)
+      {
+        mapped++;
+        for (int i = 0; i < keys_n; i++)
+        {
+          if (keys_seen[i] == vendor && mismatches++ < 10)
+            printf("DUPLICATE key %c at KS%d K%d\n", vendor, r, c + 1);
+        }
+        keys_seen[keys_n++] = vendor;
+      }
+      delay_ms(PRESS_MS * 2); // 松开后再按下一位
+    }
+  }
+  return 0;
+}
+
+int main(void)
+{
+  sim_config cfg;
+  sim_config_default(&cfg);
+  cfg.limit_us = ~0ull;
+  sim_reset(&cfg, NULL);
+  sim_run(key_map_main);
+
+  printf("bits=%d mapped=%d\n", KEY_ROWS * KEY_COLS, mapped);
+  printf("check: %s (%d mismatches)\n", mismatches ? "FAIL" : "ok",
+         mismatches);
+  return mismatches != 0;
+}
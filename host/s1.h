@@ -0,0 +1,13 @@
+//! 主机仿真用 S1 按键接口
+
+#ifndef HOST_S1_H
+#define HOST_S1_H
+
+#include "i2c.h"
+
+#define SWN 0 // 无按键
+
+i2c_slave_info s1_key_init(void);
+char s1_key_value_get(i2c_slave_info info);
+
+#endif
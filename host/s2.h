@@ -0,0 +1,18 @@
+//! 主机仿真用 S2 惯性与温湿度传感器接口
+
+#ifndef HOST_S2_H
+#define HOST_S2_H
+
+#include "i2c.h"
+
+typedef struct
+{
+  float temp; // 温度（摄氏度）
+  float humi; // 湿度（%RH）
+} s2_ths_t;
+
+i2c_slave_info s2_imu_init(void);
+i2c_slave_info s2_ths_init(void);
+s2_ths_t s2_ths_value_get(i2c_slave_info info);
+
+#endif
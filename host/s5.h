@@ -0,0 +1,18 @@
+//! 主机仿真用 S5 NFC 接口
+
+#ifndef HOST_S5_H
+#define HOST_S5_H
+
+#include "i2c.h"
+
+#define MI_OK 0
+#define MI_NOTAGERR 1
+#define PICC_REQIDL 0x26 // 寻天线区内未休眠的卡
+#define PICC_REQALL 0x52 // 寻天线区内全部卡
+
+i2c_slave_info s5_nfc_init(void);
+char s5_nfc_request(i2c_slave_info info, unsigned char req_code,
+                    unsigned char *tag_type);
+char s5_nfc_anticoll(i2c_slave_info info, unsigned char *snr);
+
+#endif
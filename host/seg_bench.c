@@ -0,0 +1,172 @@
+//! 段码编码微基准：比较固件的查表编码（TUBE_SEG_TABLE）与原来每位8次判断的
+//! 分支编码，按帧（4位数码管写成8个显存字节）计时，并核对两者对全部256个
+//! 段掩码的编码一致。
+//! 编译：gcc -std=gnu99 -O2 host/seg_bench.c -o seg_bench
+//! 运行：./seg_bench [帧数] [重复次数]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// 与 main.c 中 SEG_*、TUBE_SEG_* 一致
+#define SEG_A (1 << 0)
+#define SEG_B (1 << 1)
+#define SEG_C (1 << 2)
+#define SEG_D (1 << 3)
+#define SEG_E (1 << 4)
+#define SEG_F (1 << 5)
+#define SEG_G (1 << 6)
+#define SEG_DP (1 << 7)
+
+#define TUBE_SEG_LOW(m)                                                        \
+  ((((m) & SEG_A) ? 0x08 : 0) | (((m) & SEG_B) ? 0x10 : 0) |                   \
+   (((m) & SEG_C) ? 0x20 : 0) | (((m) & SEG_D) ? 0x40 : 0) |                   \
+   (((m) & SEG_E) ? 0x80 : 0))
+#define TUBE_SEG_HIGH(m)                                                       \
+  ((((m) & SEG_F) ? 0x01 : 0) | (((m) & SEG_G) ? 0x02 : 0) |                   \
+   (((m) & SEG_DP) ? 0x04 : 0))
+#define TUBE_SEG_CODE(m) (TUBE_SEG_LOW(m) | (TUBE_SEG_HIGH(m) << 8))
+#define TUBE_SEG_CODE4(m)                                                      \
+  TUBE_SEG_CODE(m), TUBE_SEG_CODE((m) + 1), TUBE_SEG_CODE((m) + 2),            \
+      TUBE_SEG_CODE((m) + 3)
+#define TUBE_SEG_CODE16(m)                                                     \
+  TUBE_SEG_CODE4(m), TUBE_SEG_CODE4((m) + 4), TUBE_SEG_CODE4((m) + 8),         \
+      TUBE_SEG_CODE4((m) + 12)
+#define TUBE_SEG_CODE64(m)                                                     \
+  TUBE_SEG_CODE16(m), TUBE_SEG_CODE16((m) + 16), TUBE_SEG_CODE16((m) + 32),    \
+      TUBE_SEG_CODE16((m) + 48)
+
+static const uint16_t TUBE_SEG_TABLE[256] = {
+    TUBE_SEG_CODE64(0),
+    TUBE_SEG_CODE64(64),
+    TUBE_SEG_CODE64(128),
+    TUBE_SEG_CODE64(192),
+};
+
+#define FRAME_BYTES 8 // 4位，每位低、高两个显存字节
+
+/**
+ * @brief 原来的编码：每位8次判断
+ */
+__attribute__((noinline)) static void encode_branch(const uint8_t *seg_mask,
+                                                    uint8_t *ram)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    unsigned char low = 0, high = 0;
+    if (seg_mask[i] & SEG_A)
+      low |= 0x08;
+    if (seg_mask[i] & SEG_B)
+      low |= 0x10;
+    if (seg_mask[i] & SEG_C)
+      low |= 0x20;
+    if (seg_mask[i] & SEG_D)
+      low |= 0x40;
+    if (seg_mask[i] & SEG_E)
+      low |= 0x80;
+    if (seg_mask[i] & SEG_F)
+      high |= 0x01;
+    if (seg_mask[i] & SEG_G)
+      high |= 0x02;
+    if (seg_mask[i] & SEG_DP)
+      high |= 0x04;
+    ram[i * 2] = low;
+    ram[i * 2 + 1] = high;
+  }
+}
+
+/**
+ * @brief 固件的编码：每位查一次表（tube_fb_put）
+ */
+__attribute__((noinline)) static void encode_table(const uint8_t *seg_mask,
+                                                   uint8_t *ram)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    uint16_t code = TUBE_SEG_TABLE[seg_mask[i]];
+    ram[i * 2] = (uint8_t)code;
+    ram[i * 2 + 1] = (uint8_t)(code >> 8);
+  }
+}
+
+static double now_s(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 编码全部帧，返回最快一遍的用时
+ * @param sum 输出显存字节的校验和，防止编码被优化掉
+ */
+static double bench(void (*encode)(const uint8_t *, uint8_t *),
+                    const uint8_t *masks, int frames, int repeat,
+                    uint64_t *sum)
+{
+  double best = 1e9;
+  for (int r = 0; r < repeat; r++)
+  {
+    uint8_t ram[FRAME_BYTES];
+    uint64_t s = 0;
+    double t0 = now_s();
+    for (int f = 0; f < frames; f++)
+    {
+      uint64_t v;
+      encode(&masks[f * 4], ram);
+      memcpy(&v, ram, sizeof(v));
+      s = (s << 1 | s >> 63) ^ v;
+    }
+    double t = now_s() - t0;
+    best = t < best ? t : best;
+    *sum = s;
+  }
+  return best;
+}
+
+int main(int argc, char **argv)
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 1000000;
+  int repeat = argc > 2 ? atoi(argv[2]) : 5;
+  if (frames <= 0 || repeat <= 0)
+    return 1;
+
+  // 两种编码对每个段掩码的结果必须一致
+  int mismatches = 0;
+  for (int m = 0; m < 256; m++)
+  {
+    uint8_t mask[4] = {(uint8_t)m, 0, 0, 0}, a[FRAME_BYTES], b[FRAME_BYTES];
+    encode_branch(mask, a);
+    encode_table(mask, b);
+    if (a[0] != b[0] || a[1] != b[1])
+      mismatches++;
+  }
+
+  // 随机段掩码帧（xorshift32），分支无法预测，接近文字和跑马灯的情况
+  uint8_t *masks = malloc((size_t)frames * 4);
+  if (!masks)
+    return 1;
+  uint32_t x = 2463534242u;
+  for (int i = 0; i < frames * 4; i++)
+  {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    masks[i] = (uint8_t)x;
+  }
+
+  uint64_t sum_branch = 0, sum_table = 0;
+  double t_branch = bench(encode_branch, masks, frames, repeat, &sum_branch);
+  double t_table = bench(encode_table, masks, frames, repeat, &sum_table);
+  free(masks);
+
+  printf("frames=%d repeat=%d (best of)\n", frames, repeat);
+  printf("branch %8.2f ns/frame\n", t_branch * 1e9 / frames);
+  printf("table  %8.2f ns/frame  speedup=%.2fx\n", t_table * 1e9 / frames,
+         t_table > 0 ? t_branch / t_table : 0.0);
+  int ok = mismatches == 0 && sum_branch == sum_table;
+  printf("check: %s (%d mismatches)\n", ok ? "ok" : "FAIL", mismatches);
+  return !ok;
+}
@@ -0,0 +1,979 @@
+//! 主机仿真器实现：虚拟时钟、I2C 总线计时与外设模型
+//! 总线时间按 (字节数*9 + 起止位) / I2C 时钟 计算，传感器转换、射频交互等
+//! 器件内部耗时按典型值直接推进虚拟时钟。
+
+#include "sim.h"
+#include "delay.h"
+#include "e1.h"
+#include "e2.h"
+#include "e3.h"
+#include "s1.h"
+#include "s2.h"
+#include "s5.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+
+const unsigned int I2C_PERIPH_NUM[2] = {0, 1};
+
+// 外设地址表（仿真板布局），所在控制器由 sim_config.bus 决定
+typedef struct
+{
+  const char *name;
+  unsigned char addr;
+} sim_dev_info;
+
+static const sim_dev_info SIM_DEVS[SIM_DEV_NUM] = {
+    [SIM_DEV_TUBE] = {"tube", 0x70},
+    [SIM_DEV_LED] = {"led", 0x60},
+    [SIM_DEV_FAN] = {"fan", 0x50},
+    [SIM_DEV_CURTAIN] = {"curtain", 0x51},
+    [SIM_DEV_KEY0] = {"key0", 0x74},
+    [SIM_DEV_KEY1] = {"key1", 0x75},
+    [SIM_DEV_KEY2] = {"key2", 0x76},
+    [SIM_DEV_KEY3] = {"key3", 0x77},
+    [SIM_DEV_IMU] = {"imu", 0x68},
+    [SIM_DEV_THS] = {"ths", 0x44},
+    [SIM_DEV_NFC] = {"nfc", 0x28},
+};
+
+// 器件内部耗时
+#define SIM_THS_CONVERT_US 15000 // 温湿度转换
+#define SIM_NFC_RF_US 1000       // 射频交互
+#define SIM_NFC_REQ_REGS 8       // 寻卡时的寄存器访问次数
+#define SIM_NFC_ANTICOLL_REGS 10 // 防冲突时的寄存器访问次数
+
+// flash 耗时（GD32F4 典型值的量级，擦除按一页折算）
+#define SIM_FLASH_PROGRAM_US 16 // 每字编程
+#define SIM_FLASH_ERASE_US 50000 // 每页擦除
+#define SIM_FLASH_READ_NS 20     // 每字节读取并由固件校验 CRC
+#define SIM_FLASH_SIZE (SIM_FLASH_PAGES * SIM_FLASH_PAGE_SIZE)
+
+// 异步传输（I2C_ASYNC_START），每个控制器同时只有一个
+#define SIM_ASYNC_DATA 32
+
+typedef struct
+{
+  int active;
+  uint64_t done_us; // 传输结束时间
+  int dev;
+  int read;
+  unsigned char reg;
+  int len;
+  unsigned char data[SIM_ASYNC_DATA]; // 待写入的数据
+  unsigned char *buf;                 // 读出数据的目标
+} sim_async;
+
+// 输入脚本
+#define SIM_SCRIPT_MAX 64
+
+typedef struct
+{
+  int value; // 按键值或卡号
+  uint64_t start_us;
+  uint64_t end_us;
+} sim_input;
+
+typedef struct
+{
+  sim_input items[SIM_SCRIPT_MAX];
+  int head;
+  int count;
+} sim_script;
+
+// 按键器键值RAM（0x40~0x45）的行列布局，即厂商 s1_key_value_get 的译码模型。
+// 厂商库源码不在仓库中，此表按厂商库返回的键值和假定的接线整理，需在板上的
+// 按键测试模式中核对；main.c 的 S1_KEY_MAP 由 host/key_map.c 与此表逐位比较
+#define SIM_KEY_RAM 0x40
+#define SIM_KEY_BIT 0x100 // 脚本值：直接按下键值RAM中的一位，低8位为行*16+列
+static const char SIM_KEY_MAP[3][4] = {
+    {'1', '2', '3', '*'},
+    {'4', '5', '6', '0'},
+    {'7', '8', '9', '#'},
+};
+
+static const unsigned char SIM_CARD_UID[2][4] = {
+    {0x93, 0x71, 0xAF, 0x95},
+    {0x63, 0x93, 0xBE, 0x95},
+};
+
+// 仿真状态
+static PPP_TLS sim_config cfg;
+static PPP_TLS sim_hooks hooks;
+static PPP_TLS uint64_t clock_us;
+static PPP_TLS jmp_buf stop_jmp;
+static PPP_TLS int running;
+static PPP_TLS sim_bus_stat stats[SIM_DEV_NUM];
+static PPP_TLS sim_async async_xfer[SIM_BUS_NUM];
+
+static PPP_TLS uint8_t tube_ram[16];
+static PPP_TLS int tube_text;
+static PPP_TLS int fan_speed;
+static PPP_TLS int curtain_position;
+static PPP_TLS uint32_t noise;
+static PPP_TLS sim_script keys[SIM_KEYPAD_MAX];
+static PPP_TLS sim_script cards;
+
+// 镜像文件依次保存 flash 内容和每页擦除次数
+static PPP_TLS uint8_t flash_mem[SIM_FLASH_SIZE];
+static PPP_TLS sim_flash_stat flash_stat;
+static PPP_TLS FILE *flash_fp;
+static PPP_TLS int32_t flash_cut;     // 掉电前还能编程的字数，-1=不掉电
+static PPP_TLS uint32_t flash_read_ns; // 读取耗时中不足1us的部分
+
+static void sim_flash_load(void);
+
+void sim_config_default(sim_config *c)
+{
+  c->i2c_hz = 100000;
+  c->cpu_us = 2;
+  c->keypads = 2;
+  c->limit_us = 60ull * 1000000;
+  c->seed = 1;
+  memset(c->bus, 0, sizeof(c->bus));
+  c->flash_file = NULL;
+}
+
+void sim_config_split_buses(sim_config *c)
+{
+  for (int i = 0; i < SIM_DEV_NUM; i++)
+  {
+    c->bus[i] = (i >= SIM_DEV_KEY0 && i <= SIM_DEV_KEY3) || i == SIM_DEV_NFC;
+  }
+}
+
+void sim_config_player_buses(sim_config *c)
+{
+  sim_config_split_buses(c);
+  c->bus[SIM_DEV_KEY0] = 0;
+  c->bus[SIM_DEV_KEY2] = 0;
+}
+
+void sim_reset(const sim_config *c, const sim_hooks *h)
+{
+  cfg = *c;
+  if (cfg.keypads < 1)
+    cfg.keypads = 1;
+  if (cfg.keypads > SIM_KEYPAD_MAX)
+    cfg.keypads = SIM_KEYPAD_MAX;
+  for (int i = 0; i < SIM_DEV_NUM; i++)
+  {
+    if (cfg.bus[i] >= SIM_BUS_NUM)
+      cfg.bus[i] = 0;
+  }
+  memset(&hooks, 0, sizeof(hooks));
+  if (h)
+    hooks = *h;
+  clock_us = 0;
+  memset(stats, 0, sizeof(stats));
+  memset(async_xfer, 0, sizeof(async_xfer));
+  memset(tube_ram, 0, sizeof(tube_ram));
+  tube_text = 0;
+  fan_speed = 0;
+  curtain_position = 0;
+  noise = cfg.seed ? cfg.seed : 1;
+  memset(keys, 0, sizeof(keys));
+  memset(&cards, 0, sizeof(cards));
+  sim_flash_load();
+}
+
+/**
+ * @brief 推进虚拟时钟，到达上限时结束仿真
+ */
+static void sim_advance(uint64_t us)
+{
+  clock_us += us;
+  if (running && clock_us >= cfg.limit_us)
+  {
+    longjmp(stop_jmp, 2);
+  }
+}
+
+int sim_run(int (*entry)(void))
+{
+  int r = setjmp(stop_jmp);
+  if (r == 0)
+  {
+    running = 1;
+    entry();
+  }
+  running = 0;
+  return r == 1;
+}
+
+void sim_stop(void)
+{
+  if (running)
+  {
+    longjmp(stop_jmp, 1);
+  }
+}
+
+uint64_t sim_time_us(void)
+{
+  return clock_us;
+}
+
+uint32_t sim_now_us(void)
+{
+  sim_advance(cfg.cpu_us);
+  return (uint32_t)clock_us;
+}
+
+void sim_event(const char *name, int value)
+{
+  if (hooks.on_event)
+  {
+    hooks.on_event(name, value);
+  }
+}
+
+// 总线
+
+/**
+ * @brief 按设备地址查找仿真外设
+ * @retval 外设序号，不存在返回-1
+ */
+static int sim_dev_find(unsigned int periph, unsigned char addr)
+{
+  for (int i = 0; i < SIM_DEV_NUM; i++)
+  {
+    if (i >= SIM_DEV_KEY0 + (int)cfg.keypads && i <= SIM_DEV_KEY3)
+      continue; // 未安装的按键器
+    if (cfg.bus[i] == periph && SIM_DEVS[i].addr == addr)
+      return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief 一次 I2C 事务的总线时间，bytes 含地址字节
+ */
+static uint64_t sim_bus_us(int dev, int bytes)
+{
+  uint64_t bits = (uint64_t)bytes * 9 + 2; // 每字节8位+应答，另加起止位
+  uint64_t us = (bits * 1000000 + cfg.i2c_hz - 1) / cfg.i2c_hz;
+  if (dev >= 0)
+  {
+    stats[dev].transactions++;
+    stats[dev].bytes += bytes;
+    stats[dev].bus_us += us;
+  }
+  return us;
+}
+
+static int sim_dev_of(i2c_slave_info info)
+{
+  return sim_dev_find(info.periph, info.addr);
+}
+
+static void sim_tube_changed(int text)
+{
+  tube_text = text;
+  if (hooks.on_display)
+  {
+    hooks.on_display();
+  }
+}
+
+/**
+ * @brief 外设寄存器写入的效果（目前只有数码管显存）
+ */
+static void sim_reg_write(int dev, unsigned char reg, const unsigned char *buf,
+                          int len)
+{
+  if (dev != SIM_DEV_TUBE)
+  {
+    return;
+  }
+  for (int i = 0; i < len && reg + i < (int)sizeof(tube_ram); i++)
+  {
+    tube_ram[reg + i] = buf[i];
+  }
+  if (len > 0)
+  {
+    sim_tube_changed(0);
+  }
+}
+
+static void sim_key_ram(int keypad, unsigned char *ram);
+
+/**
+ * @brief 外设寄存器读出（数码管显存、按键器键值RAM，其余读出0）
+ */
+static void sim_reg_read(int dev, unsigned char reg, unsigned char *buf,
+                         int len)
+{
+  unsigned char key_ram[6] = {0};
+  int keypad = dev >= SIM_DEV_KEY0 && dev <= SIM_DEV_KEY3;
+  if (keypad)
+  {
+    if (hooks.on_key_read)
+    {
+      hooks.on_key_read(dev - SIM_DEV_KEY0); // 脚本可以在读键前追加按键
+    }
+    sim_key_ram(dev - SIM_DEV_KEY0, key_ram);
+  }
+  for (int i = 0; i < len; i++)
+  {
+    int r = reg + i;
+    if (dev == SIM_DEV_TUBE && r < (int)sizeof(tube_ram))
+      buf[i] = tube_ram[r];
+    else if (keypad && r >= SIM_KEY_RAM && r < SIM_KEY_RAM + 6)
+      buf[i] = key_ram[r - SIM_KEY_RAM];
+    else
+      buf[i] = 0;
+  }
+}
+
+static void sim_async_complete(sim_async *a)
+{
+  a->active = 0;
+  if (a->read)
+    sim_reg_read(a->dev, a->reg, a->buf, a->len);
+  else
+    sim_reg_write(a->dev, a->reg, a->data, a->len);
+}
+
+/**
+ * @brief 等待控制器上的异步传输结束
+ */
+static void sim_bus_wait(unsigned int periph)
+{
+  if (periph >= SIM_BUS_NUM || !async_xfer[periph].active)
+  {
+    return;
+  }
+  sim_async *a = &async_xfer[periph];
+  if (clock_us < a->done_us)
+  {
+    sim_advance(a->done_us - clock_us);
+  }
+  sim_async_complete(a);
+}
+
+/**
+ * @brief 一次同步 I2C 事务，bytes 含地址字节
+ */
+static void sim_xfer(int dev, int bytes)
+{
+  sim_bus_wait(dev >= 0 ? cfg.bus[dev] : 0);
+  sim_advance(sim_bus_us(dev, bytes));
+}
+
+void i2c_init(void)
+{
+}
+
+i2c_slave_info i2c_slave_detect(unsigned int i2c_periph, unsigned char addr)
+{
+  i2c_slave_info info = {i2c_periph, addr, 0};
+  int dev = sim_dev_find(i2c_periph, addr);
+  sim_bus_wait(i2c_periph);
+  sim_advance(sim_bus_us(dev, 1)); // 只发送地址，检查应答
+  info.flag = dev >= 0;
+  return info;
+}
+
+void i2c_byte_write(i2c_slave_info info, unsigned char data)
+{
+  (void)data; // HT16K33 命令字节对仿真无影响
+  sim_xfer(sim_dev_of(info), 2);
+}
+
+void i2c_reg_byte_write(i2c_slave_info info, unsigned char reg,
+                        unsigned char data)
+{
+  int dev = sim_dev_of(info);
+  sim_xfer(dev, 3);
+  sim_reg_write(dev, reg, &data, 1);
+}
+
+void i2c_reg_buf_write(i2c_slave_info info, unsigned char reg,
+                       const unsigned char *buf, int len)
+{
+  int dev = sim_dev_of(info);
+  sim_xfer(dev, 2 + len);
+  sim_reg_write(dev, reg, buf, len);
+}
+
+void i2c_reg_buf_read(i2c_slave_info info, unsigned char reg,
+                      unsigned char *buf, int len)
+{
+  int dev = sim_dev_of(info);
+  sim_xfer(dev, 3 + len); // 地址+寄存器+重复起始地址+数据
+  sim_reg_read(dev, reg, buf, len);
+}
+
+int i2c_async_start(i2c_slave_info info, int read, unsigned char reg,
+                    unsigned char *buf, int len)
+{
+  int dev = sim_dev_of(info);
+  if (info.periph >= SIM_BUS_NUM || dev < 0 || len < 0 ||
+      len > SIM_ASYNC_DATA)
+  {
+    return 0; // 无应答或超出 DMA 缓冲
+  }
+  sim_bus_wait(info.periph);
+  sim_async *a = &async_xfer[info.periph];
+  // 写：地址+寄存器+数据；读：地址+寄存器+重复起始地址+数据
+  int bytes = read ? 3 + len : 2 + len;
+  a->done_us = clock_us + sim_bus_us(dev, bytes);
+  a->dev = dev;
+  a->read = read;
+  a->reg = reg;
+  a->len = len;
+  a->buf = buf;
+  if (!read && len > 0)
+    memcpy(a->data, buf, len);
+  a->active = 1;
+  return 1;
+}
+
+int i2c_async_busy(i2c_slave_info info)
+{
+  if (info.periph >= SIM_BUS_NUM || !async_xfer[info.periph].active)
+  {
+    return 0;
+  }
+  sim_async *a = &async_xfer[info.periph];
+  if (clock_us < a->done_us)
+  {
+    return 1;
+  }
+  sim_async_complete(a);
+  return 0;
+}
+
+void delay_ms(unsigned int ms)
+{
+  sim_advance((uint64_t)ms * 1000);
+}
+
+// flash
+
+/**
+ * @brief 把 flash 内容的一段和擦除次数写回镜像文件
+ */
+static void sim_flash_save(uint32_t addr, uint32_t len)
+{
+  if (!flash_fp)
+    return;
+  fseek(flash_fp, addr, SEEK_SET);
+  fwrite(flash_mem + addr, 1, len, flash_fp);
+  fseek(flash_fp, SIM_FLASH_SIZE, SEEK_SET);
+  fwrite(flash_stat.erases, sizeof(flash_stat.erases), 1, flash_fp);
+  fflush(flash_fp);
+}
+
+/**
+ * @brief 复位时载入镜像文件；文件不存在或大小不符时从全空开始
+ */
+static void sim_flash_load(void)
+{
+  if (flash_fp)
+    fclose(flash_fp);
+  flash_fp = NULL;
+  memset(flash_mem, 0xFF, sizeof(flash_mem));
+  memset(&flash_stat, 0, sizeof(flash_stat));
+  flash_cut = -1;
+  flash_read_ns = 0;
+  if (!cfg.flash_file)
+    return;
+
+  flash_fp = fopen(cfg.flash_file, "r+b");
+  if (flash_fp &&
+      fread(flash_mem, 1, SIM_FLASH_SIZE, flash_fp) == SIM_FLASH_SIZE &&
+      fread(flash_stat.erases, sizeof(flash_stat.erases), 1, flash_fp) == 1)
+    return;
+  if (flash_fp)
+    fclose(flash_fp);
+  memset(flash_mem, 0xFF, sizeof(flash_mem));
+  memset(flash_stat.erases, 0, sizeof(flash_stat.erases));
+  flash_fp = fopen(cfg.flash_file, "w+b");
+  sim_flash_save(0, SIM_FLASH_SIZE);
+}
+
+void sim_flash_read(uint32_t addr, void *buf, uint32_t len)
+{
+  if (addr >= SIM_FLASH_SIZE || len > SIM_FLASH_SIZE - addr)
+  {
+    memset(buf, 0xFF, len);
+    return;
+  }
+  memcpy(buf, flash_mem + addr, len);
+  flash_stat.read_bytes += len;
+  flash_read_ns += len * SIM_FLASH_READ_NS;
+  sim_advance(flash_read_ns / 1000);
+  flash_read_ns %= 1000;
+}
+
+int sim_flash_program(uint32_t addr, const void *buf, uint32_t len)
+{
+  if (addr % 4 || len % 4 || addr >= SIM_FLASH_SIZE ||
+      len > SIM_FLASH_SIZE - addr)
+  {
+    flash_stat.failures++;
+    return -1;
+  }
+  const uint8_t *src = buf;
+  int ok = 1;
+  uint32_t n = 0;
+  for (; n < len; n += 4)
+  {
+    if (flash_cut == 0)
+    {
+      ok = 0; // 已掉电
+      break;
+    }
+    if (flash_cut > 0)
+      flash_cut--;
+    for (int i = 0; i < 4; i++)
+    {
+      uint8_t *b = &flash_mem[addr + n + i];
+      if ((*b & src[n + i]) != src[n + i])
+        ok = 0; // 要把0写成1，读回与写入不符
+      *b &= src[n + i];
+    }
+    flash_stat.program_words++;
+  }
+  if (!ok)
+    flash_stat.failures++;
+  sim_flash_save(addr, n);
+  sim_advance((uint64_t)(n / 4) * SIM_FLASH_PROGRAM_US);
+  return ok ? 0 : -1;
+}
+
+int sim_flash_erase(int page)
+{
+  if (page < 0 || page >= SIM_FLASH_PAGES || flash_cut == 0)
+  {
+    flash_stat.failures++;
+    return -1;
+  }
+  memset(flash_mem + page * SIM_FLASH_PAGE_SIZE, 0xFF, SIM_FLASH_PAGE_SIZE);
+  flash_stat.erases[page]++;
+  sim_flash_save(page * SIM_FLASH_PAGE_SIZE, SIM_FLASH_PAGE_SIZE);
+  sim_advance(SIM_FLASH_ERASE_US);
+  return 0;
+}
+
+void sim_flash_power_cut(int32_t words)
+{
+  flash_cut = words < 0 ? -1 : words;
+}
+
+const sim_flash_stat *sim_flash_stats(void)
+{
+  return &flash_stat;
+}
+
+void sim_flash_report(void)
+{
+  uint32_t min = flash_stat.erases[0], max = 0, total = 0;
+  for (int p = 0; p < SIM_FLASH_PAGES; p++)
+  {
+    uint32_t e = flash_stat.erases[p];
+    min = e < min ? e : min;
+    max = e > max ? e : max;
+    total += e;
+  }
+  printf("flash    pages=%dx%dB erases=%u (min=%u max=%u) programmed=%u "
+         "words read=%llu bytes failures=%u\n",
+         SIM_FLASH_PAGES, SIM_FLASH_PAGE_SIZE, total, min, max,
+         flash_stat.program_words, (unsigned long long)flash_stat.read_bytes,
+         flash_stat.failures);
+}
+
+// 录制转存区：放在 RAM 中，不推进虚拟时钟，也不随复位清空
+
+static PPP_TLS uint8_t rec_spill[SIM_REC_SIZE];
+
+void sim_rec_write(uint32_t addr, const void *buf, uint32_t len)
+{
+  if (addr < SIM_REC_SIZE && len <= SIM_REC_SIZE - addr)
+    memcpy(&rec_spill[addr], buf, len);
+}
+
+void sim_rec_read(uint32_t addr, void *buf, uint32_t len)
+{
+  if (addr < SIM_REC_SIZE && len <= SIM_REC_SIZE - addr)
+    memcpy(buf, &rec_spill[addr], len);
+  else
+    memset(buf, 0, len);
+}
+
+// 输入脚本
+
+static void sim_script_add(sim_script *s, int value, uint64_t at_us,
+                           uint32_t hold_us)
+{
+  if (s->count >= SIM_SCRIPT_MAX)
+  {
+    return;
+  }
+  // 按开始时间插入
+  int n = s->count;
+  int pos = n;
+  while (pos > 0 &&
+         s->items[(s->head + pos - 1) % SIM_SCRIPT_MAX].start_us > at_us)
+  {
+    s->items[(s->head + pos) % SIM_SCRIPT_MAX] =
+        s->items[(s->head + pos - 1) % SIM_SCRIPT_MAX];
+    pos--;
+  }
+  sim_input *in = &s->items[(s->head + pos) % SIM_SCRIPT_MAX];
+  in->value = value;
+  in->start_us = at_us;
+  in->end_us = at_us + hold_us;
+  s->count++;
+}
+
+/**
+ * @brief 当前时刻生效的脚本项，顺便丢弃已结束的项
+ */
+static sim_input *sim_script_active(sim_script *s)
+{
+  while (s->count > 0 && s->items[s->head].end_us <= clock_us)
+  {
+    s->head = (s->head + 1) % SIM_SCRIPT_MAX;
+    s->count--;
+  }
+  for (int i = 0; i < s->count; i++)
+  {
+    sim_input *in = &s->items[(s->head + i) % SIM_SCRIPT_MAX];
+    if (in->start_us <= clock_us && clock_us < in->end_us)
+      return in;
+  }
+  return NULL;
+}
+
+/**
+ * @brief 按当前生效的所有按键生成键值RAM（支持同时按下多个键）
+ */
+static void sim_key_ram(int keypad, unsigned char *ram)
+{
+  sim_script *s = &keys[keypad];
+  sim_script_active(s); // 丢弃已结束的项
+  memset(ram, 0, 6);
+  for (int i = 0; i < s->count; i++)
+  {
+    sim_input *in = &s->items[(s->head + i) % SIM_SCRIPT_MAX];
+    if (in->start_us > clock_us || clock_us >= in->end_us)
+      continue;
+    if (in->value & SIM_KEY_BIT)
+    {
+      int r = (in->value >> 4) & 0x0F, c = in->value & 0x0F;
+      ram[2 * r + c / 8] |= 1u << (c % 8);
+      continue;
+    }
+    for (int r = 0; r < 3; r++)
+    {
+      for (int c = 0; c < 4; c++)
+      {
+        if (SIM_KEY_MAP[r][c] == in->value)
+          ram[2 * r] |= 1u << c; // K1~K4 在每行的低字节
+      }
+    }
+  }
+}
+
+void sim_key_press(int keypad, char key, uint64_t at_us, uint32_t hold_us)
+{
+  if (keypad >= 0 && keypad < SIM_KEYPAD_MAX)
+  {
+    sim_script_add(&keys[keypad], key, at_us, hold_us);
+  }
+}
+
+void sim_key_bit(int keypad, int row, int col, uint64_t at_us,
+                 uint32_t hold_us)
+{
+  if (keypad >= 0 && keypad < SIM_KEYPAD_MAX && row >= 0 && row < 3 &&
+      col >= 0 && col < 13)
+  {
+    sim_script_add(&keys[keypad], SIM_KEY_BIT | row << 4 | col, at_us,
+                   hold_us);
+  }
+}
+
+void sim_nfc_place(int card, uint64_t at_us, uint32_t hold_us)
+{
+  sim_script_add(&cards, card, at_us, hold_us);
+}
+
+// 外设状态
+
+uint8_t sim_tube_mask(int digit)
+{
+  uint8_t low = tube_ram[2 + digit * 2];
+  uint8_t high = tube_ram[3 + digit * 2];
+  return (uint8_t)((low >> 3) | ((high & 0x07) << 5));
+}
+
+int sim_tube_is_text(void)
+{
+  return tube_text;
+}
+
+int sim_fan_speed(void)
+{
+  return fan_speed;
+}
+
+int sim_curtain_position(void)
+{
+  return curtain_position;
+}
+
+const sim_bus_stat *sim_bus_stats(void)
+{
+  return stats;
+}
+
+const char *sim_dev_name(int dev)
+{
+  return dev >= 0 && dev < SIM_DEV_NUM ? SIM_DEVS[dev].name : "?";
+}
+
+void sim_bus_report(void)
+{
+  sim_bus_stat total = {0, 0, 0};
+  sim_bus_stat bus[SIM_BUS_NUM] = {{0, 0, 0}};
+  printf("%-8s %3s %12s %12s %12s\n", "device", "bus", "transfers", "bytes",
+         "bus_us");
+  for (int i = 0; i < SIM_DEV_NUM; i++)
+  {
+    if (stats[i].transactions == 0)
+      continue;
+    printf("%-8s %3d %12u %12u %12llu\n", SIM_DEVS[i].name, cfg.bus[i],
+           stats[i].transactions, stats[i].bytes,
+           (unsigned long long)stats[i].bus_us);
+    total.transactions += stats[i].transactions;
+    total.bytes += stats[i].bytes;
+    total.bus_us += stats[i].bus_us;
+    bus[cfg.bus[i]].transactions += stats[i].transactions;
+    bus[cfg.bus[i]].bytes += stats[i].bytes;
+    bus[cfg.bus[i]].bus_us += stats[i].bus_us;
+  }
+  for (int b = 0; b < SIM_BUS_NUM; b++)
+  {
+    if (bus[b].transactions == 0)
+      continue;
+    printf("%-8s %3d %12u %12u %12llu  (%.1f%% busy)\n", "bus", b,
+           bus[b].transactions, bus[b].bytes,
+           (unsigned long long)bus[b].bus_us,
+           clock_us ? 100.0 * bus[b].bus_us / clock_us : 0.0);
+  }
+  printf("%-8s %3s %12u %12u %12llu\n", "total", "", total.transactions,
+         total.bytes, (unsigned long long)total.bus_us);
+}
+
+// 设备接口
+
+static i2c_slave_info sim_dev_init(int dev, unsigned char cmd)
+{
+  i2c_slave_info info =
+      i2c_slave_detect(cfg.bus[dev], SIM_DEVS[dev].addr);
+  if (info.flag && cmd)
+  {
+    i2c_byte_write(info, cmd);
+  }
+  return info;
+}
+
+i2c_slave_info e1_tube_init(void)
+{
+  i2c_slave_info info = sim_dev_init(SIM_DEV_TUBE, 0x21); // 开启振荡器
+  i2c_byte_write(info, 0x81);                             // 开启显示
+  i2c_byte_write(info, 0xEF);                             // 最大亮度
+  return info;
+}
+
+// e1_tube_str_set 使用的数字字形（与 main.c 中 TUBE_FONT 一致）
+static const uint8_t SIM_DIGITS[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66,
+                                       0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+
+void e1_tube_str_set(i2c_slave_info info, char *str)
+{
+  int dev = sim_dev_of(info);
+  int pos = 0;
+  for (const char *p = str; pos < 4; pos++)
+  {
+    uint8_t mask = 0;
+    if (*p)
+    {
+      if (*p >= '0' && *p <= '9')
+        mask = SIM_DIGITS[*p - '0'];
+      else if (*p != ' ')
+        mask = 0x40; // 其余字符仿真为'-'
+      p++;
+      if (*p == '.')
+      {
+        mask |= 0x80;
+        p++;
+      }
+    }
+    // 逐位写入低、高两个寄存器
+    sim_xfer(dev, 3);
+    sim_xfer(dev, 3);
+    tube_ram[2 + pos * 2] = (uint8_t)(mask << 3);
+    tube_ram[3 + pos * 2] = (uint8_t)(mask >> 5);
+  }
+  sim_xfer(dev, 2); // 0x81 刷新
+  sim_tube_changed(1);
+}
+
+i2c_slave_info e1_led_init(void)
+{
+  return sim_dev_init(SIM_DEV_LED, 0);
+}
+
+void e1_led_rgb_set(i2c_slave_info info, unsigned char r, unsigned char g,
+                    unsigned char b)
+{
+  (void)r;
+  (void)g;
+  (void)b;
+  int dev = sim_dev_of(info);
+  for (int i = 0; i < 3; i++)
+  {
+    sim_xfer(dev, 3);
+  }
+}
+
+i2c_slave_info e2_fan_init(void)
+{
+  return sim_dev_init(SIM_DEV_FAN, 0);
+}
+
+void e2_fan_speed_set(i2c_slave_info info, char speed)
+{
+  sim_xfer(sim_dev_of(info), 3);
+  fan_speed = speed;
+}
+
+i2c_slave_info e3_curtain_init(void)
+{
+  return sim_dev_init(SIM_DEV_CURTAIN, 0);
+}
+
+void e3_curtain_position_set(i2c_slave_info info, unsigned char position)
+{
+  sim_xfer(sim_dev_of(info), 3);
+  curtain_position = position;
+}
+
+i2c_slave_info s1_key_init(void)
+{
+  return sim_dev_init(SIM_DEV_KEY0, 0x21);
+}
+
+char s1_key_value_get(i2c_slave_info info)
+{
+  int dev = sim_dev_of(info);
+  sim_xfer(dev, 9); // 写键值RAM地址 + 重复起始 + 读6字节
+  if (dev < SIM_DEV_KEY0 || dev > SIM_DEV_KEY3)
+  {
+    return SWN;
+  }
+  if (hooks.on_key_read)
+  {
+    hooks.on_key_read(dev - SIM_DEV_KEY0); // 脚本可以在读键前追加按键
+  }
+  sim_input *in = sim_script_active(&keys[dev - SIM_DEV_KEY0]);
+  if (in && (in->value & SIM_KEY_BIT))
+  {
+    // 直接按下的位：按厂商译码模型译出，未接的位没有键值
+    int r = (in->value >> 4) & 0x0F, c = in->value & 0x0F;
+    return c < 4 ? SIM_KEY_MAP[r][c] : SWN;
+  }
+  return in ? (char)in->value : SWN;
+}
+
+i2c_slave_info s2_imu_init(void)
+{
+  return sim_dev_init(SIM_DEV_IMU, 0);
+}
+
+i2c_slave_info s2_ths_init(void)
+{
+  return sim_dev_init(SIM_DEV_THS, 0);
+}
+
+s2_ths_t s2_ths_value_get(i2c_slave_info info)
+{
+  int dev = sim_dev_of(info);
+  sim_xfer(dev, 3); // 测量命令
+  sim_advance(SIM_THS_CONVERT_US);
+  sim_xfer(dev, 7); // 读温湿度与校验
+
+  noise ^= noise << 13;
+  noise ^= noise >> 17;
+  noise ^= noise << 5;
+  s2_ths_t t;
+  t.temp = 24.0f + (noise % 200) / 100.0f;
+  t.humi = 40.0f + (noise / 200 % 500) / 100.0f;
+  return t;
+}
+
+i2c_slave_info s5_nfc_init(void)
+{
+  return sim_dev_init(SIM_DEV_NFC, 0);
+}
+
+/**
+ * @brief 当前在场的卡（0或1），无卡返回-1
+ */
+static int sim_card_present(void)
+{
+  sim_input *in = sim_script_active(&cards);
+  if (!in)
+  {
+    return -1;
+  }
+  if (in->value == SIM_CARD_MATCH_FAN)
+  {
+    in->value = fan_speed ? 1 : 0; // 放上时才决定放哪张卡
+  }
+  return in->value;
+}
+
+char s5_nfc_request(i2c_slave_info info, unsigned char req_code,
+                    unsigned char *tag_type)
+{
+  (void)req_code;
+  int dev = sim_dev_of(info);
+  for (int i = 0; i < SIM_NFC_REQ_REGS; i++)
+  {
+    sim_xfer(dev, 3);
+  }
+  sim_advance(SIM_NFC_RF_US);
+  if (sim_card_present() < 0)
+  {
+    return MI_NOTAGERR;
+  }
+  if (tag_type)
+  {
+    tag_type[0] = 0x04; // Mifare One S50
+    tag_type[1] = 0x00;
+  }
+  return MI_OK;
+}
+
+char s5_nfc_anticoll(i2c_slave_info info, unsigned char *snr)
+{
+  int dev = sim_dev_of(info);
+  for (int i = 0; i < SIM_NFC_ANTICOLL_REGS; i++)
+  {
+    sim_xfer(dev, 3);
+  }
+  sim_advance(SIM_NFC_RF_US);
+  int card = sim_card_present();
+  if (card < 0)
+  {
+    return MI_NOTAGERR;
+  }
+  memcpy(snr, SIM_CARD_UID[card], 4);
+  return MI_OK;
+}
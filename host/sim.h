@@ -0,0 +1,158 @@
+//! 主机仿真器：虚拟时钟、I2C 总线计时与外设模型
+//! 所有厂商接口都在 sim.c 中以仿真外设实现，每次总线传输按字节数推进虚拟时钟，
+//! 固件可以脱离开发板、快于实时地运行。
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+
+// 多机仿真（PPP_FLEET）时仿真器和固件的状态按线程存放，每个线程同一时刻
+// 运行一台游戏机
+#ifndef PPP_TLS
+#ifdef PPP_FLEET
+#define PPP_TLS __thread
+#else
+#define PPP_TLS
+#endif
+#endif
+
+// 仿真外设
+enum
+{
+  SIM_DEV_TUBE,    // E1 数码管（HT16K33）
+  SIM_DEV_LED,     // E1 彩灯
+  SIM_DEV_FAN,     // E2 风扇
+  SIM_DEV_CURTAIN, // E3 窗帘
+  SIM_DEV_KEY0,    // S1 按键器（HT16K33），最多4个
+  SIM_DEV_KEY1,
+  SIM_DEV_KEY2,
+  SIM_DEV_KEY3,
+  SIM_DEV_IMU, // S2 惯性传感器
+  SIM_DEV_THS, // S2 温湿度传感器
+  SIM_DEV_NFC, // S5 NFC
+  SIM_DEV_NUM,
+};
+
+#define SIM_KEYPAD_MAX 4
+#define SIM_BUS_NUM 2 // I2C 控制器数，与 I2C_PERIPH_NUM 一致
+#define SIM_CARD_MATCH_FAN (-1) // 放卡时按当前风扇状态选择正确的卡
+
+// 仿真 flash：排行榜使用的擦除页（与 main.c 中 LB_PAGE_SIZE、LB_PAGES
+// 一致），按 NOR 语义擦除后全为0xFF，按字编程只能把1写成0
+#define SIM_FLASH_PAGE_SIZE 4096
+#define SIM_FLASH_PAGES 8
+
+// 录制转存区大小，即 main.c 中的 REC_FLASH_SIZE（8192个事件）
+#define SIM_REC_SIZE (64 * 1024)
+
+// 仿真配置
+typedef struct
+{
+  uint32_t i2c_hz;   // I2C 时钟频率
+  uint32_t cpu_us;   // 每次读取时钟消耗的 CPU 时间
+  uint32_t keypads;  // 按键器数量（1~4）
+  uint64_t limit_us; // 虚拟时间上限，到达后停止仿真
+  uint32_t seed;     // 传感器噪声种子
+  uint8_t bus[SIM_DEV_NUM]; // 每个外设所在的控制器（0~SIM_BUS_NUM-1）
+  const char *flash_file; // flash 镜像文件，每次编程、擦除后写回；
+                          // NULL=复位时为全空
+} sim_config;
+
+// 每个外设的总线统计
+typedef struct
+{
+  uint32_t transactions;
+  uint32_t bytes;
+  uint64_t bus_us;
+} sim_bus_stat;
+
+// flash 统计
+typedef struct
+{
+  uint32_t erases[SIM_FLASH_PAGES]; // 每页累计擦除次数（随镜像文件保存）
+  uint64_t read_bytes;
+  uint32_t program_words;
+  uint32_t failures; // 失败的编程、擦除（掉电或把0写成1）
+} sim_flash_stat;
+
+// 仿真回调，全部可为 NULL
+typedef struct
+{
+  void (*on_event)(const char *name, int value); // 固件阶段切换
+  void (*on_display)(void);                      // 数码管显存被写入
+  void (*on_key_read)(int keypad);               // 按键器被读取
+} sim_hooks;
+
+/**
+ * @brief 恢复默认配置
+ */
+void sim_config_default(sim_config *cfg);
+
+/**
+ * @brief 双总线布局：按键器和 NFC 放在控制器1，显示、执行器和传感器留在控制器0
+ */
+void sim_config_split_buses(sim_config *cfg);
+
+/**
+ * @brief 玩家分总线布局：在双总线布局基础上把偶数号按键器移回控制器0，
+ *        两名玩家的按键器在两条总线上并行读取
+ */
+void sim_config_player_buses(sim_config *cfg);
+
+/**
+ * @brief 复位全部外设与虚拟时钟
+ */
+void sim_reset(const sim_config *cfg, const sim_hooks *hooks);
+
+/**
+ * @brief 运行固件入口，直到 sim_stop 或到达虚拟时间上限
+ * @retval 1=由 sim_stop 停止，0=到达时间上限
+ */
+int sim_run(int (*entry)(void));
+
+/**
+ * @brief 在回调中停止仿真
+ */
+void sim_stop(void);
+
+// 固件侧接口
+uint32_t sim_now_us(void);
+void sim_event(const char *name, int value);
+
+// 虚拟时间（64位，不回绕）
+uint64_t sim_time_us(void);
+
+// 输入脚本
+void sim_key_press(int keypad, char key, uint64_t at_us, uint32_t hold_us);
+// 直接按下键值RAM中的一位（行0~2，列0~12），用于逐位核对译码
+void sim_key_bit(int keypad, int row, int col, uint64_t at_us,
+                 uint32_t hold_us);
+void sim_nfc_place(int card, uint64_t at_us, uint32_t hold_us);
+
+// 外设状态
+uint8_t sim_tube_mask(int digit); // 数码管第 digit 位（0~3）的段掩码
+int sim_tube_is_text(void);       // 最近一次写入来自 e1_tube_str_set
+int sim_fan_speed(void);
+int sim_curtain_position(void);
+
+// 仿真 flash，地址为排行榜区内的偏移；读取、编程和擦除按典型耗时推进
+// 虚拟时钟
+void sim_flash_read(uint32_t addr, void *buf, uint32_t len);
+int sim_flash_program(uint32_t addr, const void *buf, uint32_t len); // 0=成功
+int sim_flash_erase(int page);                                       // 0=成功
+void sim_flash_power_cut(int32_t words); // 再编程 words 个字后掉电，之后的
+                                         // 编程和擦除全部失败；-1=恢复供电
+const sim_flash_stat *sim_flash_stats(void);
+void sim_flash_report(void);
+
+// 录制转存区，地址为区内偏移
+void sim_rec_write(uint32_t addr, const void *buf, uint32_t len);
+void sim_rec_read(uint32_t addr, void *buf, uint32_t len);
+
+// 总线统计
+const sim_bus_stat *sim_bus_stats(void); // SIM_DEV_NUM 项
+const char *sim_dev_name(int dev);
+void sim_bus_report(void);
+
+#endif
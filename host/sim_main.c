@@ -0,0 +1,68 @@
+//! 主机仿真入口：用机器人玩家驱动完整固件（欢迎界面 -> 选择模式 -> 游戏）
+//! 编译：gcc -std=gnu99 -O2 -DPPP_HOST -Ihost main.c host/sim.c host/bot.c
+//!       host/sim_main.c -o ppp_sim
+//! 运行：./ppp_sim [solo|multi|replay] [虚拟秒数上限] [随机种子] [总线布局]
+//!                 [玩家数2~4] [flash镜像文件]
+//!       总线布局：1=单总线，2=按键器和NFC在控制器1，3=相邻玩家分在两条总线
+//!       flash镜像文件：排行榜在多次运行之间保留
+//!       replay：先玩一局游戏（玩家数为1时为单人），再选模式4回放并核对结果
+
+#include "bot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int main(int argc, char **argv)
+{
+  sim_config cfg;
+  sim_config_default(&cfg);
+  int replay = argc > 1 && strcmp(argv[1], "replay") == 0;
+  int multi = argc > 1 && (strcmp(argv[1], "multi") == 0 || replay);
+  if (argc > 2)
+    cfg.limit_us = (uint64_t)atoi(argv[2]) * 1000000;
+  if (argc > 3)
+    cfg.seed = (uint32_t)atoi(argv[3]);
+  if (argc > 4 && atoi(argv[4]) == 2)
+    sim_config_split_buses(&cfg);
+  else if (argc > 4 && atoi(argv[4]) >= 3)
+    sim_config_player_buses(&cfg);
+
+  int players = multi ? 2 : 1;
+  if (multi && argc > 5)
+    players = atoi(argv[5]);
+  if (argc > 6)
+    cfg.flash_file = argv[6];
+
+  bot_session run;
+  bot_session_init(&run, players, cfg.seed);
+  run.replay = replay;
+  if (replay && players == 1)
+    run.bots[0].error_pct = 30; // 单人局要输掉才结束，录制远超环形缓冲
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  bot_session_run(&run, &cfg);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  double virt = sim_time_us() / 1e6;
+  printf("mode=%s finished=%d result=%d\n", run.multi ? "multi" : "solo",
+         run.finished, run.result);
+  printf("virtual=%.3fs wall=%.3fs speedup=%.0fx presses=", virt, wall,
+         wall > 0 ? virt / wall : 0.0);
+  for (int i = 0; i < run.players; i++)
+    printf(i ? "/%u" : "%u", run.bots[i].presses);
+  printf("\n");
+  if (run.replay)
+  {
+    printf("replay=%s game=%.3fs replay=%.3fms\n",
+           run.replay_result == 1   ? "match"
+           : run.replay_result == 0 ? "MISMATCH"
+                                    : "none",
+           run.game_us / 1e6, run.replay_us / 1e3);
+  }
+  sim_bus_report();
+  sim_flash_report();
+  return run.replay && run.replay_result != 1;
+}
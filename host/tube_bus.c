@@ -0,0 +1,154 @@
+//! 数码管总线流量测试：按游戏节拍（每200ms一次）刷新分数显示，分别用原来的
+//! 整屏重写（8次寄存器写+0x81命令）和固件的显存影子写出，比较仿真器统计的
+//! 数码管事务数、字节数和总线时间，并逐拍核对显示内容。
+//! 编译：gcc -std=gnu99 -O2 -DPPP_HOST -Ihost main.c host/sim.c
+//!       host/tube_bus.c -o tube_bus
+//! 运行：./tube_bus [节拍数] [分数每隔几拍变化一次]
+
+#include "sim.h"
+#include "i2c.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// main.c 在 PPP_HOST 下的数码管接口
+void ppp_host_reset(void);
+void i2c_queue_drain(void);
+void tube_str_render(const char *str, uint8_t *seg_mask);
+void tube_str_set(i2c_slave_info info, const char *str);
+
+// 与 main.c 中 SEG_*、TUBE_ADDR 一致
+#define SEG_A (1 << 0)
+#define SEG_B (1 << 1)
+#define SEG_C (1 << 2)
+#define SEG_D (1 << 3)
+#define SEG_E (1 << 4)
+#define SEG_F (1 << 5)
+#define SEG_G (1 << 6)
+#define SEG_DP (1 << 7)
+static const uint8_t TUBE_ADDR[4][2] = {
+    {0x02, 0x03}, {0x04, 0x05}, {0x06, 0x07}, {0x08, 0x09}};
+
+#define TUBE_I2C_ADDR 0x70 // 仿真器中数码管的地址
+
+static int ticks = 300; // 60s 游戏
+static int hold = 5;    // 分数每隔几拍变化一次
+static int mismatches;
+
+typedef struct
+{
+  uint32_t transactions;
+  uint32_t bytes;
+  uint64_t bus_us;
+} tube_cost;
+
+/**
+ * @brief 原来的整屏写入：每位两次寄存器写，最后发送显示命令
+ */
+static void tube_all_set_old(i2c_slave_info info, const uint8_t *seg_mask)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    unsigned char low = 0, high = 0;
+    if (seg_mask[i] & SEG_A)
+      low |= 0x08;
+    if (seg_mask[i] & SEG_B)
+      low |= 0x10;
+    if (seg_mask[i] & SEG_C)
+      low |= 0x20;
+    if (seg_mask[i] & SEG_D)
+      low |= 0x40;
+    if (seg_mask[i] & SEG_E)
+      low |= 0x80;
+    if (seg_mask[i] & SEG_F)
+      high |= 0x01;
+    if (seg_mask[i] & SEG_G)
+      high |= 0x02;
+    if (seg_mask[i] & SEG_DP)
+      high |= 0x04;
+    i2c_reg_byte_write(info, TUBE_ADDR[i][0], low);
+    i2c_reg_byte_write(info, TUBE_ADDR[i][1], high);
+  }
+  i2c_byte_write(info, 0x81);
+}
+
+/**
+ * @brief 按节拍刷新分数，统计数码管的总线开销
+ * @param shadow 0=原来的整屏重写，1=显存影子
+ */
+static tube_cost tube_run(int shadow)
+{
+  ppp_host_reset();
+  i2c_slave_info tube = i2c_slave_detect(0, TUBE_I2C_ADDR);
+  tube_cost before = {0, 0, 0};
+  const sim_bus_stat *s = &sim_bus_stats()[SIM_DEV_TUBE];
+  before.transactions = s->transactions;
+  before.bytes = s->bytes;
+  before.bus_us = s->bus_us;
+
+  for (int t = 0; t < ticks; t++)
+  {
+    char str[16];
+    uint8_t mask[4];
+    snprintf(str, sizeof(str), "%4d", t / hold);
+    tube_str_render(str, mask);
+    if (shadow)
+    {
+      tube_str_set(tube, str);
+      i2c_queue_drain();
+    }
+    else
+    {
+      tube_all_set_old(tube, mask);
+    }
+    for (int d = 0; d < 4; d++)
+    {
+      if (sim_tube_mask(d) != mask[d] && mismatches++ < 10)
+        printf("MISMATCH %s tick=%d digit=%d\n", shadow ? "shadow" : "old", t,
+               d);
+    }
+  }
+
+  tube_cost c = {s->transactions - before.transactions,
+                 s->bytes - before.bytes, s->bus_us - before.bus_us};
+  return c;
+}
+
+static tube_cost cost[2];
+
+static int tube_main(void)
+{
+  cost[0] = tube_run(0);
+  cost[1] = tube_run(1);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  sim_config cfg;
+  sim_config_default(&cfg);
+  cfg.limit_us = ~0ull;
+  if (argc > 1)
+    ticks = atoi(argv[1]);
+  if (argc > 2 && atoi(argv[2]) > 0)
+    hold = atoi(argv[2]);
+
+  sim_reset(&cfg, NULL);
+  sim_run(tube_main);
+
+  static const char *const NAMES[2] = {"old", "shadow"};
+  printf("ticks=%d hold=%d\n", ticks, hold);
+  printf("%-7s %12s %12s %12s %10s\n", "path", "transactions", "bytes",
+         "bus_us", "bytes/tick");
+  for (int i = 0; i < 2; i++)
+  {
+    printf("%-7s %12u %12u %12llu %10.2f\n", NAMES[i], cost[i].transactions,
+           cost[i].bytes, (unsigned long long)cost[i].bus_us,
+           ticks ? (double)cost[i].bytes / ticks : 0.0);
+  }
+
+  // 显存影子每拍最多一次事务（首次同步另加开启显示命令），字节数必须减少
+  int ok = mismatches == 0 && cost[1].transactions <= (uint32_t)ticks + 1 &&
+           cost[1].bytes < cost[0].bytes;
+  printf("check: %s (%d mismatches)\n", ok ? "ok" : "FAIL", mismatches);
+  return !ok;
+}
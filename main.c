@@ -1,9 +1,4 @@
-//! 由于需要自定义显示，本程序需要将e1.c与e1.h中
-//! static void e1_ht16k33_chr_set(i2c_slave_info info, unsigned char bit,
-//! unsigned char chr, unsigned char point)
-//! 改为
-//! void e1_ht16k33_chr_set(i2c_slave_info info, unsigned char bit, unsigned
-//! char chr, unsigned char point)
+//! 数码管文字由本文件的字库直接渲染到显存，无需修改厂商 e1.c/e1.h
 
 #include "delay.h"
 #include "e1.h"
@@ -12,729 +7,4791 @@
 #include "s1.h"
 #include "s2.h"
 #include "s5.h"
+#include "game_rules.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #define TIME_LIMIT 1000 // 游戏时间限制
 
+// 0. 时钟与任务调度
+
+// 调试输出，定义 PPP_LOG_ENABLE 且 printf 已重定向到串口时生效
+#ifdef PPP_LOG_ENABLE
+#define PPP_LOG(...) printf(__VA_ARGS__)
+#else
+#define PPP_LOG(...)                                                           \
+  do                                                                           \
+  {                                                                            \
+    if (0)                                                                     \
+      printf(__VA_ARGS__);                                                     \
+  } while (0)
+#endif
+
+// GD32F4 使用 DWT 周期计数器作为微秒时钟；主机仿真（PPP_HOST）使用仿真器的
+// 虚拟时钟；其余平台退化为由 sys_delay_ms 推进的软件时钟（此时任务运行时间
+// 无法测量）
+#if defined(GD32F450) || defined(GD32F470)
+#include "gd32f4xx.h"
+#define SYS_CLOCK_DWT 1
+#define SYS_CLOCK_HW 1
+#elif defined(PPP_HOST)
+#define SYS_CLOCK_HW 1
+#else
+#define SYS_CLOCK_HW 0
+#endif
+
+// 主机仿真事件钩子（阶段切换、游戏结果），板上为空
+#ifdef PPP_HOST
+#define PPP_SIM_EVENT(name, value) sim_event(name, value)
+#else
+#define PPP_SIM_EVENT(name, value) ((void)0)
+#endif
+
+// 主机多机仿真（PPP_FLEET）时每个线程运行一台独立的游戏机，可变的全局状态
+// 按线程存放；板上和单机仿真时为普通静态变量
+#ifdef PPP_FLEET
+#define PPP_TLS __thread
+#else
+#define PPP_TLS
+#endif
+
+static PPP_TLS uint32_t sys_clock_us; // 当前微秒数（32位回绕，比较时用差值）
+#ifdef SYS_CLOCK_DWT
+static PPP_TLS uint32_t sys_clock_cyc; // 上次换算时的周期计数
+#endif
+
+/**
+ * @brief 初始化微秒时钟
+ */
+void sys_clock_init(void)
+{
+#ifdef SYS_CLOCK_DWT
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  sys_clock_cyc = 0;
+#endif
+  sys_clock_us = 0;
+}
+
+/**
+ * @brief 获取当前时间
+ * @retval 微秒数
+ * @note   周期计数器约每20秒回绕一次，只要两次调用间隔小于该值即可正确累计
+ */
+uint32_t sys_now_us(void)
+{
+#if defined(SYS_CLOCK_DWT)
+  uint32_t cyc = DWT->CYCCNT;
+  uint32_t per_us = SystemCoreClock / 1000000;
+  uint32_t delta = cyc - sys_clock_cyc;
+  sys_clock_us += delta / per_us;
+  sys_clock_cyc = cyc - delta % per_us; // 余数留到下次
+#elif defined(PPP_HOST)
+  sys_clock_us = sim_now_us();
+#endif
+  return sys_clock_us;
+}
+
+/**
+ * @brief 休眠，同时推进软件时钟（不等待 I2C 作业队列）
+ * @param ms 毫秒
+ */
+static void sys_sleep_ms(uint32_t ms)
+{
+  delay_ms(ms);
+#if !SYS_CLOCK_HW
+  sys_clock_us += ms * 1000;
+#endif
+}
+
+void i2c_queue_pump(void); // I2C 作业队列，见下文
+void i2c_queue_drain(void);
+
+/**
+ * @brief 阻塞延时，先等待已提交的 I2C 作业全部完成
+ * @param ms 毫秒
+ */
+void sys_delay_ms(uint32_t ms)
+{
+  i2c_queue_drain();
+  sys_sleep_ms(ms);
+}
+
+// 协作式任务：按周期运行，运行中不得阻塞
+typedef struct
+{
+  const char *name;
+  void (*run)(void *arg);
+  void *arg;
+  uint32_t period_us;
+  uint32_t next_us; // 下次释放时间
+  // 统计
+  uint32_t runs;     // 运行次数
+  uint32_t misses;   // 未在下次释放前完成的次数
+  uint32_t max_us;   // 最长单次运行时间
+  uint64_t total_us; // 累计运行时间
+} sched_task;
+
+typedef struct
+{
+  sched_task *tasks; // 按优先级从高到低排列
+  int count;
+  int stop;
+} scheduler;
+
+static PPP_TLS scheduler *sched_current; // 正在运行的调度器
+
+/**
+ * @brief 初始化任务
+ * @param task      任务
+ * @param name      任务名（用于统计输出）
+ * @param run       任务函数
+ * @param arg       任务参数
+ * @param period_ms 周期（毫秒，>=1）
+ */
+void sched_task_init(sched_task *task, const char *name, void (*run)(void *),
+                     void *arg, uint32_t period_ms)
+{
+  memset(task, 0, sizeof(*task));
+  task->name = name;
+  task->run = run;
+  task->arg = arg;
+  task->period_us = period_ms * 1000;
+}
+
+/**
+ * @brief 停止正在运行的调度器，当前任务返回后 sched_run 退出
+ */
+void sched_stop(void)
+{
+  if (sched_current)
+  {
+    sched_current->stop = 1;
+  }
+}
+
+/**
+ * @brief 没有任务到期时等待
+ */
+static void sched_idle(scheduler *s, uint32_t now)
+{
+  int32_t wait = INT32_MAX;
+  for (int i = 0; i < s->count; i++)
+  {
+    int32_t d = (int32_t)(s->tasks[i].next_us - now);
+    if (d < wait)
+      wait = d;
+  }
+  i2c_queue_pump();
+  // 有硬件时钟时不足1ms则空转，避免错过释放时间
+  if (wait >= 1000 || (wait > 0 && !SYS_CLOCK_HW))
+  {
+    sys_sleep_ms(1);
+  }
+}
+
+/**
+ * @brief 运行调度器，直到某个任务调用 sched_stop
+ * @param s 调度器
+ * @note  每次只运行一个到期任务，随后从最高优先级重新检查，
+ *        因此高频的输入任务不会被低优先级任务长时间挡住
+ */
+void sched_run(scheduler *s)
+{
+  scheduler *outer = sched_current;
+  sched_current = s;
+  s->stop = 0;
+
+  uint32_t now = sys_now_us();
+  for (int i = 0; i < s->count; i++)
+  {
+    s->tasks[i].next_us = now;
+  }
+
+  while (!s->stop)
+  {
+    int ran = 0;
+    for (int i = 0; i < s->count; i++)
+    {
+      sched_task *t = &s->tasks[i];
+      now = sys_now_us();
+      if ((int32_t)(now - t->next_us) < 0)
+        continue;
+
+      uint32_t release = t->next_us;
+      t->run(t->arg);
+      uint32_t end = sys_now_us();
+      uint32_t cost = end - now;
+
+      t->runs++;
+      t->total_us += cost;
+      if (cost > t->max_us)
+        t->max_us = cost;
+
+      t->next_us = release + t->period_us;
+      if ((int32_t)(end - t->next_us) > 0)
+      {
+        t->misses++;
+        PPP_SIM_EVENT("tick_miss", (int)(end - t->next_us)); // 超出的微秒数
+        // 落后时跳过错过的周期，保持相位，不补跑
+        while ((int32_t)(end - t->next_us) > 0)
+          t->next_us += t->period_us;
+      }
+      ran = 1;
+      break;
+    }
+    i2c_queue_pump(); // 启动任务刚提交的传输
+    if (!ran)
+    {
+      sched_idle(s, now);
+    }
+  }
+  sched_current = outer;
+}
+
+/**
+ * @brief 输出各任务的运行时间与超时次数
+ * @param s 调度器
+ */
+void sched_report(const scheduler *s)
+{
+  for (int i = 0; i < s->count; i++)
+  {
+    const sched_task *t = &s->tasks[i];
+    uint32_t avg = t->runs ? (uint32_t)(t->total_us / t->runs) : 0;
+    PPP_LOG("[sched] %-8s runs=%lu avg=%luus max=%luus miss=%lu\r\n", t->name,
+            (unsigned long)t->runs, (unsigned long)avg,
+            (unsigned long)t->max_us, (unsigned long)t->misses);
+  }
+}
+
+// I2C 总线统计（定义 I2C_TRACE 时启用）
+// 用同名宏包装 main.c 用到的每个 I2C 接口，按调用位置和设备地址统计事务数、
+// 字节数和总线时间，并把最近的事务记入固定大小的跟踪环，可随时输出。
+// 厂商设备函数内部的字节数无法直接得到，按器件手册估算。
+
+// i2c_slave_info 的控制器、地址字段名与此不同时，在编译选项中重新定义
+#ifndef I2C_INFO_PERIPH
+#define I2C_INFO_PERIPH(info) ((info).periph)
+#endif
+#ifndef I2C_INFO_ADDR
+#define I2C_INFO_ADDR(info) ((info).addr)
+#endif
+
+// 地址自增的多字节寄存器读写
+// 厂商 i2c 库只有单字节寄存器写，没有寄存器读。GD32F4 板上用标准外设库轮询实现
+// 多字节写和读：数码管显存刷新合并为一次事务，按键器键值RAM一次读出；编译选项
+// 中已定义 I2C_REG_BUF_WRITE / I2C_REG_BUF_READ 时以编译选项为准。
+#if (defined(GD32F450) || defined(GD32F470)) &&                                \
+    (!defined(I2C_REG_BUF_WRITE) || !defined(I2C_REG_BUF_READ))
+#define I2C_BURST_TIMEOUT_US 1000 // 等待一个状态标志的最长时间
+
+/**
+ * @brief 等待 I2C 状态标志变为 want
+ * @retval 1=成功，0=超时
+ */
+static int i2c_burst_wait(uint32_t periph, i2c_flag_enum flag,
+                          FlagStatus want)
+{
+  uint32_t t0 = sys_now_us();
+  while (i2c_flag_get(periph, flag) != want)
+  {
+    if (sys_now_us() - t0 > I2C_BURST_TIMEOUT_US)
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief 发送起始条件、从设备写地址和寄存器地址
+ * @retval 1=成功，0=总线忙、无应答或超时（已发送停止条件）
+ */
+static int i2c_burst_begin(i2c_slave_info info, uint8_t reg)
+{
+  uint32_t periph = I2C_INFO_PERIPH(info);
+  if (!i2c_burst_wait(periph, I2C_FLAG_I2CBSY, RESET))
+    return 0;
+  i2c_start_on_bus(periph);
+  int ok = i2c_burst_wait(periph, I2C_FLAG_SBSEND, SET);
+  if (ok)
+  {
+    i2c_master_addressing(periph, I2C_INFO_ADDR(info), I2C_TRANSMITTER);
+    ok = i2c_burst_wait(periph, I2C_FLAG_ADDSEND, SET);
+  }
+  if (ok)
+  {
+    i2c_flag_clear(periph, I2C_FLAG_ADDSEND);
+    ok = i2c_burst_wait(periph, I2C_FLAG_TBE, SET);
+  }
+  if (ok)
+    i2c_data_transmit(periph, reg);
+  else
+    i2c_stop_on_bus(periph);
+  return ok;
+}
+#endif
+
+#if (defined(GD32F450) || defined(GD32F470)) && !defined(I2C_REG_BUF_WRITE)
+
+/**
+ * @brief 从 reg 开始连续写 len 个字节，一次事务
+ */
+static void i2c_burst_write(i2c_slave_info info, uint8_t reg,
+                            const uint8_t *buf, int len)
+{
+  uint32_t periph = I2C_INFO_PERIPH(info);
+  if (!i2c_burst_begin(info, reg))
+    return;
+  for (int i = 0; i < len; i++)
+  {
+    if (!i2c_burst_wait(periph, I2C_FLAG_TBE, SET))
+      break;
+    i2c_data_transmit(periph, buf[i]);
+  }
+  i2c_burst_wait(periph, I2C_FLAG_BTC, SET);
+  i2c_stop_on_bus(periph);
+}
+
+#define I2C_REG_BUF_WRITE(info, reg, buf, len)                                 \
+  i2c_burst_write(info, reg, buf, len)
+#endif
+
+#if (defined(GD32F450) || defined(GD32F470)) && !defined(I2C_REG_BUF_READ)
+/**
+ * @brief 从 reg 开始连续读 len 个字节：写寄存器地址后重复起始，一次事务
+ * @note  按 GD32F4 主机接收流程，在最后两个字节前关闭应答并发送停止条件；
+ *        失败时未读到的字节为0
+ */
+static void i2c_burst_read(i2c_slave_info info, uint8_t reg, uint8_t *buf,
+                           int len)
+{
+  uint32_t periph = I2C_INFO_PERIPH(info);
+  memset(buf, 0, len);
+  if (len <= 0 || !i2c_burst_begin(info, reg))
+    return;
+  int ok = i2c_burst_wait(periph, I2C_FLAG_BTC, SET);
+  if (ok)
+  {
+    i2c_start_on_bus(periph); // 重复起始
+    ok = i2c_burst_wait(periph, I2C_FLAG_SBSEND, SET);
+  }
+  if (ok)
+  {
+    i2c_master_addressing(periph, I2C_INFO_ADDR(info), I2C_RECEIVER);
+    if (len < 3)
+      i2c_ack_config(periph, I2C_ACK_DISABLE);
+    if (len == 2)
+      i2c_ackpos_config(periph, I2C_ACKPOS_NEXT);
+    ok = i2c_burst_wait(periph, I2C_FLAG_ADDSEND, SET);
+  }
+  if (ok)
+  {
+    i2c_flag_clear(periph, I2C_FLAG_ADDSEND);
+    if (len == 1)
+      i2c_stop_on_bus(periph);
+  }
+  for (int n = len; ok && n > 0; n--)
+  {
+    if (n == 3)
+    {
+      ok = i2c_burst_wait(periph, I2C_FLAG_BTC, SET);
+      i2c_ack_config(periph, I2C_ACK_DISABLE);
+    }
+    else if (n == 2)
+    {
+      ok = i2c_burst_wait(periph, I2C_FLAG_BTC, SET);
+      i2c_stop_on_bus(periph);
+    }
+    ok = ok && i2c_burst_wait(periph, I2C_FLAG_RBNE, SET);
+    if (ok)
+      *buf++ = i2c_data_receive(periph);
+  }
+  if (!ok)
+    i2c_stop_on_bus(periph);
+  i2c_ack_config(periph, I2C_ACK_ENABLE);
+  i2c_ackpos_config(periph, I2C_ACKPOS_CURRENT);
+}
+
+#define I2C_REG_BUF_READ(info, reg, buf, len)                                  \
+  i2c_burst_read(info, reg, buf, len)
+#endif
+
+#ifdef I2C_TRACE
+
+#define I2C_TRACE_SITES 48   // 调用位置数
+#define I2C_TRACE_DEVICES 16 // 设备数
+#define I2C_TRACE_RING 64    // 跟踪环大小
+
+// 事务类型
+typedef enum
+{
+  I2C_OP_DETECT,
+  I2C_OP_BYTE_WRITE,
+  I2C_OP_REG_WRITE,
+  I2C_OP_BUF_WRITE,
+  I2C_OP_BUF_READ,
+  I2C_OP_LED,
+  I2C_OP_FAN,
+  I2C_OP_CURTAIN,
+  I2C_OP_KEY_READ,
+  I2C_OP_THS_READ,
+  I2C_OP_NFC_REQUEST,
+  I2C_OP_NFC_ANTICOLL,
+  I2C_OP_NUM,
+} i2c_op;
+
+static const char *const I2C_OP_NAME[I2C_OP_NUM] = {
+    "detect", "byte_wr", "reg_wr",  "buf_wr",  "buf_rd",  "led",
+    "fan",    "curtain", "key_rd",  "ths_rd",  "nfc_req", "nfc_acl",
+};
+
+typedef struct
+{
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t bus_us;
+} i2c_counter;
+
+typedef struct
+{
+  const char *func; // 调用函数
+  int line;         // 调用行号
+  i2c_counter n;
+} i2c_site;
+
+typedef struct
+{
+  unsigned int periph;
+  unsigned int addr;
+  i2c_counter n;
+} i2c_device;
+
+typedef struct
+{
+  uint32_t time_us;
+  uint16_t bus_us;
+  uint8_t site;
+  uint8_t addr;
+  uint8_t op;
+  uint8_t bytes;
+} i2c_trace_entry;
+
+static PPP_TLS i2c_site i2c_sites[I2C_TRACE_SITES];
+static PPP_TLS int i2c_site_count;
+static PPP_TLS i2c_device i2c_devices[I2C_TRACE_DEVICES];
+static PPP_TLS int i2c_device_count;
+static PPP_TLS i2c_trace_entry i2c_ring[I2C_TRACE_RING];
+static PPP_TLS uint32_t i2c_ring_head; // 累计写入条数
+
+static void i2c_count(i2c_counter *c, int bytes, uint32_t bus_us)
+{
+  c->transactions++;
+  c->bytes += bytes;
+  c->bus_us += bus_us;
+}
+
+/**
+ * @brief 记录一次总线事务
+ * @param periph 控制器
+ * @param addr   设备地址
+ * @param op     事务类型
+ * @param bytes  字节数（含地址字节）
+ * @param t0     开始时间
+ * @param func   调用函数
+ * @param line   调用行号
+ */
+static void i2c_trace_record(unsigned int periph, unsigned int addr, i2c_op op,
+                             int bytes, uint32_t t0, const char *func, int line)
+{
+  uint32_t bus_us = sys_now_us() - t0;
+
+  int site = 0;
+  while (site < i2c_site_count &&
+         (i2c_sites[site].func != func || i2c_sites[site].line != line))
+    site++;
+  if (site == i2c_site_count && site < I2C_TRACE_SITES)
+  {
+    i2c_sites[site].func = func;
+    i2c_sites[site].line = line;
+    i2c_site_count++;
+  }
+  if (site < I2C_TRACE_SITES)
+    i2c_count(&i2c_sites[site].n, bytes, bus_us);
+
+  int dev = 0;
+  while (dev < i2c_device_count && (i2c_devices[dev].periph != periph ||
+                                    i2c_devices[dev].addr != addr))
+    dev++;
+  if (dev == i2c_device_count && dev < I2C_TRACE_DEVICES)
+  {
+    i2c_devices[dev].periph = periph;
+    i2c_devices[dev].addr = addr;
+    i2c_device_count++;
+  }
+  if (dev < I2C_TRACE_DEVICES)
+    i2c_count(&i2c_devices[dev].n, bytes, bus_us);
+
+  i2c_trace_entry *e = &i2c_ring[i2c_ring_head++ % I2C_TRACE_RING];
+  e->time_us = t0;
+  e->bus_us = bus_us > 0xFFFF ? 0xFFFF : bus_us;
+  e->site = site;
+  e->addr = addr;
+  e->op = op;
+  e->bytes = bytes > 0xFF ? 0xFF : bytes;
+}
+
+/**
+ * @brief 清空统计
+ */
+void i2c_trace_reset(void)
+{
+  memset(i2c_sites, 0, sizeof(i2c_sites));
+  memset(i2c_devices, 0, sizeof(i2c_devices));
+  i2c_site_count = 0;
+  i2c_device_count = 0;
+  i2c_ring_head = 0;
+}
+
+/**
+ * @brief 输出按调用位置、按设备的统计和跟踪环
+ * @note  有异步后端时 buf_wr/buf_rd 的总线时间从启动传输计到作业队列引擎发现
+ *        传输完成，比实际传输时间多出最长一个推进间隔的等待
+ */
+void i2c_trace_dump(void)
+{
+  for (int i = 0; i < i2c_site_count; i++)
+  {
+    const i2c_site *s = &i2c_sites[i];
+    PPP_LOG("[i2c] %-24s:%-5d n=%lu bytes=%lu bus=%luus\r\n", s->func, s->line,
+            (unsigned long)s->n.transactions, (unsigned long)s->n.bytes,
+            (unsigned long)s->n.bus_us);
+  }
+  for (int i = 0; i < i2c_device_count; i++)
+  {
+    const i2c_device *d = &i2c_devices[i];
+    PPP_LOG("[i2c] dev %u:0x%02x n=%lu bytes=%lu bus=%luus\r\n", d->periph,
+            d->addr, (unsigned long)d->n.transactions,
+            (unsigned long)d->n.bytes, (unsigned long)d->n.bus_us);
+  }
+  uint32_t n = i2c_ring_head < I2C_TRACE_RING ? i2c_ring_head : I2C_TRACE_RING;
+  for (uint32_t i = i2c_ring_head - n; i != i2c_ring_head; i++)
+  {
+    const i2c_trace_entry *e = &i2c_ring[i % I2C_TRACE_RING];
+    PPP_LOG("[i2c] t=%lu %-8s 0x%02x %ub %uus %s:%d\r\n",
+            (unsigned long)e->time_us, I2C_OP_NAME[e->op], e->addr, e->bytes,
+            e->bus_us, i2c_sites[e->site].func, i2c_sites[e->site].line);
+  }
+}
+
+// 包装函数：先调用真实接口，再记录到调用位置 func:line
+#define I2C_TRACED_AT(info, op, bytes, call, func, line)                       \
+  do                                                                           \
+  {                                                                            \
+    uint32_t i2c_t0_ = sys_now_us();                                           \
+    call;                                                                      \
+    i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info), op, bytes,    \
+                     i2c_t0_, func, line);                                     \
+  } while (0)
+static inline void traced_i2c_byte_write(i2c_slave_info info,
+                                         unsigned char data, const char *func,
+                                         int line)
+{
+  uint32_t t0 = sys_now_us();
+  i2c_byte_write(info, data);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info),
+                   I2C_OP_BYTE_WRITE, 2, t0, func, line);
+}
+
+static inline void traced_i2c_reg_byte_write(i2c_slave_info info,
+                                             unsigned char reg,
+                                             unsigned char data,
+                                             const char *func, int line)
+{
+  uint32_t t0 = sys_now_us();
+  i2c_reg_byte_write(info, reg, data);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info),
+                   I2C_OP_REG_WRITE, 3, t0, func, line);
+}
+
+static inline i2c_slave_info traced_i2c_slave_detect(unsigned int periph,
+                                                     unsigned char addr,
+                                                     const char *func, int line)
+{
+  uint32_t t0 = sys_now_us();
+  i2c_slave_info info = i2c_slave_detect(periph, addr);
+  i2c_trace_record(periph, addr, I2C_OP_DETECT, 1, t0, func, line);
+  return info;
+}
+
+static inline void traced_e1_led_rgb_set(i2c_slave_info info, unsigned char r,
+                                         unsigned char g, unsigned char b,
+                                         const char *func, int line)
+{
+  uint32_t t0 = sys_now_us();
+  e1_led_rgb_set(info, r, g, b);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info), I2C_OP_LED, 9,
+                   t0, func, line); // 3次寄存器写
+}
+
+static inline void traced_e2_fan_speed_set(i2c_slave_info info, char speed,
+                                           const char *func, int line)
+{
+  uint32_t t0 = sys_now_us();
+  e2_fan_speed_set(info, speed);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info), I2C_OP_FAN, 3,
+                   t0, func, line);
+}
+
+static inline void traced_e3_curtain_position_set(i2c_slave_info info,
+                                                  unsigned char position,
+                                                  const char *func, int line)
+{
+  uint32_t t0 = sys_now_us();
+  e3_curtain_position_set(info, position);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info), I2C_OP_CURTAIN,
+                   3, t0, func, line);
+}
+
+static inline char traced_s1_key_value_get(i2c_slave_info info,
+                                           const char *func, int line)
+{
+  uint32_t t0 = sys_now_us();
+  char key = s1_key_value_get(info);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info),
+                   I2C_OP_KEY_READ, 9, t0, func, line); // 写地址+读6字节
+  return key;
+}
+
+static inline s2_ths_t traced_s2_ths_value_get(i2c_slave_info info,
+                                               const char *func, int line)
+{
+  uint32_t t0 = sys_now_us();
+  s2_ths_t t = s2_ths_value_get(info);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info),
+                   I2C_OP_THS_READ, 10, t0, func, line); // 命令+读6字节
+  return t;
+}
+
+static inline char traced_s5_nfc_request(i2c_slave_info info, unsigned char req,
+                                         unsigned char *type, const char *func,
+                                         int line)
+{
+  uint32_t t0 = sys_now_us();
+  char r = s5_nfc_request(info, req, type);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info),
+                   I2C_OP_NFC_REQUEST, 24, t0, func, line); // 约8次寄存器访问
+  return r;
+}
+
+static inline char traced_s5_nfc_anticoll(i2c_slave_info info,
+                                          unsigned char *id, const char *func,
+                                          int line)
+{
+  uint32_t t0 = sys_now_us();
+  char r = s5_nfc_anticoll(info, id);
+  i2c_trace_record(I2C_INFO_PERIPH(info), I2C_INFO_ADDR(info),
+                   I2C_OP_NFC_ANTICOLL, 30, t0, func, line); // 约10次寄存器访问
+  return r;
+}
+
+#define i2c_byte_write(info, data)                                             \
+  traced_i2c_byte_write(info, data, __func__, __LINE__)
+#define i2c_reg_byte_write(info, reg, data)                                    \
+  traced_i2c_reg_byte_write(info, reg, data, __func__, __LINE__)
+#define i2c_slave_detect(periph, addr)                                         \
+  traced_i2c_slave_detect(periph, addr, __func__, __LINE__)
+#define e1_led_rgb_set(info, r, g, b)                                          \
+  traced_e1_led_rgb_set(info, r, g, b, __func__, __LINE__)
+#define e2_fan_speed_set(info, speed)                                          \
+  traced_e2_fan_speed_set(info, speed, __func__, __LINE__)
+#define e3_curtain_position_set(info, position)                                \
+  traced_e3_curtain_position_set(info, position, __func__, __LINE__)
+#define s1_key_value_get(info)                                                 \
+  traced_s1_key_value_get(info, __func__, __LINE__)
+#define s2_ths_value_get(info)                                                 \
+  traced_s2_ths_value_get(info, __func__, __LINE__)
+#define s5_nfc_request(info, req, type)                                        \
+  traced_s5_nfc_request(info, req, type, __func__, __LINE__)
+#define s5_nfc_anticoll(info, id)                                              \
+  traced_s5_nfc_anticoll(info, id, __func__, __LINE__)
+
+#else
+#define I2C_TRACED_AT(info, op, bytes, call, func, line) call
+#define i2c_trace_reset() ((void)0)
+#define i2c_trace_dump() ((void)0)
+#endif
+
+// I2C 作业队列
+// 调用者提交寄存器写、寄存器读或厂商函数调用作业后立即返回，由队列引擎按提交
+// 顺序依次执行，同一设备的读写顺序与提交顺序一致。调度器在每次运行任务后和空闲时
+// 推进引擎。定义 I2C_ASYNC_START / I2C_ASYNC_BUSY 为 DMA 或中断驱动的传输后端后，
+// 寄存器读写在后台进行，期间游戏逻辑和输入处理照常运行：
+//   I2C_ASYNC_START(info, read, reg, buf, len) 启动传输，成功返回非0
+//     （len 为0的写只发送 reg 一个字节，用于 HT16K33 命令）
+//   I2C_ASYNC_BUSY(info) 传输未完成时返回非0
+// 没有后端时引擎在推进时同步执行；寄存器读还需要定义
+// I2C_REG_BUF_READ(info, reg, buf, len)，否则读作业以 status=-1 完成。
+// 目前只有主机仿真（host/i2c.h）提供异步后端。GD32F4 板上还没有 DMA/中断
+// 后端，作业在任务之间同步执行：渲染和执行器的传输移出了游戏任务并按总线
+// 排队，但不会与游戏逻辑重叠。主机仿真定义 SIM_I2C_SYNC 时走同一路径。
+// 厂商设备函数（彩灯、风扇等）总是同步执行，只是被推迟到任务之间的空闲时间
+// 并与其他作业保持顺序。
+// 每个 I2C 控制器（I2C_PERIPH_NUM 中的一项）有独立的队列，引擎在各条总线上
+// 同时启动传输，不同总线上的设备互不等待。
+// 定义 I2C_TRACE 时作业记下提交者的调用位置（i2c_submit* 的同名宏传入
+// __func__/__LINE__），引擎执行的传输记在该位置而不是引擎自己名下。
+#define I2C_JOB_DATA 16   // 每个作业携带的最大数据字节数
+#define I2C_QUEUE_SIZE 16 // 每条总线的作业槽数
+#define I2C_BUS_COUNT (sizeof(I2C_PERIPH_NUM) / sizeof(I2C_PERIPH_NUM[0]))
+
+typedef enum
+{
+  I2C_JOB_WRITE, // 从 reg 开始写 len 字节
+  I2C_JOB_READ,  // 从 reg 开始读 len 字节到 data
+  I2C_JOB_CALL,  // 由引擎调用 call（厂商设备函数）；call 为 NULL 时是栅栏：
+                 // 不访问总线，此前提交到同一总线的作业完成后才回调 done
+} i2c_job_type;
+
+typedef struct i2c_job i2c_job;
+struct i2c_job
+{
+  i2c_slave_info info;
+  uint8_t type;                                // i2c_job_type
+  uint8_t reg;                                 // 寄存器地址或命令字节
+  uint8_t len;                                 // data 中的有效字节数
+  int8_t status;                               // 0=成功，-1=后端不支持或失败
+  uint8_t data[I2C_JOB_DATA];                  // 写入数据或读出结果
+  void (*call)(const i2c_job *job);            // I2C_JOB_CALL 的执行函数
+  void (*done)(const i2c_job *job, void *arg); // 完成回调，可为 NULL
+  void *arg;
+  uint32_t queued_us; // 提交时间
+  uint32_t start_us;  // 后端开始传输的时间（统计用）
+#ifdef I2C_TRACE
+  const char *func; // 提交作业的调用位置
+  int line;
+#endif
+};
+
+// 作业中的传输记在提交作业的调用位置；厂商函数名加括号调用，绕过跟踪宏
+#define I2C_JOB_TRACED(job, op, bytes, call)                                   \
+  I2C_TRACED_AT((job)->info, op, bytes, call, (job)->func, (job)->line)
+#ifdef I2C_TRACE
+#define I2C_SITE_PARAMS , const char *func, int line
+#define I2C_SITE_ARGS , func, line
+#define I2C_SITE_HERE , __func__, __LINE__
+#else
+#define I2C_SITE_PARAMS
+#define I2C_SITE_ARGS
+#define I2C_SITE_HERE
+#endif
+
+typedef struct
+{
+  i2c_job jobs[I2C_QUEUE_SIZE];
+  uint32_t head; // 队首（正在执行或下一个执行的作业）
+  uint32_t tail; // 下一个空槽
+  int active;    // 队首作业正由后端传输
+  // 统计
+  uint32_t submitted;
+  uint32_t completed;
+  uint32_t bytes;
+  uint32_t max_depth;      // 最大排队深度
+  uint32_t full_waits;     // 队列满时提交者等待的次数
+  uint32_t max_latency_us; // 提交到完成的最长时间
+  uint64_t latency_us;     // 提交到完成的累计时间
+} i2c_queue;
+
+static PPP_TLS i2c_queue i2c_q[I2C_BUS_COUNT];
+
+/**
+ * @brief 控制器在 I2C_PERIPH_NUM 中的序号，未知控制器归入第一条总线
+ */
+static int i2c_bus_index(uint32_t periph)
+{
+  for (unsigned int i = 0; i < I2C_BUS_COUNT; i++)
+  {
+    if (I2C_PERIPH_NUM[i] == periph)
+      return i;
+  }
+  return 0;
+}
+
+/**
+ * @brief 设备所在总线的序号
+ */
+static int i2c_bus_of(i2c_slave_info info)
+{
+  return i2c_bus_index(I2C_INFO_PERIPH(info));
+}
+
+/**
+ * @brief 开始执行作业
+ * @retval 1=后端传输中，0=已同步完成
+ */
+static int i2c_job_start(i2c_job *job)
+{
+  job->status = 0;
+  if (job->type == I2C_JOB_CALL)
+  {
+    if (job->call)
+      job->call(job);
+    return 0;
+  }
+#ifdef I2C_ASYNC_START
+  int read = job->type == I2C_JOB_READ;
+#ifdef I2C_TRACE
+  job->start_us = sys_now_us(); // 总线时间在完成时记录，见 i2c_job_finish
+#endif
+  int started = I2C_ASYNC_START(job->info, read, job->reg, job->data, job->len);
+  if (!started)
+    job->status = -1;
+  return started;
+#else
+  if (job->type == I2C_JOB_READ)
+  {
+#ifdef I2C_REG_BUF_READ
+    I2C_JOB_TRACED(job, I2C_OP_BUF_READ, 3 + job->len,
+                   I2C_REG_BUF_READ(job->info, job->reg, job->data, job->len));
+#else
+    job->status = -1; // 厂商库没有通用的寄存器读
+#endif
+  }
+  else if (job->len == 0)
+  {
+    I2C_JOB_TRACED(job, I2C_OP_BYTE_WRITE, 2,
+                   (i2c_byte_write)(job->info, job->reg));
+  }
+  else
+  {
+#ifdef I2C_REG_BUF_WRITE
+    I2C_JOB_TRACED(job, I2C_OP_BUF_WRITE, 2 + job->len,
+                   I2C_REG_BUF_WRITE(job->info, job->reg, job->data, job->len));
+#else
+    for (int i = 0; i < job->len; i++)
+    {
+      I2C_JOB_TRACED(job, I2C_OP_REG_WRITE, 3,
+                     (i2c_reg_byte_write)(job->info, job->reg + i,
+                                          job->data[i]));
+    }
+#endif
+  }
+  return 0;
+#endif
+}
+
+static void i2c_job_finish(i2c_queue *q, const i2c_job *job)
+{
+#if defined(I2C_TRACE) && defined(I2C_ASYNC_START)
+  if (job->type != I2C_JOB_CALL)
+  {
+    int read = job->type == I2C_JOB_READ;
+    i2c_trace_record(I2C_INFO_PERIPH(job->info), I2C_INFO_ADDR(job->info),
+                     read ? I2C_OP_BUF_READ : I2C_OP_BUF_WRITE,
+                     (read ? 3 : 2) + job->len, job->start_us, job->func,
+                     job->line);
+  }
+#endif
+  uint32_t latency = sys_now_us() - job->queued_us;
+  q->completed++;
+  q->bytes += job->len;
+  q->latency_us += latency;
+  if (latency > q->max_latency_us)
+    q->max_latency_us = latency;
+  if (job->done)
+  {
+    i2c_job done = *job; // 先释放槽，回调中可以继续提交
+    q->active = 0;
+    q->head++;
+    done.done(&done, done.arg);
+    return;
+  }
+  q->active = 0;
+  q->head++;
+}
+
+static void i2c_bus_pump(i2c_queue *q)
+{
+  while (q->head != q->tail)
+  {
+    i2c_job *job = &q->jobs[q->head % I2C_QUEUE_SIZE];
+    if (q->active)
+    {
+#ifdef I2C_ASYNC_BUSY
+      if (I2C_ASYNC_BUSY(job->info))
+        return; // 后端仍在传输
+#endif
+    }
+    else if (i2c_job_start(job))
+    {
+      q->active = 1;
+      continue; // 立即检查一次，极短的传输可能已经完成
+    }
+    i2c_job_finish(q, job);
+  }
+}
+
+/**
+ * @brief 推进所有总线的作业队列：回收已完成的传输，启动后续作业
+ * @note  不阻塞；完成回调在此处调用，回调中可以提交作业，但不能等待
+ */
+void i2c_queue_pump(void)
+{
+  for (unsigned int i = 0; i < I2C_BUS_COUNT; i++)
+  {
+    i2c_bus_pump(&i2c_q[i]);
+  }
+}
+
+static int i2c_queue_idle(void)
+{
+  for (unsigned int i = 0; i < I2C_BUS_COUNT; i++)
+  {
+    if (i2c_q[i].head != i2c_q[i].tail)
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief 等待所有已提交的作业完成
+ * @note  直接调用厂商函数访问同一设备之前必须调用，以保持顺序
+ */
+void i2c_queue_drain(void)
+{
+  while (!i2c_queue_idle())
+  {
+    i2c_queue_pump();
+    sys_now_us(); // 推进时钟（主机仿真中等待后台传输）
+  }
+}
+
+/**
+ * @brief 等待一条总线上已提交的作业全部完成
+ * @param periph I2C 控制器
+ * @note  任务中直接调用厂商函数或探测设备之前调用：后端可能正在这条总线上
+ *        传输，同一外设上不能交错两个事务；其他总线不受影响
+ */
+void i2c_bus_drain(uint32_t periph)
+{
+  i2c_queue *q = &i2c_q[i2c_bus_index(periph)];
+  while (q->head != q->tail)
+  {
+    i2c_bus_pump(q);
+    sys_now_us();
+  }
+}
+
+/**
+ * @brief 提交作业，队列满时推进引擎直到有空槽
+ * @param job 作业模板，内容被复制，调用后可以释放
+ */
+void i2c_submit(const i2c_job *job I2C_SITE_PARAMS)
+{
+  i2c_queue *q = &i2c_q[i2c_bus_of(job->info)];
+  if (q->tail - q->head >= I2C_QUEUE_SIZE)
+  {
+    q->full_waits++;
+    while (q->tail - q->head >= I2C_QUEUE_SIZE)
+    {
+      i2c_queue_pump();
+      sys_now_us();
+    }
+  }
+  i2c_job *slot = &q->jobs[q->tail % I2C_QUEUE_SIZE];
+  *slot = *job;
+  slot->queued_us = sys_now_us();
+#ifdef I2C_TRACE
+  slot->func = func;
+  slot->line = line;
+#endif
+  q->tail++;
+  q->submitted++;
+  if (q->tail - q->head > q->max_depth)
+    q->max_depth = q->tail - q->head;
+}
+
+/**
+ * @brief 提交寄存器写作业
+ * @param len 字节数（0~I2C_JOB_DATA），为0时只发送 reg 作为命令字节
+ */
+void i2c_submit_write(i2c_slave_info info, uint8_t reg, const uint8_t *buf,
+                      int len I2C_SITE_PARAMS)
+{
+  i2c_job job = {.info = info, .type = I2C_JOB_WRITE, .reg = reg};
+  job.len = len > I2C_JOB_DATA ? I2C_JOB_DATA : len;
+  if (job.len)
+    memcpy(job.data, buf, job.len);
+  i2c_submit(&job I2C_SITE_ARGS);
+}
+
+/**
+ * @brief 提交寄存器读作业，结果在完成回调的 job->data 中
+ */
+void i2c_submit_read(i2c_slave_info info, uint8_t reg, int len,
+                     void (*done)(const i2c_job *job, void *arg),
+                     void *arg I2C_SITE_PARAMS)
+{
+  i2c_job job = {.info = info, .type = I2C_JOB_READ, .reg = reg};
+  job.len = len > I2C_JOB_DATA ? I2C_JOB_DATA : len;
+  job.done = done;
+  job.arg = arg;
+  i2c_submit(&job I2C_SITE_ARGS);
+}
+
+#ifdef I2C_TRACE
+#define i2c_submit(job) i2c_submit(job, __func__, __LINE__)
+#define i2c_submit_write(info, reg, buf, len)                                  \
+  i2c_submit_write(info, reg, buf, len, __func__, __LINE__)
+#define i2c_submit_read(info, reg, len, done, arg)                             \
+  i2c_submit_read(info, reg, len, done, arg, __func__, __LINE__)
+#endif
+
+/**
+ * @brief 输出各总线的队列深度、吞吐与延迟统计
+ */
+void i2c_queue_report(void)
+{
+  for (unsigned int i = 0; i < I2C_BUS_COUNT; i++)
+  {
+    const i2c_queue *q = &i2c_q[i];
+    if (q->submitted == 0)
+      continue;
+    uint32_t avg = q->completed ? (uint32_t)(q->latency_us / q->completed) : 0;
+    PPP_LOG("[i2cq] bus%u jobs=%lu bytes=%lu depth max=%lu full=%lu latency "
+            "avg=%luus max=%luus\r\n",
+            i, (unsigned long)q->completed, (unsigned long)q->bytes,
+            (unsigned long)q->max_depth, (unsigned long)q->full_waits,
+            (unsigned long)avg, (unsigned long)q->max_latency_us);
+  }
+}
+
+// 执行器状态缓存
+// 记录最后一次发送给彩灯、风扇、窗帘的值（写穿式），值和设备都没变时不发送
+// 总线命令。设备复位或写入出错后调用 actuator_cache_invalidate 作废缓存，
+// 或调用 actuator_cache_resync 立即重发全部缓存值。
+#define ACT_LED_MAX 4 // 彩灯缓存槽数，多个彩灯各占一槽
+
+enum
+{
+  ACT_LED,                        // E1 彩灯，值为 0xRRGGBB
+  ACT_FAN = ACT_LED + ACT_LED_MAX, // E2 风扇速度
+  ACT_CURTAIN,                    // E3 窗帘位置
+  ACT_NUM,
+};
+
+typedef struct
+{
+  i2c_slave_info info; // 最后写入的设备
+  uint32_t value;      // 最后写入的值
+  int valid;           // 缓存是否与设备一致
+  uint32_t writes;     // 实际发送次数
+  uint32_t skipped;    // 被抑制的重复写入次数
+} actuator_cache;
+
+static PPP_TLS actuator_cache act_cache[ACT_NUM];
+
+/**
+ * @brief 检查执行器的值是否需要发送，需要时更新缓存
+ * @param dev   执行器编号
+ * @param info  I2C 从设备信息结构体
+ * @param value 新值
+ * @retval 1=需要写入设备，0=与缓存一致
+ */
+static int actuator_cache_update(int dev, i2c_slave_info info, uint32_t value)
+{
+  actuator_cache *c = &act_cache[dev];
+  if (c->valid && c->value == value &&
+      memcmp(&c->info, &info, sizeof(info)) == 0)
+  {
+    c->skipped++;
+    return 0;
+  }
+  c->info = info;
+  c->value = value;
+  c->valid = 1;
+  c->writes++;
+  return 1;
+}
+
+// 在作业队列中执行厂商设备函数，reg 为执行器编号，data 为值
+static void actuator_call(const i2c_job *job)
+{
+  uint32_t value;
+  memcpy(&value, job->data, sizeof(value));
+  switch (job->reg)
+  {
+  case ACT_FAN:
+    I2C_JOB_TRACED(job, I2C_OP_FAN, 3,
+                   (e2_fan_speed_set)(job->info, (char)value));
+    break;
+  case ACT_CURTAIN:
+    I2C_JOB_TRACED(job, I2C_OP_CURTAIN, 3,
+                   (e3_curtain_position_set)(job->info, (unsigned char)value));
+    break;
+  default: // ACT_LED ~ ACT_LED + ACT_LED_MAX - 1
+    I2C_JOB_TRACED(job, I2C_OP_LED, 9,
+                   (e1_led_rgb_set)(job->info, (value >> 16) & 0xFF,
+                                    (value >> 8) & 0xFF, value & 0xFF));
+    break;
+  }
+}
+
+static void actuator_send(int dev, i2c_slave_info info,
+                          uint32_t value I2C_SITE_PARAMS)
+{
+  i2c_job job = {.info = info, .type = I2C_JOB_CALL, .reg = dev};
+  job.len = sizeof(value);
+  memcpy(job.data, &value, sizeof(value));
+  job.call = actuator_call;
+  (i2c_submit)(&job I2C_SITE_ARGS);
+}
+
+/**
+ * @brief 查找彩灯的缓存槽，新设备占用空闲槽，槽满时共用第一槽
+ */
+static int led_cache_slot(i2c_slave_info info)
+{
+  int free = -1;
+  for (int i = ACT_LED; i < ACT_LED + ACT_LED_MAX; i++)
+  {
+    actuator_cache *c = &act_cache[i];
+    if (c->writes == 0)
+    {
+      if (free < 0)
+        free = i;
+    }
+    else if (memcmp(&c->info, &info, sizeof(info)) == 0)
+    {
+      return i;
+    }
+  }
+  return free >= 0 ? free : ACT_LED;
+}
+
+/**
+ * @brief 设置彩灯颜色，与上次相同时不发送
+ */
+void led_rgb_set(i2c_slave_info info, unsigned char r, unsigned char g,
+                 unsigned char b I2C_SITE_PARAMS)
+{
+  uint32_t value = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  int slot = led_cache_slot(info);
+  if (actuator_cache_update(slot, info, value))
+    actuator_send(slot, info, value I2C_SITE_ARGS);
+}
+
+/**
+ * @brief 设置风扇速度，与上次相同时不发送
+ */
+void fan_speed_set(i2c_slave_info info, char speed I2C_SITE_PARAMS)
+{
+  if (actuator_cache_update(ACT_FAN, info, (uint8_t)speed))
+    actuator_send(ACT_FAN, info, (uint8_t)speed I2C_SITE_ARGS);
+}
+
+/**
+ * @brief 设置窗帘位置，与上次相同时不发送
+ */
+void curtain_position_set(i2c_slave_info info,
+                          unsigned char position I2C_SITE_PARAMS)
+{
+  if (actuator_cache_update(ACT_CURTAIN, info, position))
+    actuator_send(ACT_CURTAIN, info, position I2C_SITE_ARGS);
+}
+
+// 跟踪时执行器写入记在游戏中的调用位置，而不是上面的包装函数
+#ifdef I2C_TRACE
+#define led_rgb_set(info, r, g, b)                                             \
+  led_rgb_set(info, r, g, b, __func__, __LINE__)
+#define fan_speed_set(info, speed) fan_speed_set(info, speed, __func__, __LINE__)
+#define curtain_position_set(info, position)                                   \
+  curtain_position_set(info, position, __func__, __LINE__)
+#endif
+
+/**
+ * @brief 作废全部执行器缓存，下次设置时无条件写入
+ */
+void actuator_cache_invalidate(void)
+{
+  for (int i = 0; i < ACT_NUM; i++)
+  {
+    act_cache[i].valid = 0;
+  }
+}
+
+/**
+ * @brief 立即重发全部已知的执行器状态（总线出错或设备复位后恢复）
+ */
+void actuator_cache_resync(void)
+{
+  for (int i = 0; i < ACT_NUM; i++)
+  {
+    actuator_cache *c = &act_cache[i];
+    if (c->writes == 0)
+      continue; // 从未写入过，设备状态未知
+    c->valid = 1;
+    c->writes++;
+    actuator_send(i, c->info, c->value I2C_SITE_HERE);
+  }
+}
+
+/**
+ * @brief 输出执行器写入与抑制统计
+ */
+void actuator_cache_report(void)
+{
+  for (int i = 0; i < ACT_NUM; i++)
+  {
+    char name[8];
+    if (i == ACT_FAN)
+      strcpy(name, "fan");
+    else if (i == ACT_CURTAIN)
+      strcpy(name, "curtain");
+    else if (i == ACT_LED)
+      strcpy(name, "led");
+    else if (act_cache[i].writes)
+      sprintf(name, "led%d", i - ACT_LED);
+    else
+      continue; // 未使用的彩灯槽
+    PPP_LOG("[act] %-8s writes=%lu skipped=%lu\r\n", name,
+            (unsigned long)act_cache[i].writes,
+            (unsigned long)act_cache[i].skipped);
+  }
+}
+
+// 设备登记表
+// 开机时每个厂商初始化函数只调用一次，再在所有控制器上一次扫描全部按键器地址，
+// 结果（类型、总线、地址、是否在线）记入登记表。之后切换模式只查表，不再重新
+// 初始化总线或探测地址。空闲界面中由后台任务每次探测一项，发现设备插拔时
+// 重新初始化设备并作废相应的缓存。
+typedef enum
+{
+  DEV_TUBE,    // E1 数码管
+  DEV_LED,     // E1 彩灯
+  DEV_FAN,     // E2 风扇
+  DEV_CURTAIN, // E3 窗帘
+  DEV_KEY,     // S1 按键器（可有多个）
+  DEV_IMU,     // S2 惯性传感器
+  DEV_THS,     // S2 温湿度传感器
+  DEV_NFC,     // S5 NFC
+  DEV_TYPE_NUM,
+} dev_type;
+
+#define DEV_REGISTRY_MAX 24 // 登记表容量
+#ifndef DEV_RESCAN_MS
+#define DEV_RESCAN_MS 250 // 后台探测周期，0=关闭热插拔检测
+#endif
+
+// S1按键传感器地址
+#if defined(GD32F450) || defined(GD32F470)
+static const unsigned char S1_HT16K33_ADDR[] = {0xE8, 0xEA, 0xEC, 0xEE};
+#else
+static const unsigned char S1_HT16K33_ADDR[] = {0x74, 0x75, 0x76, 0x77};
+#endif
+
+typedef struct
+{
+  uint8_t type;        // dev_type
+  uint8_t bus;         // I2C_PERIPH_NUM 中的序号
+  uint8_t present;     // 是否在线
+  i2c_slave_info info; // 初始化或探测得到的设备信息
+} dev_entry;
+
+typedef struct
+{
+  dev_entry devs[DEV_REGISTRY_MAX]; // 按发现顺序排列
+  int count;
+  int scan_next; // 后台探测的下一项
+  uint32_t probes;
+  uint32_t changes; // 检测到的插拔次数
+} dev_registry;
+
+static PPP_TLS dev_registry dev_reg;
+
+void tube_fb_invalidate(void); // 数码管显存影子，见第1节
+
+static dev_entry *dev_registry_add(dev_type type, i2c_slave_info info)
+{
+  if (dev_reg.count >= DEV_REGISTRY_MAX)
+    return NULL;
+  dev_entry *e = &dev_reg.devs[dev_reg.count++];
+  e->type = type;
+  e->bus = i2c_bus_of(info);
+  e->present = info.flag != 0;
+  e->info = info;
+  return e;
+}
+
+/**
+ * @brief 按控制器和地址查找登记项
+ * @retval 登记项，不存在返回 NULL
+ */
+dev_entry *dev_registry_find(unsigned int periph, unsigned int addr)
+{
+  for (int i = 0; i < dev_reg.count; i++)
+  {
+    dev_entry *e = &dev_reg.devs[i];
+    if (I2C_INFO_PERIPH(e->info) == periph && I2C_INFO_ADDR(e->info) == addr)
+      return e;
+  }
+  return NULL;
+}
+
+/**
+ * @brief 获取某类设备的第 n 个登记项（含离线设备）
+ * @retval 设备信息，不存在时 flag 为0
+ */
+i2c_slave_info dev_registry_get(dev_type type, int n)
+{
+  for (int i = 0; i < dev_reg.count; i++)
+  {
+    if (dev_reg.devs[i].type == type && n-- == 0)
+      return dev_reg.devs[i].info;
+  }
+  i2c_slave_info none;
+  memset(&none, 0, sizeof(none));
+  return none;
+}
+
+/**
+ * @brief 设备上线后的初始化
+ */
+static void dev_attach(dev_entry *e)
+{
+  switch (e->type)
+  {
+  case DEV_TUBE:
+    e->info = e1_tube_init();
+    tube_fb_invalidate();
+    break;
+  case DEV_LED:
+    e->info = e1_led_init();
+    actuator_cache_invalidate();
+    break;
+  case DEV_FAN:
+    e->info = e2_fan_init();
+    actuator_cache_invalidate();
+    break;
+  case DEV_CURTAIN:
+    e->info = e3_curtain_init();
+    actuator_cache_invalidate();
+    break;
+  case DEV_KEY:
+    i2c_submit_write(e->info, 0x21, NULL, 0); // 开启振荡器（按照官方驱动）
+    break;
+  case DEV_IMU:
+    e->info = s2_imu_init();
+    break;
+  case DEV_THS:
+    e->info = s2_ths_init();
+    break;
+  case DEV_NFC:
+    e->info = s5_nfc_init();
+    break;
+  }
+}
+
+/**
+ * @brief 开机扫描：初始化所有设备，一次探测全部控制器上的按键器地址
+ */
+void dev_registry_boot(void)
+{
+  memset(&dev_reg, 0, sizeof(dev_reg));
+  dev_registry_add(DEV_TUBE, e1_tube_init());
+  dev_registry_add(DEV_LED, e1_led_init());
+  dev_registry_add(DEV_FAN, e2_fan_init());
+  dev_registry_add(DEV_CURTAIN, e3_curtain_init());
+  dev_registry_add(DEV_KEY, s1_key_init());
+  dev_registry_add(DEV_IMU, s2_imu_init());
+  dev_registry_add(DEV_THS, s2_ths_init());
+  dev_registry_add(DEV_NFC, s5_nfc_init());
+
+  // 按键器：离线的地址也登记，供热插拔检测
+  for (unsigned int i = 0; i < I2C_BUS_COUNT; i++)
+  {
+    for (unsigned int j = 0; j < sizeof(S1_HT16K33_ADDR); j++)
+    {
+      if (dev_registry_find(I2C_PERIPH_NUM[i], S1_HT16K33_ADDR[j]))
+        continue; // s1_key_init 已初始化
+      i2c_slave_info info =
+          i2c_slave_detect(I2C_PERIPH_NUM[i], S1_HT16K33_ADDR[j]);
+      dev_reg.probes++;
+      dev_entry *e = dev_registry_add(DEV_KEY, info);
+      if (e && e->present)
+        dev_attach(e);
+    }
+  }
+  i2c_queue_drain(); // 初始化命令全部发出后再返回
+}
+
+/**
+ * @brief 后台热插拔检测：探测登记表中的下一项
+ * @retval 1=设备状态发生变化
+ */
+int dev_registry_rescan_step(void)
+{
+  if (dev_reg.count == 0)
+    return 0;
+  dev_entry *e = &dev_reg.devs[dev_reg.scan_next];
+  dev_reg.scan_next = (dev_reg.scan_next + 1) % dev_reg.count;
+
+  i2c_bus_drain(I2C_INFO_PERIPH(e->info)); // 探测不能与后台传输交错
+  i2c_slave_info probe =
+      i2c_slave_detect(I2C_INFO_PERIPH(e->info), I2C_INFO_ADDR(e->info));
+  dev_reg.probes++;
+  int present = probe.flag != 0;
+  if (present == e->present)
+    return 0;
+
+  dev_reg.changes++;
+  e->present = present;
+  e->info.flag = probe.flag;
+  if (present)
+    dev_attach(e);
+  PPP_LOG("[dev] %u:0x%02x %s\r\n", (unsigned)I2C_INFO_PERIPH(e->info),
+          (unsigned)I2C_INFO_ADDR(e->info), present ? "attached" : "removed");
+  return 1;
+}
+
+/**
+ * @brief 输出登记表
+ */
+void dev_registry_report(void)
+{
+  static const char *const names[DEV_TYPE_NUM] = {
+      "tube", "led", "fan", "curtain", "key", "imu", "ths", "nfc"};
+  for (int i = 0; i < dev_reg.count; i++)
+  {
+    const dev_entry *e = &dev_reg.devs[i];
+    PPP_LOG("[dev] %-8s bus%u 0x%02x %s\r\n", names[e->type], e->bus,
+            (unsigned)I2C_INFO_ADDR(e->info), e->present ? "present" : "-");
+  }
+  PPP_LOG("[dev] probes=%lu changes=%lu\r\n", (unsigned long)dev_reg.probes,
+          (unsigned long)dev_reg.changes);
+}
+
+// 任务周期
+#define INPUT_PERIOD_MS 10    // 按键采样
+#define RENDER_PERIOD_MS 50   // 数码管刷新
+#define LED_PERIOD_MS 20      // 彩灯动画与熄灭
+#define MARQUEE_PERIOD_MS 200 // 跑马灯步进
+#define ACTUATOR_PERIOD_MS 50 // 风扇、窗帘
+#define GAME_TICK_MS 200      // 游戏节拍（反馈灯持续时间）
+#define LB_TASK_PERIOD_MS 20  // 排行榜写入（待机界面）
+
 // 1. 数码管显示
 
-// 数码管段码定义
-#define SEG_A (1 << 0)
-#define SEG_B (1 << 1)
-#define SEG_C (1 << 2)
-#define SEG_D (1 << 3)
-#define SEG_E (1 << 4)
-#define SEG_F (1 << 5)
-#define SEG_G (1 << 6)
-#define SEG_DP (1 << 7)
+// 数码管段码定义
+#define SEG_A (1 << 0)
+#define SEG_B (1 << 1)
+#define SEG_C (1 << 2)
+#define SEG_D (1 << 3)
+#define SEG_E (1 << 4)
+#define SEG_F (1 << 5)
+#define SEG_G (1 << 6)
+#define SEG_DP (1 << 7)
+
+// 数码管地址定义
+static const uint8_t TUBE_ADDR[4][2] = {
+    {0x02, 0x03}, // bit 1
+    {0x04, 0x05}, // bit 2
+    {0x06, 0x07}, // bit 3
+    {0x08, 0x09}, // bit 4
+};
+
+// 段掩码到 HT16K33 寄存器对的编码
+// 低字节对应 TUBE_ADDR[n][0]，高字节对应 TUBE_ADDR[n][1]
+#define TUBE_SEG_LOW(m)                                                        \
+  ((((m) & SEG_A) ? 0x08 : 0) | (((m) & SEG_B) ? 0x10 : 0) |                   \
+   (((m) & SEG_C) ? 0x20 : 0) | (((m) & SEG_D) ? 0x40 : 0) |                   \
+   (((m) & SEG_E) ? 0x80 : 0))
+#define TUBE_SEG_HIGH(m)                                                       \
+  ((((m) & SEG_F) ? 0x01 : 0) | (((m) & SEG_G) ? 0x02 : 0) |                   \
+   (((m) & SEG_DP) ? 0x04 : 0))
+#define TUBE_SEG_CODE(m) (TUBE_SEG_LOW(m) | (TUBE_SEG_HIGH(m) << 8))
+#define TUBE_SEG_CODE4(m)                                                      \
+  TUBE_SEG_CODE(m), TUBE_SEG_CODE((m) + 1), TUBE_SEG_CODE((m) + 2),            \
+      TUBE_SEG_CODE((m) + 3)
+#define TUBE_SEG_CODE16(m)                                                     \
+  TUBE_SEG_CODE4(m), TUBE_SEG_CODE4((m) + 4), TUBE_SEG_CODE4((m) + 8),         \
+      TUBE_SEG_CODE4((m) + 12)
+#define TUBE_SEG_CODE64(m)                                                     \
+  TUBE_SEG_CODE16(m), TUBE_SEG_CODE16((m) + 16), TUBE_SEG_CODE16((m) + 32),    \
+      TUBE_SEG_CODE16((m) + 48)
+
+// 段码查找表，编译期由 SEG_A~SEG_DP 展开生成，存放在flash中
+static const uint16_t TUBE_SEG_TABLE[256] = {
+    TUBE_SEG_CODE64(0),
+    TUBE_SEG_CODE64(64),
+    TUBE_SEG_CODE64(128),
+    TUBE_SEG_CODE64(192),
+};
+
+// 数码管字库（ASCII），编译期由 SEG_A~SEG_G 组合生成，未定义的字符显示为空
+// 数字、字母与常用标点全部在此定义，文字显示不依赖厂商字库
+// 七段无法区分所有字母，此表有意是有损的：
+// - 大小写共用一个字形（B/b、D/d、S/s 等），O、S、Z、g、I/l 与 0、5、2、9、
+//   1 附近的形状相同，按上下文可读；
+// - U/V、u/v、H/X/x、m/w 的段码完全相同，M、W 只是近似，单独出现时无法辨认。
+//   表中以“歧义”标出，显示给玩家的文字应避免依赖它们区分含义
+#define SEG_ALL (SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G)
+static const uint8_t TUBE_FONT[128] = {
+    [' '] = 0,
+    ['-'] = SEG_G,
+    ['_'] = SEG_D,
+    ['='] = SEG_D | SEG_G,
+    ['.'] = SEG_DP,
+    ['\''] = SEG_B,
+    ['"'] = SEG_B | SEG_F,
+    ['['] = SEG_A | SEG_D | SEG_E | SEG_F,
+    [']'] = SEG_A | SEG_B | SEG_C | SEG_D,
+    ['('] = SEG_A | SEG_D | SEG_E | SEG_F,
+    [')'] = SEG_A | SEG_B | SEG_C | SEG_D,
+    ['?'] = SEG_A | SEG_B | SEG_E | SEG_G,
+    [','] = SEG_C,
+    ['/'] = SEG_B | SEG_E | SEG_G,
+    ['\\'] = SEG_C | SEG_F | SEG_G,
+    ['|'] = SEG_E | SEG_F,
+    ['^'] = SEG_A | SEG_B | SEG_F,
+    ['*'] = SEG_A | SEG_B | SEG_F | SEG_G, // 度数符号
+    ['#'] = SEG_ALL & ~SEG_A,
+    ['0'] = SEG_ALL & ~SEG_G,
+    ['1'] = SEG_B | SEG_C,
+    ['2'] = SEG_A | SEG_B | SEG_D | SEG_E | SEG_G,
+    ['3'] = SEG_A | SEG_B | SEG_C | SEG_D | SEG_G,
+    ['4'] = SEG_B | SEG_C | SEG_F | SEG_G,
+    ['5'] = SEG_A | SEG_C | SEG_D | SEG_F | SEG_G,
+    ['6'] = SEG_ALL & ~SEG_B,
+    ['7'] = SEG_A | SEG_B | SEG_C,
+    ['8'] = SEG_ALL,
+    ['9'] = SEG_ALL & ~SEG_E,
+    ['A'] = SEG_ALL & ~SEG_D,
+    ['B'] = SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,
+    ['C'] = SEG_A | SEG_D | SEG_E | SEG_F,
+    ['D'] = SEG_B | SEG_C | SEG_D | SEG_E | SEG_G,
+    ['E'] = SEG_A | SEG_D | SEG_E | SEG_F | SEG_G,
+    ['F'] = SEG_A | SEG_E | SEG_F | SEG_G,
+    ['G'] = SEG_A | SEG_C | SEG_D | SEG_E | SEG_F,
+    ['H'] = SEG_B | SEG_C | SEG_E | SEG_F | SEG_G,
+    ['I'] = SEG_E | SEG_F,
+    ['J'] = SEG_B | SEG_C | SEG_D | SEG_E,
+    ['K'] = SEG_A | SEG_C | SEG_E | SEG_F | SEG_G,
+    ['L'] = SEG_D | SEG_E | SEG_F,
+    ['M'] = SEG_A | SEG_C | SEG_E, // 歧义：近似，难以辨认
+    ['N'] = SEG_A | SEG_B | SEG_C | SEG_E | SEG_F,
+    ['O'] = SEG_ALL & ~SEG_G,
+    ['P'] = SEG_A | SEG_B | SEG_E | SEG_F | SEG_G,
+    ['Q'] = SEG_A | SEG_B | SEG_D | SEG_F | SEG_G,
+    ['R'] = SEG_A | SEG_B | SEG_E | SEG_F,
+    ['S'] = SEG_A | SEG_C | SEG_D | SEG_F | SEG_G,
+    ['T'] = SEG_D | SEG_E | SEG_F | SEG_G,
+    ['U'] = SEG_B | SEG_C | SEG_D | SEG_E | SEG_F,
+    ['V'] = SEG_B | SEG_C | SEG_D | SEG_E | SEG_F, // 歧义：同 'U'
+    ['W'] = SEG_B | SEG_D | SEG_F, // 歧义：近似，难以辨认
+    ['X'] = SEG_B | SEG_C | SEG_E | SEG_F | SEG_G, // 歧义：同 'H'
+    ['Y'] = SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,
+    ['Z'] = SEG_A | SEG_B | SEG_D | SEG_E | SEG_G,
+    ['a'] = SEG_ALL & ~SEG_F,
+    ['b'] = SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,
+    ['c'] = SEG_D | SEG_E | SEG_G,
+    ['d'] = SEG_B | SEG_C | SEG_D | SEG_E | SEG_G,
+    ['e'] = SEG_ALL & ~SEG_C,
+    ['f'] = SEG_A | SEG_E | SEG_F | SEG_G,
+    ['g'] = SEG_ALL & ~SEG_E,
+    ['h'] = SEG_C | SEG_E | SEG_F | SEG_G,
+    ['i'] = SEG_E,
+    ['j'] = SEG_C | SEG_D,
+    ['k'] = SEG_A | SEG_C | SEG_E | SEG_F | SEG_G,
+    ['l'] = SEG_E | SEG_F,
+    ['m'] = SEG_C | SEG_E,
+    ['n'] = SEG_C | SEG_E | SEG_G,
+    ['o'] = SEG_C | SEG_D | SEG_E | SEG_G,
+    ['p'] = SEG_A | SEG_B | SEG_E | SEG_F | SEG_G,
+    ['q'] = SEG_A | SEG_B | SEG_C | SEG_F | SEG_G,
+    ['r'] = SEG_E | SEG_G,
+    ['s'] = SEG_A | SEG_C | SEG_D | SEG_F | SEG_G,
+    ['t'] = SEG_D | SEG_E | SEG_F | SEG_G,
+    ['u'] = SEG_C | SEG_D | SEG_E,
+    ['v'] = SEG_C | SEG_D | SEG_E, // 歧义：同 'u'
+    ['w'] = SEG_C | SEG_E, // 歧义：同 'm'
+    ['x'] = SEG_B | SEG_C | SEG_E | SEG_F | SEG_G, // 歧义：同 'H'
+    ['y'] = SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,
+    ['z'] = SEG_A | SEG_B | SEG_D | SEG_E | SEG_G,
+};
+
+/**
+ * @brief 获取字符的段码
+ * @param c 字符
+ * @retval 段掩码
+ */
+static inline uint8_t tube_char_mask(char c)
+{
+  return (unsigned char)c < 128 ? TUBE_FONT[(unsigned char)c] : 0;
+}
+
+/**
+ * @brief 取字符串中下一位数码管的段码，紧跟的'.'并入该位的小数点
+ * @param p 字符串游标，返回时指向下一位
+ * @retval 段掩码
+ */
+static uint8_t tube_glyph_next(const char **p)
+{
+  uint8_t mask = tube_char_mask(*(*p)++);
+  if (**p == '.') // 支持小数点
+  {
+    mask |= SEG_DP;
+    (*p)++;
+  }
+  return mask;
+}
+
+/**
+ * @brief 把字符串渲染成4位段码，左对齐，不足补空，超出截断
+ * @param str      字符串
+ * @param seg_mask 输出4位段码
+ */
+void tube_str_render(const char *str, uint8_t *seg_mask)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    seg_mask[i] = *str ? tube_glyph_next(&str) : 0;
+  }
+}
+
+// 数码管显存影子
+// HT16K33 显示RAM中，TUBE_ADDR 占用 0x02~0x09 共8字节。
+// tube_fb.ram 保存期望的显存内容，tube_fb.shadow 保存已写入设备的内容，
+// 刷新时只发送有变化的字节，并合并为一次地址自增的连续写。
+#define TUBE_RAM_FIRST 0x02
+#define TUBE_RAM_SIZE 8
+
+typedef struct
+{
+  i2c_slave_info info;           // 绑定的数码管
+  uint8_t ram[TUBE_RAM_SIZE];    // 期望的显存内容
+  uint8_t shadow[TUBE_RAM_SIZE]; // 设备中实际的显存内容
+  int synced;                    // shadow 是否与设备一致
+} tube_frame_buffer;
+
+static PPP_TLS tube_frame_buffer tube_fb;
+
+/**
+ * @brief 绑定数码管，设备变化时作废影子
+ * @param info I2C 从设备信息结构体
+ */
+static void tube_fb_bind(i2c_slave_info info)
+{
+  if (memcmp(&tube_fb.info, &info, sizeof(info)) != 0)
+  {
+    tube_fb.info = info;
+    tube_fb.synced = 0;
+  }
+}
+
+/**
+ * @brief 作废显存影子，下次刷新时整屏重写
+ * @note  调用厂商 e1 显示函数等绕过影子的函数后必须调用
+ */
+void tube_fb_invalidate(void)
+{
+  tube_fb.synced = 0;
+}
+
+/**
+ * @brief 提交从 reg 开始的 len 个显存字节
+ * @note  HT16K33 地址自增，合并为一次事务（板上和主机仿真的默认路径）；
+ *        既没有异步后端也没有 I2C_REG_BUF_WRITE 的平台才逐字节提交有变化的字节
+ */
+static void tube_ram_write(i2c_slave_info info, uint8_t reg, const uint8_t *buf,
+                           const uint8_t *old, int len, int force)
+{
+#if defined(I2C_ASYNC_START) || defined(I2C_REG_BUF_WRITE)
+  (void)old;
+  (void)force;
+  i2c_submit_write(info, reg, buf, len);
+#else
+  for (int i = 0; i < len; i++)
+  {
+    if (force || buf[i] != old[i])
+    {
+      i2c_submit_write(info, reg + i, &buf[i], 1);
+    }
+  }
+#endif
+}
+
+/**
+ * @brief 将显存影子中有变化的部分提交到 I2C 作业队列
+ * @retval 提交的显存字节数（0 表示无总线传输）
+ */
+int tube_fb_flush(void)
+{
+  int first = -1, last = -1;
+  for (int i = 0; i < TUBE_RAM_SIZE; i++)
+  {
+    if (!tube_fb.synced || tube_fb.ram[i] != tube_fb.shadow[i])
+    {
+      if (first < 0)
+        first = i;
+      last = i;
+    }
+  }
+  if (first < 0)
+  {
+    return 0; // 无变化，不占用总线
+  }
+
+  int len = last - first + 1;
+  tube_ram_write(tube_fb.info, TUBE_RAM_FIRST + first, &tube_fb.ram[first],
+                 &tube_fb.shadow[first], len, !tube_fb.synced);
+  memcpy(&tube_fb.shadow[first], &tube_fb.ram[first], len);
+
+  if (!tube_fb.synced)
+  {
+    i2c_submit_write(tube_fb.info, 0x81, NULL, 0); // 开启显示（仅在重新同步时发送）
+    tube_fb.synced = 1;
+  }
+  return len;
+}
+
+/**
+ * @brief 将一位数码管的段码写入显存影子（不刷新）
+ * @param pos      数码管位置（0~3）
+ * @param seg_mask 段选择掩码
+ * @note  所有数码管写入函数共用此编码路径
+ */
+static inline void tube_fb_put(int pos, uint8_t seg_mask)
+{
+  uint16_t code = TUBE_SEG_TABLE[seg_mask];
+  tube_fb.ram[TUBE_ADDR[pos][0] - TUBE_RAM_FIRST] = (uint8_t)code;
+  tube_fb.ram[TUBE_ADDR[pos][1] - TUBE_RAM_FIRST] = (uint8_t)(code >> 8);
+}
+
+/**
+ * @brief 显示字符串，支持小数点（如 "12.34"）
+ * @param info I2C 从设备信息结构体
+ * @param str  字符串，左对齐显示前4位
+ * @note  由字库渲染进显存影子，有变化的部分合并为一次突发写入
+ */
+void tube_str_set(i2c_slave_info info, const char *str)
+{
+  uint8_t seg_mask[4];
+  tube_str_render(str, seg_mask);
+  tube_fb_bind(info);
+  for (int i = 0; i < 4; i++)
+  {
+    tube_fb_put(i, seg_mask[i]);
+  }
+  tube_fb_flush();
+}
+
+/**
+ * @brief  这是一个自定义的数码管显示函数，可以显示单个数码管
+ * @param  info     I2C 从设备信息结构体
+ * @param  bit      数码管位（1~4）
+ * @param  seg_mask 段选择掩码（比如 SEG_A|SEG_B|SEG_DP）
+ * @retval 无
+ * @note   可任意组合段，见SEG_A等定义；只写入显存影子中有变化的字节
+ */
+void e1_tube_bit_set(i2c_slave_info info, int bit, uint8_t seg_mask)
+{
+  if (bit >= 1 && bit <= 4)
+  {
+    tube_fb_bind(info);
+    tube_fb_put(bit - 1, seg_mask);
+    tube_fb_flush(); // 更新显示
+  }
+}
+
+/**
+ * @brief  这是一个自定义的数码管显示函数，可以显示4个数码管
+ * @param  info     I2C 从设备信息结构体
+ * @param  seg_mask 段选择掩码数组（比如 {SEG_A|SEG_B|SEG_DP,
+ * SEG_A|SEG_B|SEG_DP, SEG_A|SEG_B|SEG_DP, SEG_A|SEG_B|SEG_DP}）
+ * @retval 无
+ * @note   可任意组合段，见SEG_A等定义；内容未变化时不产生总线传输
+ */
+void e1_tube_all_set(i2c_slave_info info, uint8_t *seg_mask)
+{
+  tube_fb_bind(info);
+  for (int i = 0; i < 4; i++)
+  {
+    tube_fb_put(i, seg_mask[i]);
+  }
+  tube_fb_flush(); // 更新显示
+}
+
+// 彩灯颜色
+// 色轮表编译期生成，存放在flash中：360个色相在满饱和、满明度下的颜色，过渡段
+// 做了 gamma 校正（近似 gamma 2.0）。换算颜色只需查表和 8 位定点乘法，不做除法；
+// 渐变按 Q8 定点插值。同一次算出的颜色可写到一组彩灯，每个彩灯经执行器缓存
+// 去重，颜色未变时不产生总线传输。
+typedef struct
+{
+  uint8_t r, g, b;
+} rgb_color;
+
+#define COLOR_HUE_NUM 360 // 色轮精度（度）
+#define LED_GROUP_MAX ACT_LED_MAX
+#define LED_FADE_STEP_MS 40 // 阻塞渐变的刷新间隔
+
+static const rgb_color COLOR_OFF = {0, 0, 0};
+
+// 色相 h 的颜色：每60度一个扇区，扇区内一个通道按 gamma 校正后的进度上升或下降
+#define COLOR_WHEEL_F(h) ((h) % 60 * 255 / 60) // 扇区内线性进度
+#define COLOR_WHEEL_UP(h) ((COLOR_WHEEL_F(h) * COLOR_WHEEL_F(h) + 254) / 255)
+#define COLOR_WHEEL_DOWN(h)                                                    \
+  (((255 - COLOR_WHEEL_F(h)) * (255 - COLOR_WHEEL_F(h)) + 254) / 255)
+#define COLOR_WHEEL_PICK(h, c0, c1, c2, c3, c4, c5)                            \
+  ((h) < 60    ? (c0)                                                          \
+   : (h) < 120 ? (c1)                                                          \
+   : (h) < 180 ? (c2)                                                          \
+   : (h) < 240 ? (c3)                                                          \
+   : (h) < 300 ? (c4)                                                          \
+               : (c5))
+#define COLOR_WHEEL_RGB(h)                                                     \
+  {COLOR_WHEEL_PICK(h, 255, COLOR_WHEEL_DOWN(h), 0, 0, COLOR_WHEEL_UP(h), 255), \
+   COLOR_WHEEL_PICK(h, COLOR_WHEEL_UP(h), 255, 255, COLOR_WHEEL_DOWN(h), 0, 0), \
+   COLOR_WHEEL_PICK(h, 0, 0, COLOR_WHEEL_UP(h), 255, 255, COLOR_WHEEL_DOWN(h))}
+#define COLOR_WHEEL_RGB5(h)                                                    \
+  COLOR_WHEEL_RGB(h), COLOR_WHEEL_RGB((h) + 1), COLOR_WHEEL_RGB((h) + 2),      \
+      COLOR_WHEEL_RGB((h) + 3), COLOR_WHEEL_RGB((h) + 4)
+#define COLOR_WHEEL_RGB20(h)                                                   \
+  COLOR_WHEEL_RGB5(h), COLOR_WHEEL_RGB5((h) + 5), COLOR_WHEEL_RGB5((h) + 10),  \
+      COLOR_WHEEL_RGB5((h) + 15)
+#define COLOR_WHEEL_RGB60(h)                                                   \
+  COLOR_WHEEL_RGB20(h), COLOR_WHEEL_RGB20((h) + 20),                           \
+      COLOR_WHEEL_RGB20((h) + 40)
+
+static const rgb_color COLOR_WHEEL[COLOR_HUE_NUM] = {
+    COLOR_WHEEL_RGB60(0),   COLOR_WHEEL_RGB60(60),  COLOR_WHEEL_RGB60(120),
+    COLOR_WHEEL_RGB60(180), COLOR_WHEEL_RGB60(240), COLOR_WHEEL_RGB60(300),
+};
+
+// a*b/255 的定点近似
+static inline uint8_t scale8(uint8_t a, uint8_t b)
+{
+  return (uint8_t)((a * (b + 1)) >> 8);
+}
+
+/**
+ * @brief 将HSV颜色转换为RGB颜色（查色轮表）
+ * @param h 色相（度），超出0~359时按360取模
+ * @param s 饱和度（0-255）
+ * @param v 明度（0-255）
+ * @retval RGB颜色
+ */
+rgb_color color_hsv(int h, uint8_t s, uint8_t v)
+{
+  h %= COLOR_HUE_NUM;
+  if (h < 0)
+    h += COLOR_HUE_NUM;
+  rgb_color c = COLOR_WHEEL[h];
+  uint8_t w = 255 - s; // 混入的白色
+  c.r = scale8(v, c.r + scale8(255 - c.r, w));
+  c.g = scale8(v, c.g + scale8(255 - c.g, w));
+  c.b = scale8(v, c.b + scale8(255 - c.b, w));
+  return c;
+}
+
+/**
+ * @brief 两种颜色间插值
+ * @param a 起始颜色
+ * @param b 结束颜色
+ * @param t 进度（Q8，0=a，256=b）
+ */
+rgb_color color_lerp(rgb_color a, rgb_color b, uint16_t t)
+{
+  uint16_t u = 256 - t;
+  rgb_color c = {(uint8_t)((a.r * u + b.r * t) >> 8),
+                 (uint8_t)((a.g * u + b.g * t) >> 8),
+                 (uint8_t)((a.b * u + b.b * t) >> 8)};
+  return c;
+}
+
+// 渐变：进度按64位算出，任意时长都走满全程，长渐变也不会停住
+typedef struct
+{
+  rgb_color from;
+  rgb_color to;
+  uint32_t start_us;
+  uint32_t dur_us;
+} color_fade;
+
+/**
+ * @brief 开始渐变
+ * @param f    渐变状态
+ * @param from 起始颜色
+ * @param to   结束颜色
+ * @param ms   持续时间
+ */
+void color_fade_start(color_fade *f, rgb_color from, rgb_color to, uint32_t ms)
+{
+  f->from = from;
+  f->to = to;
+  f->start_us = sys_now_us();
+  f->dur_us = ms ? ms * 1000 : 1;
+}
+
+/**
+ * @brief 取渐变的当前颜色
+ * @param f 渐变状态
+ * @param c 输出颜色
+ * @retval 1=渐变中，0=已到结束颜色
+ */
+int color_fade_get(const color_fade *f, rgb_color *c)
+{
+  uint32_t elapsed = sys_now_us() - f->start_us;
+  if (elapsed >= f->dur_us)
+  {
+    *c = f->to;
+    return 0;
+  }
+  *c = color_lerp(f->from, f->to,
+                  (uint16_t)(((uint64_t)elapsed << 8) / f->dur_us));
+  return 1;
+}
+
+// 彩灯组：同一个颜色写到多个彩灯
+typedef struct
+{
+  i2c_slave_info info[LED_GROUP_MAX];
+  int count;
+} led_group;
+
+/**
+ * @brief 建立彩灯组：first 及登记表中其余在线的彩灯
+ * @param g     彩灯组
+ * @param first 主彩灯，不在线时彩灯组为空
+ */
+void led_group_init(led_group *g, i2c_slave_info first)
+{
+  g->count = 0;
+  if (!first.flag)
+    return;
+  g->info[g->count++] = first;
+  for (int n = 0; n < DEV_REGISTRY_MAX && g->count < LED_GROUP_MAX; n++)
+  {
+    i2c_slave_info info = dev_registry_get(DEV_LED, n);
+    if (info.flag && memcmp(&info, &first, sizeof(info)) != 0)
+      g->info[g->count++] = info;
+  }
+}
+
+/**
+ * @brief 设置彩灯组颜色，各彩灯与上次相同时不发送
+ */
+void led_group_set(const led_group *g, rgb_color c)
+{
+  for (int i = 0; i < g->count; i++)
+  {
+    led_rgb_set(g->info[i], c.r, c.g, c.b);
+  }
+}
+
+/**
+ * @brief 阻塞渐变彩灯组
+ * @param g    彩灯组
+ * @param from 起始颜色
+ * @param to   结束颜色
+ * @param ms   持续时间
+ */
+void led_group_fade(const led_group *g, rgb_color from, rgb_color to,
+                    uint32_t ms)
+{
+  color_fade f;
+  rgb_color c;
+  color_fade_start(&f, from, to, ms);
+  while (color_fade_get(&f, &c))
+  {
+    led_group_set(g, c);
+    sys_delay_ms(LED_FADE_STEP_MS);
+  }
+  led_group_set(g, to);
+}
+
+// 帧动画
+// 动画是预先算好的帧表，每帧含4位段码、彩灯颜色和持续时间。播放器由调度器任务
+// 定时推进，到时才切换帧；数码管经显存影子、彩灯经执行器缓存写出，相邻帧相同的
+// 部分不产生总线传输。动画在后台播放，不阻塞输入任务。
+#define ANIM_TUBE 0x01 // 帧包含数码管段码
+#define ANIM_LED 0x02  // 帧包含彩灯颜色
+
+typedef struct
+{
+  uint8_t seg[4]; // 第1~4位段码
+  uint8_t rgb[3]; // 彩灯颜色
+  uint8_t flags;  // ANIM_TUBE / ANIM_LED
+  uint16_t ms;    // 持续时间
+} anim_frame;
+
+typedef struct
+{
+  const anim_frame *frames; // 帧表，NULL 表示未在播放
+  int count;                // 帧数
+  int loops;                // 播放遍数，0=循环播放
+  int shown;                // 已显示的帧数
+  uint32_t next_us;         // 切换到下一帧的时间
+  i2c_slave_info tube;
+  led_group leds;
+} anim_player;
+
+/**
+ * @brief 开始播放动画
+ * @param a      播放器
+ * @param frames 帧表（播放期间需保持有效）
+ * @param count  帧数
+ * @param loops  播放遍数，0=循环播放
+ * @param tube   数码管
+ * @param led    主彩灯，登记表中其余彩灯同步显示
+ */
+void anim_play(anim_player *a, const anim_frame *frames, int count, int loops,
+               i2c_slave_info tube, i2c_slave_info led)
+{
+  a->frames = frames;
+  a->count = count;
+  a->loops = loops;
+  a->shown = 0;
+  a->next_us = sys_now_us();
+  a->tube = tube;
+  led_group_init(&a->leds, led);
+}
+
+/**
+ * @brief 推进动画，到时则显示下一帧
+ * @param a 播放器
+ * @retval 1=正在播放，0=未播放或已播完
+ */
+int anim_update(anim_player *a)
+{
+  if (!a->frames)
+    return 0;
+  uint32_t now = sys_now_us();
+  if ((int32_t)(now - a->next_us) < 0)
+    return 1; // 当前帧未到时
+  if (a->loops && a->shown >= a->count * a->loops)
+  {
+    a->frames = NULL; // 最后一帧已显示完
+    return 0;
+  }
+
+  const anim_frame *f = &a->frames[a->shown % a->count];
+  if (++a->shown == a->count && !a->loops)
+    a->shown = 0;
+  if (f->flags & ANIM_TUBE)
+  {
+    tube_fb_bind(a->tube);
+    for (int p = 0; p < 4; p++)
+    {
+      tube_fb_put(p, f->seg[p]);
+    }
+    tube_fb_flush();
+  }
+  if (f->flags & ANIM_LED)
+  {
+    rgb_color c = {f->rgb[0], f->rgb[1], f->rgb[2]};
+    led_group_set(&a->leds, c);
+  }
+  a->next_us += f->ms * 1000;
+  if ((int32_t)(now - a->next_us) > 0)
+    a->next_us = now; // 落后时不追帧
+  return 1;
+}
+
+// 跑马灯：字符串只在初始化和流式补充时编码一次，之后每帧只滑动4位窗口
+#define MARQUEE_WINDOW 4
+#define MARQUEE_RING 32 // 段码环形缓冲大小
+
+typedef struct
+{
+  const char *src;            // 原始字符串（需在跑马灯期间保持有效）
+  const char *cursor;         // 下一个待编码的字符
+  uint8_t ring[MARQUEE_RING]; // 段码序列 k 存放在 ring[k % MARQUEE_RING]
+  int compiled;               // 已编码的段码数（含前补）
+  int resident;               // 整条消息已全部编码进缓冲
+  int pos;                    // 当前窗口起点
+  int steps;                  // 总步数，走完后回到开头
+} tube_marquee;
+
+/**
+ * @brief 编码下一个段码，小数点并入前一个字符
+ */
+static void marquee_compile_next(tube_marquee *m)
+{
+  uint8_t mask = 0;
+  if (m->compiled < MARQUEE_WINDOW)
+  {
+    mask = SEG_G; // 只在前面补window个'-'
+  }
+  else if (*m->cursor)
+  {
+    mask = tube_glyph_next(&m->cursor);
+  }
+  m->ring[m->compiled % MARQUEE_RING] = mask;
+  m->compiled++;
+}
+
+/**
+ * @brief 从头开始编码，尽量填满缓冲
+ */
+static void marquee_rewind(tube_marquee *m)
+{
+  m->cursor = m->src;
+  m->compiled = 0;
+  m->pos = 0;
+  while (m->compiled < MARQUEE_RING &&
+         (m->compiled < MARQUEE_WINDOW || *m->cursor))
+  {
+    marquee_compile_next(m);
+  }
+  m->resident = (*m->cursor == '\0');
+}
+
+/**
+ * @brief 初始化跑马灯，从右边推进，窗口4位，支持小数点
+ * @param m     跑马灯
+ * @param str   原始字符串（如 "Welcome-to-bpu"），可超过缓冲长度
+ * @param steps 总步数（窗口偏移 0 ~ steps-1）
+ */
+void tube_marquee_init(tube_marquee *m, const char *str, int steps)
+{
+  m->src = str;
+  m->steps = steps;
+  marquee_rewind(m);
+}
+
+/**
+ * @brief 取当前窗口的段码
+ * @param m      跑马灯
+ * @param window 输出 MARQUEE_WINDOW 位段码
+ */
+void tube_marquee_window(const tube_marquee *m, uint8_t *window)
+{
+  for (int i = 0; i < MARQUEE_WINDOW; i++)
+  {
+    int k = m->pos + i;
+    window[i] = k < m->compiled ? m->ring[k % MARQUEE_RING] : 0; // 不补后缀
+  }
+}
+
+/**
+ * @brief 窗口前进一位
+ * @param m 跑马灯
+ * @note  消息超过缓冲长度时每步最多编码一个字符，回到开头时重新编码
+ */
+void tube_marquee_step(tube_marquee *m)
+{
+  if (++m->pos >= m->steps)
+  {
+    if (m->resident)
+      m->pos = 0;
+    else
+      marquee_rewind(m);
+    return;
+  }
+  while (!m->resident && m->compiled < m->pos + MARQUEE_WINDOW)
+  {
+    marquee_compile_next(m);
+  }
+}
+
+// 跑马灯播放器：由调度器任务定时推进，每步直接取环形缓冲中的窗口经显存影子写出，
+// 不展开成帧表，消息长度不受缓冲大小限制
+typedef struct
+{
+  tube_marquee m;
+  i2c_slave_info tube;
+  uint16_t ms;      // 每步持续时间
+  uint32_t next_us; // 前进到下一步的时间
+} marquee_player;
+
+/**
+ * @brief 开始循环播放跑马灯
+ * @param p     播放器
+ * @param str   原始字符串（播放期间需保持有效）
+ * @param steps 总步数
+ * @param ms    每步持续时间
+ * @param tube  数码管
+ */
+void marquee_play(marquee_player *p, const char *str, int steps, uint16_t ms,
+                  i2c_slave_info tube)
+{
+  tube_marquee_init(&p->m, str, steps);
+  p->tube = tube;
+  p->ms = ms;
+  p->next_us = sys_now_us();
+}
+
+/**
+ * @brief 推进跑马灯，到时则显示当前窗口并前进一位
+ * @param p 播放器
+ */
+void marquee_update(marquee_player *p)
+{
+  uint32_t now = sys_now_us();
+  if ((int32_t)(now - p->next_us) < 0)
+    return;
+  uint8_t window[MARQUEE_WINDOW];
+  tube_marquee_window(&p->m, window);
+  tube_fb_bind(p->tube);
+  for (int i = 0; i < MARQUEE_WINDOW; i++)
+  {
+    tube_fb_put(i, window[i]);
+  }
+  tube_fb_flush();
+  tube_marquee_step(&p->m);
+  p->next_us += p->ms * 1000;
+  if ((int32_t)(now - p->next_us) > 0)
+    p->next_us = now; // 落后时不追帧
+}
+
+// 加载动画：亮一段沿外圈顺时针走一圈，每帧60ms
+#define LOADING_FRAME(p, mask)                                                 \
+  {{(p) == 1 ? (mask) : 0, (p) == 2 ? (mask) : 0, (p) == 3 ? (mask) : 0,       \
+    (p) == 4 ? (mask) : 0},                                                    \
+   {0, 0, 0},                                                                  \
+   ANIM_TUBE,                                                                  \
+   60}
+static const anim_frame LOADING_ANIM[] = {
+    LOADING_FRAME(1, SEG_A), LOADING_FRAME(2, SEG_A), LOADING_FRAME(3, SEG_A),
+    LOADING_FRAME(4, SEG_A), LOADING_FRAME(4, SEG_B), LOADING_FRAME(4, SEG_C),
+    LOADING_FRAME(4, SEG_D), LOADING_FRAME(3, SEG_D), LOADING_FRAME(2, SEG_D),
+    LOADING_FRAME(1, SEG_D), LOADING_FRAME(1, SEG_E), LOADING_FRAME(1, SEG_F),
+};
+#define LOADING_FRAME_NUM (sizeof(LOADING_ANIM) / sizeof(LOADING_ANIM[0]))
+
+// 动画推进任务的周期
+#define ANIM_TICK_MS 10
+
+static void anim_task(void *arg)
+{
+  if (!anim_update(arg))
+    sched_stop();
+}
+
+/**
+ * @brief 加载动画，从左到右依次点亮数码管
+ * @param info I2C 设备信息
+ * @param round 轮数
+ */
+void loading(i2c_slave_info info, int round)
+{
+  anim_player a;
+  i2c_slave_info no_led;
+  memset(&no_led, 0, sizeof(no_led));
+  anim_play(&a, LOADING_ANIM, LOADING_FRAME_NUM, round, info, no_led);
+  sched_task tasks[1];
+  sched_task_init(&tasks[0], "loading", anim_task, &a, ANIM_TICK_MS);
+  scheduler s = {tasks, 1, 0};
+  sched_run(&s);
+
+  uint8_t blank[4] = {0, 0, 0, 0}; // 最后一帧显示完毕，清屏结束
+  e1_tube_all_set(info, blank);
+}
+
+// 欢迎界面与模式选择界面共用的跑马灯、彩灯动画
+// 每个跑马灯步内彩灯变色次数
+#define IDLE_COLOR_STEPS (MARQUEE_PERIOD_MS / LED_PERIOD_MS)
+#define IDLE_RAINBOW_FRAMES (IDLE_COLOR_STEPS * 12) // 色相转一圈
+
+void lb_task(void *arg); // 排行榜写入任务，见 4.6
+
+static PPP_TLS anim_frame idle_rainbow[IDLE_RAINBOW_FRAMES];
+static PPP_TLS int idle_rainbow_ready;
+
+/**
+ * @brief 预先算好彩虹帧表，每个跑马灯步内转一圈色相，步间整体推进30度
+ */
+static void idle_rainbow_build(void)
+{
+  if (idle_rainbow_ready)
+    return;
+  for (int i = 0; i < IDLE_RAINBOW_FRAMES; i++)
+  {
+    int j = i % IDLE_COLOR_STEPS;
+    int hue_base = i / IDLE_COLOR_STEPS * 30; // 每步整体推进色相
+    int hue = (hue_base + j * (360 / IDLE_COLOR_STEPS)) % 360;
+    rgb_color c = color_hsv(hue, 255, 128);
+    idle_rainbow[i] = (anim_frame){{0, 0, 0, 0}, {c.r, c.g, c.b}, ANIM_LED,
+                                   LED_PERIOD_MS};
+  }
+  idle_rainbow_ready = 1;
+}
+
+typedef struct
+{
+  i2c_slave_info tube_info;
+  i2c_slave_info led_info;
+  i2c_slave_info key_info;
+  const char *text; // 跑马灯文字
+  int text_steps;   // 跑马灯总步数
+  marquee_player marquee;
+  anim_player rainbow_anim;
+  int mode_select; // 1=只接受模式键'1'~'4'
+  int key;         // 结束时读到的按键
+} idle_screen;
+
+static void idle_anim_task(void *arg)
+{
+  idle_screen *st = arg;
+  marquee_update(&st->marquee);
+  anim_update(&st->rainbow_anim);
+}
+
+static void idle_rescan_task(void *arg)
+{
+  (void)arg;
+  dev_registry_rescan_step();
+}
+
+static void idle_input_task(void *arg)
+{
+  idle_screen *st = arg;
+  i2c_bus_drain(I2C_INFO_PERIPH(st->key_info));
+  int key = s1_key_value_get(st->key_info);
+  if (key == 0)
+    return;
+
+  led_group_set(&st->rainbow_anim.leds, COLOR_OFF); // 熄灭
+  tube_str_set(st->tube_info, "");       // 显示结束信息
+  if (!st->mode_select || (key >= '1' && key <= '4'))
+  {
+    st->key = key;
+    sched_stop();
+  }
+}
+
+/**
+ * @brief 运行跑马灯与彩灯，直到按下按键
+ * @param st 界面状态
+ * @retval 按下的按键
+ */
+static int idle_screen_run(idle_screen *st)
+{
+  idle_rainbow_build();
+  marquee_play(&st->marquee, st->text, st->text_steps, MARQUEE_PERIOD_MS,
+               st->tube_info);
+  anim_play(&st->rainbow_anim, idle_rainbow, IDLE_RAINBOW_FRAMES, 0,
+            st->tube_info, st->led_info);
+
+  sched_task tasks[4];
+  int n = 0;
+  sched_task_init(&tasks[n++], "input", idle_input_task, st, INPUT_PERIOD_MS);
+  sched_task_init(&tasks[n++], "anim", idle_anim_task, st, ANIM_TICK_MS);
+  sched_task_init(&tasks[n++], "store", lb_task, NULL, LB_TASK_PERIOD_MS);
+  if (DEV_RESCAN_MS > 0)
+    sched_task_init(&tasks[n++], "rescan", idle_rescan_task, st,
+                    DEV_RESCAN_MS);
+  scheduler s = {tasks, n, 0};
+  sched_run(&s);
+  return st->key;
+}
+
+/**
+ * @brief 欢迎界面，彩灯和数码管跑马灯
+ * @param tube_info 数码管信息
+ * @param led_info 彩灯信息
+ * @param key_info 按键信息
+ */
+void welcome(i2c_slave_info tube_info, i2c_slave_info led_info,
+             i2c_slave_info key_info)
+{
+  int window = 4;
+  int msg_len = 15;
+  idle_screen st = {.tube_info = tube_info,
+                    .led_info = led_info,
+                    .key_info = key_info,
+                    .text = "Welcome-to-PPP2025----",
+                    .text_steps = msg_len + window,
+                    .marquee = {.m = {0}},
+                    .rainbow_anim = {0},
+                    .mode_select = 0,
+                    .key = 0};
+  idle_screen_run(&st);
+}
+
+// 玩家反馈
+// 多人模式每名玩家一种颜色。得分提示、按键测试和结算画面共用这里的渲染：
+// 彩灯显示玩家颜色，数码管显示 "P<编号>.<分数>"。
+static const rgb_color PLAYER_COLOR[PLAYER_MAX] = {
+    {0, 255, 0},   // player1 绿
+    {0, 0, 255},   // player2 蓝
+    {255, 128, 0}, // player3 橙
+    {0, 255, 255}, // player4 青
+};
+
+/**
+ * @brief 一批按键结果的提示颜色
+ * @param results 每名玩家的结果（1=得分，-1=失分，0=没有按键）
+ * @param players 玩家数
+ * @retval 一人得分为其颜色，多人得分为白色；无人得分时一人失分为红色，
+ *         多人失分为紫色；没有按键为 COLOR_OFF
+ */
+rgb_color player_feedback_color(const int *results, int players)
+{
+  int scored = 0, missed = 0, first = 0;
+  for (int p = 0; p < players && p < PLAYER_MAX; p++)
+  {
+    if (results[p] > 0 && scored++ == 0)
+      first = p;
+    else if (results[p] < 0)
+      missed++;
+  }
+  if (scored == 1)
+    return PLAYER_COLOR[first];
+  if (scored > 1)
+    return (rgb_color){255, 255, 255};
+  if (missed == 1)
+    return (rgb_color){255, 0, 0};
+  if (missed > 1)
+    return (rgb_color){255, 0, 255};
+  return COLOR_OFF;
+}
+
+/**
+ * @brief 显示一名玩家：彩灯为玩家颜色，数码管为 "P<编号>.<分数>"
+ * @param e1_tube 数码管信息
+ * @param leds    彩灯组
+ * @param player  玩家（1起）
+ * @param score   分数（0~99），小于0时只显示编号
+ */
+void player_show(i2c_slave_info e1_tube, const led_group *leds, int player,
+                 int score)
+{
+  char str[12];
+  if (score < 0)
+    sprintf(str, "P%d", player);
+  else
+    sprintf(str, "P%d.%2d", player, score > 99 ? 99 : score);
+  tube_str_set(e1_tube, str);
+  led_group_set(leds, PLAYER_COLOR[(player - 1) % PLAYER_MAX]);
+}
+
+// 2. 按键
+
+// 多人模式的按键器，每名玩家一个
+typedef struct
+{
+  i2c_slave_info keys[PLAYER_MAX];
+  int count;
+} multi_key_info;
+
+/**
+ * @brief 取多人模式使用的按键器
+ * @param 无
+ * @retval 按键器列表，玩家 k 使用 keys[k-1]
+ * @note   按键器已在开机扫描时初始化，这里按控制器、地址顺序取登记表中全部
+ *         在线的按键器，最多 PLAYER_MAX 个
+ */
+multi_key_info s1_multi_key_init(void)
+{
+  multi_key_info multi_info;
+  multi_info.count = 0;
+  for (unsigned int i = 0; i < I2C_BUS_COUNT; i++)
+  {
+    for (unsigned int j = 0; j < sizeof(S1_HT16K33_ADDR); j++)
+    {
+      dev_entry *e = dev_registry_find(I2C_PERIPH_NUM[i], S1_HT16K33_ADDR[j]);
+      if (e && e->type == DEV_KEY && e->present &&
+          multi_info.count < PLAYER_MAX)
+      {
+        multi_info.keys[multi_info.count++] = e->info;
+      }
+    }
+  }
+  return multi_info;
+}
+
+/**
+ * @brief 获取一个玩家的按键值
+ * @param multi_info 按键器列表
+ * @param player 玩家编号（1起）
+ * @retval 按键值
+ * @note   如果玩家编号大于按键器数量，返回SWN
+ */
+char get_player_key(const multi_key_info *multi_info, int player)
+{
+  if (player >= 1 && player <= multi_info->count)
+  {
+    return s1_key_value_get(multi_info->keys[player - 1]);
+  }
+  return SWN;
+}
+
+// S1 按键器键值RAM
+// HT16K33 每次键扫描把 KS0~KS2 三行、K1~K13 列的状态写入 0x40~0x45（每行两字节，
+// 低字节在前）。一次连续读出6字节就得到所有按下的键，与上次扫描比较即可产生
+// 按下/松开边沿，同时按下的多个键都能看到。
+// 需要寄存器读：有异步后端（I2C_ASYNC_START）或 I2C_REG_BUF_READ 时启用（GD32F4
+// 板上由第1节的轮询读提供），否则按键采样退化为逐个调用 s1_key_value_get。
+// S1_KEY_MAP 的接线尚未在实物上核对，GD32F4 板上默认仍用厂商译码
+// （S1_KEY_VENDOR）；在按键测试模式中逐键核对一致后定义 S1_KEY_MAP_VERIFIED
+// 启用连续读。主机上 host/key_map.c 逐位比较 S1_KEY_MAP 与仿真器的厂商译码。
+#if (defined(GD32F450) || defined(GD32F470)) && !defined(S1_KEY_MAP_VERIFIED)
+#define S1_KEY_VENDOR 1
+#endif
+#if !defined(S1_KEY_VENDOR) &&                                                 \
+    (defined(I2C_ASYNC_START) || defined(I2C_REG_BUF_READ))
+#define S1_KEY_BURST 1
+#endif
+#define S1_KEY_RAM 0x40 // 键值RAM起始地址
+#define S1_KEY_ROWS 3
+#define S1_KEY_RAM_SIZE (S1_KEY_ROWS * 2)
+#ifndef KEY_DEBOUNCE_SCANS
+#define KEY_DEBOUNCE_SCANS 2 // 新状态需连续保持的扫描次数（1=不消抖）
+#endif
+#define S1_KEY_EDGES 8 // 每次扫描最多报告的边沿数
+
+// 键值RAM的位到按键值（行 KS0~KS2，列 K1~K13），0 表示未接
+// 注意：按假定的接线（3行×4列，与厂商 s1_key_value_get 的键值一致）排列，
+// 尚未在实物按键器上逐键核对（见 s1_key_map_check）
+static const char S1_KEY_MAP[S1_KEY_ROWS][16] = {
+    {'1', '2', '3', '*'},
+    {'4', '5', '6', '0'},
+    {'7', '8', '9', '#'},
+};
+
+// 按键边沿
+typedef struct
+{
+  char key;
+  uint8_t pressed; // 1=按下，0=松开
+} s1_key_edge;
+
+// 一个按键器的扫描状态
+typedef struct
+{
+  uint16_t stable[S1_KEY_ROWS];  // 消抖后的状态
+  uint16_t pending[S1_KEY_ROWS]; // 与 stable 不同、正在确认的位
+  uint8_t age[S1_KEY_ROWS][16];  // pending 位已保持的扫描次数
+  uint8_t debounce;              // 需要连续保持的扫描次数
+} s1_keypad;
+
+/**
+ * @brief 初始化按键器扫描状态
+ * @param debounce 新状态需连续保持的扫描次数（>=1）
+ */
+void s1_keypad_init(s1_keypad *kp, int debounce)
+{
+  memset(kp, 0, sizeof(*kp));
+  kp->debounce = debounce < 1 ? 1 : debounce;
+}
+
+/**
+ * @brief 用一次读出的键值RAM更新状态，输出确认的边沿
+ * @param kp    按键器扫描状态
+ * @param ram   键值RAM（S1_KEY_RAM_SIZE 字节）
+ * @param edges 边沿输出
+ * @param max   edges 容量
+ * @retval 边沿数
+ */
+int s1_keypad_update(s1_keypad *kp, const uint8_t *ram, s1_key_edge *edges,
+                     int max)
+{
+  int n = 0;
+  for (int r = 0; r < S1_KEY_ROWS; r++)
+  {
+    uint16_t raw = (uint16_t)(ram[2 * r] | (ram[2 * r + 1] << 8)) & 0x1FFF;
+    uint16_t diff = raw ^ kp->stable[r];
+    kp->pending[r] &= diff; // 回到稳定值的位重新计数
+    for (uint16_t bits = diff; bits; bits &= bits - 1)
+    {
+      int c = 0;
+      while (!(bits & (1u << c)))
+        c++;
+      uint16_t bit = 1u << c;
+      if (!(kp->pending[r] & bit))
+      {
+        kp->pending[r] |= bit;
+        kp->age[r][c] = 0;
+      }
+      if (++kp->age[r][c] < kp->debounce || n >= max)
+        continue;
+
+      kp->stable[r] ^= bit;
+      kp->pending[r] &= ~bit;
+      if (S1_KEY_MAP[r][c])
+      {
+        edges[n].key = S1_KEY_MAP[r][c];
+        edges[n].pressed = (raw & bit) != 0;
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief 列出当前按下的所有键
+ * @param keys 输出
+ * @param max  keys 容量
+ * @retval 按下的键数
+ */
+int s1_keypad_down(const s1_keypad *kp, char *keys, int max)
+{
+  int n = 0;
+  for (int r = 0; r < S1_KEY_ROWS; r++)
+  {
+    for (int c = 0; c < 16 && n < max; c++)
+    {
+      if ((kp->stable[r] & (1u << c)) && S1_KEY_MAP[r][c])
+        keys[n++] = S1_KEY_MAP[r][c];
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief 按 S1_KEY_MAP 译出键值RAM中第一个按下的键（不消抖）
+ * @param ram 键值RAM（S1_KEY_RAM_SIZE 字节）
+ * @retval 按键值，没有按下或按下的位未接时为 SWN
+ */
+char s1_key_ram_decode(const uint8_t *ram)
+{
+  for (int r = 0; r < S1_KEY_ROWS; r++)
+  {
+    uint16_t raw = (uint16_t)(ram[2 * r] | (ram[2 * r + 1] << 8)) & 0x1FFF;
+    for (int c = 0; raw; c++, raw >>= 1)
+    {
+      if (raw & 1)
+        return S1_KEY_MAP[r][c] ? S1_KEY_MAP[r][c] : SWN;
+    }
+  }
+  return SWN;
+}
+
+#ifdef I2C_REG_BUF_READ
+/**
+ * @brief 核对 S1_KEY_MAP：读出键值RAM，与厂商 s1_key_value_get 的键值比较
+ * @param info 按键器
+ * @param key  厂商译码读到的键值
+ * @retval 1=一致，0=不一致（串口输出键值RAM）
+ * @note   按键测试模式中调用，每个键按一遍即可核对接线
+ */
+int s1_key_map_check(i2c_slave_info info, char key)
+{
+  uint8_t ram[S1_KEY_RAM_SIZE];
+  i2c_bus_drain(I2C_INFO_PERIPH(info));
+  I2C_REG_BUF_READ(info, S1_KEY_RAM, ram, S1_KEY_RAM_SIZE);
+  char mapped = s1_key_ram_decode(ram);
+  if (mapped == key)
+    return 1;
+  PPP_LOG("[key] map: vendor=%c map=%c ram=%02x %02x %02x %02x %02x %02x\r\n",
+          key ? key : '-', mapped ? mapped : '-', ram[0], ram[1], ram[2],
+          ram[3], ram[4], ram[5]);
+  return 0;
+}
+#endif
+
+// 按键采样与事件队列
+// 采样任务（生产者）按固定周期读取所有按键器，检测按下/松开边沿并写入带时间戳
+// 的事件队列；游戏任务（消费者）每次运行时取空队列。队列为单生产者单消费者
+// 无锁环形缓冲，采样也可以移到定时器中断中进行。
+// 支持键值RAM连续读（S1_KEY_BURST）时，每个按键器每次采样只提交一个读作业，
+// 在完成回调中消抖并产生边沿，采样任务不等待总线。
+// 每次采样把所有按键器的读操作紧挨着提交，事件带采样序号、本次采样中的读取
+// 位次和读到键值的时间；各按键器读取时间相对本次第一个读取的差值（偏斜）计入
+// 统计。读取顺序每次采样轮转一位，N 个按键器时每名玩家的采样延迟（采样开始→
+// 读到键值）平均为 (N-1)/2 次读传输，最坏 N-1 次，与玩家编号无关；每名玩家的
+// 采样延迟分别统计。
+#define KEY_PLAYER_MAX 4        // 最多按键器数量
+#define KEY_SAMPLE_PERIOD_MS 5  // 默认采样周期
+#define KEY_EVENT_RING 32       // 事件队列大小（2的幂）
+
+#ifdef SYS_CLOCK_DWT
+#define MEM_BARRIER() __DMB()
+#else
+#define MEM_BARRIER() __sync_synchronize()
+#endif
+
+// 按键事件
+typedef struct
+{
+  uint32_t time_us;   // 读到键值的时间
+  uint32_t sample_us; // 本次采样开始的时间
+  uint16_t seq;       // 采样序号
+  uint8_t rank;     // 在本次采样中的读取位次（轮流交换）
+  uint8_t player;   // 按键器序号（0起）
+  char key;         // 按键值
+  uint8_t pressed;  // 1=按下，0=松开
+} key_event;
+
+typedef struct
+{
+  key_event buf[KEY_EVENT_RING];
+  volatile uint32_t head; // 只由生产者写
+  volatile uint32_t tail; // 只由消费者写
+  uint32_t dropped;       // 队列满时丢弃的事件数
+} key_event_queue;
+
+/**
+ * @brief 写入事件（生产者）
+ * @retval 1=成功，0=队列满
+ */
+static int key_queue_push(key_event_queue *q, const key_event *ev)
+{
+  uint32_t head = q->head;
+  if (head - q->tail >= KEY_EVENT_RING)
+  {
+    q->dropped++;
+    return 0;
+  }
+  q->buf[head % KEY_EVENT_RING] = *ev;
+  MEM_BARRIER(); // 先写数据再发布
+  q->head = head + 1;
+  return 1;
+}
+
+/**
+ * @brief 取出事件（消费者）
+ * @retval 1=取到事件，0=队列空
+ */
+int key_queue_pop(key_event_queue *q, key_event *ev)
+{
+  uint32_t tail = q->tail;
+  if (tail == q->head)
+  {
+    return 0;
+  }
+  MEM_BARRIER();
+  *ev = q->buf[tail % KEY_EVENT_RING];
+  MEM_BARRIER(); // 读完数据再释放槽位
+  q->tail = tail + 1;
+  return 1;
+}
+
+// 按键采样器
+typedef struct key_input key_input;
+
+// 连续读模式下一个按键器的状态
+typedef struct
+{
+  key_input *in;
+  uint8_t player;
+  uint8_t busy;       // 读作业尚未完成
+  uint8_t rank;       // 本次读取位次
+  uint16_t seq;       // 本次采样序号
+  uint32_t sample_us; // 本次采样开始的时间
+  s1_keypad pad;
+} key_port;
+
+struct key_input
+{
+  i2c_slave_info keys[KEY_PLAYER_MAX];
+  int count;
+  char last[KEY_PLAYER_MAX]; // 上次采样值（逐键读取模式）
+#ifdef S1_KEY_BURST
+  key_port ports[KEY_PLAYER_MAX];
+#endif
+  int first; // 本次最先采样的按键器，轮流交换保证公平
+  uint32_t period_us;        // 采样周期
+  key_event_queue queue;
+  // 采样抖动统计
+  uint32_t last_us;
+  uint32_t samples;
+  uint32_t jitter_max_us;
+  uint64_t jitter_sum_us;
+  // 每名玩家的采样延迟统计
+  uint32_t lag_count[KEY_PLAYER_MAX];
+  uint32_t lag_max_us[KEY_PLAYER_MAX];
+  uint64_t lag_sum_us[KEY_PLAYER_MAX];
+  // 按键器间读取偏斜统计
+  uint16_t skew_seq;      // 当前统计的采样序号
+  uint32_t skew_first_us; // 该次采样第一个读到键值的时间
+  uint32_t skew_count;
+  uint32_t skew_max_us;
+  uint64_t skew_sum_us;
+};
+
+/**
+ * @brief 初始化按键采样器
+ * @param in        采样器
+ * @param keys      按键器数组
+ * @param count     按键器数量
+ * @param period_ms 采样周期（毫秒）
+ */
+void key_input_init(key_input *in, const i2c_slave_info *keys, int count,
+                    uint32_t period_ms)
+{
+  memset(in, 0, sizeof(*in));
+  if (count > KEY_PLAYER_MAX)
+    count = KEY_PLAYER_MAX;
+  for (int i = 0; i < count; i++)
+  {
+    in->keys[i] = keys[i];
+    in->last[i] = SWN;
+#ifdef S1_KEY_BURST
+    in->ports[i].in = in;
+    in->ports[i].player = i;
+    s1_keypad_init(&in->ports[i].pad, KEY_DEBOUNCE_SCANS);
+#endif
+  }
+  in->count = count;
+  in->period_us = period_ms * 1000;
+}
+
+/**
+ * @brief 记录一个按键器读到键值的时间，计入该玩家的采样延迟和与本次采样
+ *        第一个读取的偏斜
+ */
+static void key_input_skew(key_input *in, int player, uint16_t seq,
+                           uint32_t sample_us, uint32_t now)
+{
+  uint32_t lag = now - sample_us;
+  in->lag_count[player]++;
+  in->lag_sum_us[player] += lag;
+  if (lag > in->lag_max_us[player])
+    in->lag_max_us[player] = lag;
+  if (in->count < 2)
+    return;
+  if (seq != in->skew_seq || in->skew_count == 0)
+  {
+    in->skew_seq = seq;
+    in->skew_first_us = now;
+    in->skew_count++; // 第一个读取偏斜为0，同样计入
+    return;
+  }
+  uint32_t skew = now - in->skew_first_us;
+  in->skew_count++;
+  in->skew_sum_us += skew;
+  if (skew > in->skew_max_us)
+    in->skew_max_us = skew;
+  PPP_SIM_EVENT("key_skew", (int)skew);
+}
+
+#ifdef S1_KEY_BURST
+/**
+ * @brief 键值RAM读完成：消抖并把边沿写入事件队列
+ */
+static void key_port_done(const i2c_job *job, void *arg)
+{
+  key_port *port = arg;
+  port->busy = 0;
+  if (job->status != 0)
+    return;
+
+  uint32_t now = sys_now_us();
+  key_input_skew(port->in, port->player, port->seq, port->sample_us, now);
+  s1_key_edge edges[S1_KEY_EDGES];
+  int n = s1_keypad_update(&port->pad, job->data, edges, S1_KEY_EDGES);
+  for (int i = 0; i < n; i++)
+  {
+    key_event ev;
+    ev.time_us = now;
+    ev.sample_us = port->sample_us;
+    ev.seq = port->seq;
+    ev.rank = port->rank;
+    ev.player = port->player;
+    ev.key = edges[i].key;
+    ev.pressed = edges[i].pressed;
+    key_queue_push(&port->in->queue, &ev);
+  }
+}
+
+/**
+ * @brief 提交一个按键器的键值RAM读作业
+ * @param in   采样器
+ * @param i    按键器序号
+ * @param rank 本次采样中的读取位次
+ */
+static void key_input_read(key_input *in, int i, int rank)
+{
+  key_port *port = &in->ports[i];
+  if (port->busy)
+    return; // 总线忙，上次的读还没完成
+  port->busy = 1;
+  port->rank = rank;
+  port->seq = (uint16_t)in->samples;
+  port->sample_us = in->last_us;
+  i2c_submit_read(in->keys[i], S1_KEY_RAM, S1_KEY_RAM_SIZE, key_port_done,
+                  port);
+}
+#else
+/**
+ * @brief 读取一个按键器的当前键值，与上次不同时产生事件
+ * @param in   采样器
+ * @param i    按键器序号
+ * @param rank 本次采样中的读取位次
+ */
+static void key_input_read(key_input *in, int i, int rank)
+{
+  i2c_bus_drain(I2C_INFO_PERIPH(in->keys[i]));
+  char key = s1_key_value_get(in->keys[i]);
+  uint32_t now = sys_now_us();
+  key_input_skew(in, i, (uint16_t)in->samples, in->last_us, now);
+  if (key == in->last[i])
+    return;
+
+  key_event ev;
+  ev.time_us = now;
+  ev.sample_us = in->last_us;
+  ev.seq = (uint16_t)in->samples;
+  ev.rank = rank;
+  ev.player = i;
+  if (in->last[i] != SWN) // 先松开旧键
+  {
+    ev.key = in->last[i];
+    ev.pressed = 0;
+    key_queue_push(&in->queue, &ev);
+  }
+  if (key != SWN)
+  {
+    ev.key = key;
+    ev.pressed = 1;
+    key_queue_push(&in->queue, &ev);
+  }
+  in->last[i] = key;
+}
+#endif
+
+/**
+ * @brief 采样所有按键器，产生按下/松开事件（生产者）
+ * @param in 采样器
+ */
+void key_input_sample(key_input *in)
+{
+  uint32_t now = sys_now_us();
+  if (in->samples > 0)
+  {
+    uint32_t interval = now - in->last_us;
+    uint32_t jitter = interval > in->period_us ? interval - in->period_us
+                                               : in->period_us - interval;
+    in->jitter_sum_us += jitter;
+    if (jitter > in->jitter_max_us)
+      in->jitter_max_us = jitter;
+  }
+  in->last_us = now;
+  in->samples++;
+
+  for (int n = 0; n < in->count; n++)
+  {
+    key_input_read(in, (in->first + n) % in->count, n);
+  }
+  in->first = (in->first + 1) % in->count;
+}
+
+/**
+ * @brief 输出采样抖动与丢弃事件统计
+ * @param in 采样器
+ */
+void key_input_report(const key_input *in)
+{
+  uint32_t avg =
+      in->samples > 1 ? (uint32_t)(in->jitter_sum_us / (in->samples - 1)) : 0;
+  PPP_LOG("[key] samples=%lu period=%luus jitter avg=%luus max=%luus "
+          "dropped=%lu\r\n",
+          (unsigned long)in->samples, (unsigned long)in->period_us,
+          (unsigned long)avg, (unsigned long)in->jitter_max_us,
+          (unsigned long)in->queue.dropped);
+  for (int i = 0; i < in->count; i++)
+  {
+    if (in->lag_count[i] == 0)
+      continue;
+    PPP_LOG("[key] p%d lag avg=%luus max=%luus\r\n", i + 1,
+            (unsigned long)(in->lag_sum_us[i] / in->lag_count[i]),
+            (unsigned long)in->lag_max_us[i]);
+  }
+  if (in->skew_count > 0)
+  {
+    PPP_LOG("[key] skew reads=%lu avg=%luus max=%luus\r\n",
+            (unsigned long)in->skew_count,
+            (unsigned long)(in->skew_sum_us / in->skew_count),
+            (unsigned long)in->skew_max_us);
+  }
+}
+
+/**
+ * @brief 测试按键
+ */
+void test_button()
+{
+  i2c_slave_info s1_key = dev_registry_get(DEV_KEY, 0);
+  i2c_slave_info e1_tube = dev_registry_get(DEV_TUBE, 0);
+  char str[8]; // 足够大
+
+  char i = s1_key_value_get(s1_key); // 读取按键值
+  sprintf(str, "%d", i);             // 转成字符串
+
+  tube_str_set(e1_tube, str); // 显示
+}
+
+// 3. NFC
+
+// 卡ID
+const unsigned char CARD0_ID[4] = {0x93, 0x71, 0xAF, 0x95}; // card0: 9371AF95
+const unsigned char CARD1_ID[4] = {0x63, 0x93, 0xBE, 0x95}; // card1: 6393BE95
+// 卡类型
+unsigned char CardType[2] = {0};
+// 识别到的卡ID
+unsigned char CardID[4] = {0};
+
+// 比较两个卡ID是否一致
+int compare_card_id(const unsigned char *id1, const unsigned char *id2)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    if (id1[i] != id2[i])
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief 卡ID转卡号
+ * @param id 卡ID
+ * @retval 0=card0，1=card1，-2=不是这两张卡
+ */
+int card_number_of(const unsigned char *id)
+{
+  if (compare_card_id(id, CARD0_ID))
+  {
+    return 0;
+  }
+  else if (compare_card_id(id, CARD1_ID))
+  {
+    return 1;
+  }
+  return -2;
+}
+
+/**
+ * @brief 返回当前卡号：0=card0，1=card1，-1=没有卡，-2=不是这两张卡
+ * @param s5_nfc NFC信息
+ * @retval 当前卡号
+ */
+int get_current_card_number(i2c_slave_info s5_nfc)
+{
+  if (s5_nfc_request(s5_nfc, PICC_REQIDL, CardType) == MI_OK &&
+      s5_nfc_anticoll(s5_nfc, CardID) == MI_OK)
+  {
+    return card_number_of(CardID);
+  }
+  return -1;
+}
+
+// NFC读卡状态机
+// 空闲 -> 检测到卡 -> 卡号确认 -> 卡移开 -> 空闲
+// 空闲时轮询间隔逐步退避；卡号确认后缓存卡号，只用一次寻卡确认卡仍在场，
+// 不再重复防冲突读卡号。游戏只消费“卡到达”事件。本轮不需要刷卡时空闲退避到
+// NFC_POLL_SLOW_MS、在场确认放慢到 NFC_POLL_MAX_MS，只为登记玩家身份卡和发现
+// 卡移开保留低频轮询。
+#define NFC_POLL_MIN_MS 40      // 空闲时最短轮询间隔
+#define NFC_POLL_MAX_MS 320     // 等卡时空闲轮询的最长间隔
+#define NFC_POLL_SLOW_MS 1280   // 不需要刷卡时空闲轮询的最长间隔
+#define NFC_PRESENCE_MS 100     // 等卡时卡在场的确认间隔
+#define NFC_REMOVE_MISSES 3     // 连续几次寻卡失败判定为移开
+#define NFC_TASK_PERIOD_MS 20   // 状态机任务周期
+#ifndef PICC_REQALL
+#define PICC_REQALL 0x52 // 寻天线区内全部卡（含休眠卡）
+#endif
+
+typedef enum
+{
+  NFC_IDLE,      // 无卡
+  NFC_PRESENT,   // 寻到卡，尚未读到卡号
+  NFC_CONFIRMED, // 卡号已确认
+  NFC_REMOVED,   // 卡已移开
+} nfc_state;
+
+typedef struct
+{
+  i2c_slave_info info;
+  nfc_state state;
+  unsigned char uid[4]; // 缓存的卡号
+  int misses;           // 连续寻卡失败次数
+  uint32_t interval_ms; // 当前轮询间隔
+  int wanted;           // 本轮需要刷卡
+  uint32_t next_us;     // 下次轮询时间
+  int arrived;          // 未消费的卡到达事件
+  // 统计
+  uint32_t polls;  // 实际访问总线的轮询次数
+  uint32_t bus_us; // 累计总线时间
+} nfc_reader;
+
+/**
+ * @brief 初始化读卡状态机
+ * @param r    状态机
+ * @param info NFC信息
+ */
+void nfc_reader_init(nfc_reader *r, i2c_slave_info info)
+{
+  memset(r, 0, sizeof(*r));
+  r->info = info;
+  r->state = NFC_IDLE;
+  r->interval_ms = NFC_POLL_MIN_MS;
+  r->wanted = 1;
+  r->next_us = sys_now_us();
+}
+
+/**
+ * @brief 设置是否正在等卡
+ * @param r      状态机
+ * @param wanted 1=本轮需要刷卡，0=不需要（空闲轮询降到 NFC_POLL_SLOW_MS）
+ * @note  转为等卡时，已排好的慢速轮询提前到等卡时的间隔以内
+ */
+void nfc_reader_demand(nfc_reader *r, int wanted)
+{
+  r->wanted = wanted;
+  uint32_t max = r->state == NFC_CONFIRMED ? NFC_PRESENCE_MS : NFC_POLL_MAX_MS;
+  if (wanted && r->interval_ms > max)
+  {
+    r->next_us -= (r->interval_ms - max) * 1000;
+    r->interval_ms = max;
+  }
+}
 
-// 数码管地址定义
-static const uint8_t TUBE_ADDR[4][2] = {
-    {0x02, 0x03}, // bit 1
-    {0x04, 0x05}, // bit 2
-    {0x06, 0x07}, // bit 3
-    {0x08, 0x09}, // bit 4
+/**
+ * @brief 运行一次状态机，未到轮询时间时不访问总线
+ * @param r 状态机
+ */
+void nfc_reader_poll(nfc_reader *r)
+{
+  uint32_t now = sys_now_us();
+  if ((int32_t)(now - r->next_us) < 0)
+  {
+    return;
+  }
+
+  unsigned char type[2];
+  i2c_bus_drain(I2C_INFO_PERIPH(r->info)); // 厂商函数直接访问总线
+  switch (r->state)
+  {
+  case NFC_IDLE:
+    if (s5_nfc_request(r->info, PICC_REQIDL, type) != MI_OK)
+    {
+      // 无卡，退避
+      r->interval_ms *= 2;
+      uint32_t max = r->wanted ? NFC_POLL_MAX_MS : NFC_POLL_SLOW_MS;
+      if (r->interval_ms > max)
+        r->interval_ms = max;
+      break;
+    }
+    r->state = NFC_PRESENT;
+    r->misses = 0;
+    // 同一次轮询中直接读卡号
+    // fall through
+  case NFC_PRESENT:
+    if (s5_nfc_anticoll(r->info, r->uid) == MI_OK)
+    {
+      r->state = NFC_CONFIRMED;
+      r->arrived = 1;
+      r->misses = 0;
+      r->interval_ms = NFC_PRESENCE_MS;
+    }
+    else if (++r->misses >= NFC_REMOVE_MISSES)
+    {
+      r->state = NFC_IDLE;
+      r->interval_ms = NFC_POLL_MIN_MS;
+    }
+    else
+    {
+      r->interval_ms = NFC_POLL_MIN_MS;
+    }
+    break;
+  case NFC_CONFIRMED:
+    // 防冲突后卡处于就绪态，寻卡可能隔次失败，因此连续多次失败才判定移开
+    r->interval_ms = r->wanted ? NFC_PRESENCE_MS : NFC_POLL_MAX_MS;
+    if (s5_nfc_request(r->info, PICC_REQALL, type) == MI_OK)
+    {
+      r->misses = 0;
+    }
+    else if (++r->misses >= NFC_REMOVE_MISSES)
+    {
+      r->state = NFC_REMOVED;
+    }
+    break;
+  case NFC_REMOVED:
+    break;
+  }
+
+  if (r->state == NFC_REMOVED)
+  {
+    memset(r->uid, 0, sizeof(r->uid));
+    r->arrived = 0;
+    r->state = NFC_IDLE;
+    r->interval_ms = NFC_POLL_MIN_MS;
+  }
+
+  uint32_t end = sys_now_us();
+  r->polls++;
+  r->bus_us += end - now;
+  r->next_us = end + r->interval_ms * 1000;
+}
+
+/**
+ * @brief 取走卡到达事件
+ * @param r 状态机
+ * @retval 到达的卡号（同 get_current_card_number），无事件返回-1
+ */
+int nfc_reader_take_arrival(nfc_reader *r)
+{
+  if (!r->arrived)
+  {
+    return -1;
+  }
+  r->arrived = 0;
+  return card_number_of(r->uid);
+}
+
+/**
+ * @brief 输出轮询统计
+ * @param r 状态机
+ */
+void nfc_reader_report(const nfc_reader *r)
+{
+  PPP_LOG("[nfc] polls=%lu bus=%luus\r\n", (unsigned long)r->polls,
+          (unsigned long)r->bus_us);
+}
+
+/**
+ * @brief 测试NFC
+ * @param e1_tube 数码管信息
+ * @param e1_led 彩灯信息
+ * @param s1_key 按键信息
+ * @param s5_nfc NFC信息
+ */
+void nfc_test(i2c_slave_info e1_tube, i2c_slave_info e1_led,
+              i2c_slave_info s1_key, i2c_slave_info s5_nfc)
+{
+  unsigned char CardID[4] = {0};
+  char buf[10] = {0};
+
+  tube_str_set(e1_tube, "nfc");
+  sys_delay_ms(500);
+
+  while (1)
+  {
+    int pos = 0;
+    if (s1_key_value_get(s1_key) != 0)
+    {
+      pos = 1;
+    }
+    if (s5_nfc_request(s5_nfc, 0x26, NULL) == MI_OK &&
+        s5_nfc_anticoll(s5_nfc, CardID) == MI_OK)
+    {
+      sprintf(buf, "%02x%02x", CardID[0 + 2 * pos], CardID[1 + 2 * pos]);
+      tube_str_set(e1_tube, buf);
+      if (compare_card_id(CardID, CARD0_ID))
+      {
+        led_rgb_set(e1_led, 0, 100, 0);
+      }
+      else if (compare_card_id(CardID, CARD1_ID))
+      {
+        led_rgb_set(e1_led, 0, 0, 100);
+      }
+      else
+      {
+        led_rgb_set(e1_led, 100, 100, 0);
+      }
+    }
+    else
+    {
+      led_rgb_set(e1_led, 100, 100, 0);
+    }
+    i2c_queue_drain(); // 这里没有调度器推进队列，每轮发出数码管和彩灯的作业
+  }
+}
+
+// 4. 游戏代码
+
+// 4.1 游戏代码与显示
+
+// 管道编号、游戏代码结构体与判定函数见 game_rules.h
+
+// 同一位数码管上三个管道（第 p、p+3、p+6 位）组成的3位索引到段掩码
+static const uint8_t TARGET_COLUMN_SEG[8] = {
+    0,
+    SEG_A,
+    SEG_G,
+    SEG_A | SEG_G,
+    SEG_D,
+    SEG_A | SEG_D,
+    SEG_G | SEG_D,
+    SEG_A | SEG_G | SEG_D,
+};
+
+/**
+ * @brief 在数码管上显示当前游戏代码状态
+ * @param tube_info 数码管信息
+ * @param code 游戏代码
+ * @note  风扇由执行器任务单独更新
+ */
+void display_code(i2c_slave_info tube_info, const struct game_code *code)
+{
+  uint8_t seg_mask[4];
+  unsigned int t = code->targets;
+  for (int p = 1; p <= 3; p++)
+  {
+    seg_mask[p] = TARGET_COLUMN_SEG[((t >> p) & 1) | ((t >> (p + 2)) & 2) |
+                                    ((t >> (p + 4)) & 4)];
+  }
+  // 显示unsolved
+  seg_mask[0] = tube_char_mask('0' + code->unsolved) | SEG_DP;
+  e1_tube_all_set(tube_info, seg_mask);
+}
+
+// 4.2 游戏代码随机生成
+
+// 伪随机数：开机时用温湿度传感器采集一次熵作为种子，之后只做 xorshift32
+// 运算，生成游戏代码时不再访问总线
+static PPP_TLS uint32_t prng_state = 1;
+
+/**
+ * @brief 设置随机数种子
+ * @param seed 种子（为0时替换为非零常数）
+ */
+void prng_seed(uint32_t seed)
+{
+  prng_state = seed ? seed : 0x9E3779B9u;
+}
+
+/**
+ * @brief 用温湿度读数和时钟采集熵，设置随机数种子
+ * @param temp_humi_info 温湿度传感器信息
+ * @retval 种子
+ */
+uint32_t prng_seed_from_sensor(i2c_slave_info temp_humi_info)
+{
+  uint32_t h = 2166136261u; // FNV-1a
+  for (int i = 0; i < 4; i++)
+  {
+    s2_ths_t t = s2_ths_value_get(temp_humi_info);
+    uint32_t words[3] = {(uint32_t)(int)(t.temp * 100),
+                         (uint32_t)(int)(t.humi * 100), sys_now_us()};
+    for (int w = 0; w < 3; w++)
+    {
+      h = (h ^ words[w]) * 16777619u;
+    }
+  }
+  // 末尾混合，使相近的读数得到差异很大的种子
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35u;
+  h ^= h >> 16;
+  prng_seed(h);
+  return h;
+}
+
+// 4.3 游戏核心函数
+// 计分与判定规则见 game_rules.h
+
+/**
+ * @brief 初始化所有设备
+ */
+void init_all(i2c_slave_info e1_tube, i2c_slave_info e1_led,
+              i2c_slave_info e2_fan, i2c_slave_info e3_curtain)
+{
+  actuator_cache_invalidate(); // 每局开始前重新同步所有执行器
+  tube_str_set(e1_tube, "");
+  led_rgb_set(e1_led, 0, 0, 0);
+  fan_speed_set(e2_fan, 0);
+  curtain_position_set(e3_curtain, 100);
+  loading(e1_tube, 1);
+}
+
+/**
+ * @brief 选择模式(单人/多人/测试多按键)
+ * @param e1_tube 数码管信息
+ * @param e1_led 彩灯信息
+ * @param s1_key 按键信息
+ * @retval 模式
+ */
+int chose_mode(i2c_slave_info e1_tube, i2c_slave_info e1_led,
+               i2c_slave_info s1_key)
+{
+  int window = 4;
+  int msg_len = 12;
+  idle_screen st = {.tube_info = e1_tube,
+                    .led_info = e1_led,
+                    .key_info = s1_key,
+                    .text = "CHOOSE-MODE----",
+                    .text_steps = msg_len + window,
+                    .marquee = {.m = {0}},
+                    .rainbow_anim = {0},
+                    .mode_select = 1,
+                    .key = 0};
+  return idle_screen_run(&st) - '0';
+}
+
+// 4.4 反应时间统计
+// 每只地鼠记录生成时间和第一次真正显示的时间，击中时用按键事件的采样时间
+// 计算反应时间（显示→按下），按玩家计入固定分桶直方图；同时统计生成→显示
+// 的渲染延迟和每名玩家采样→处理的输入延迟，用于发现输入链路的退化，以及
+// 玩家增多时输入延迟是否仍然一致。
+// 显示时间取数码管刷新完成的时间：提交画面后在同一总线上跟一个栅栏作业，
+// 其完成回调记录时间，不含随队列深度变化的排队和总线传输时间。
+#define REACT_BUCKET_MS 20 // 分桶宽度
+#define REACT_BUCKETS 64   // 分桶数，最后一桶收容更慢的样本
+
+typedef struct
+{
+  uint16_t buckets[REACT_BUCKETS];
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint64_t sum_us;
+} latency_hist;
+
+typedef struct
+{
+  uint32_t spawn_us[TARGET_MAX + 1]; // 地鼠生成时间
+  uint32_t shown_us[TARGET_MAX + 1]; // 地鼠第一次显示（刷新完成）的时间
+  uint16_t pending;                  // 已生成、尚未提交显示的地鼠
+  uint16_t shown;                    // 已显示的地鼠
+  uint16_t round;                    // 生成轮次，丢弃上一轮迟到的刷新完成
+  latency_hist react[KEY_PLAYER_MAX]; // 每名玩家的反应时间
+  latency_hist render;                // 生成→显示
+  latency_hist input[KEY_PLAYER_MAX]; // 每名玩家 采样开始→游戏处理
+} react_stats;
+
+/**
+ * @brief 记录一个样本
+ */
+static void latency_hist_add(latency_hist *h, uint32_t us)
+{
+  uint32_t b = us / (REACT_BUCKET_MS * 1000);
+  h->buckets[b < REACT_BUCKETS ? b : REACT_BUCKETS - 1]++;
+  if (h->count == 0 || us < h->min_us)
+    h->min_us = us;
+  if (us > h->max_us)
+    h->max_us = us;
+  h->sum_us += us;
+  h->count++;
+}
+
+/**
+ * @brief 估计百分位数（取所在分桶的上沿，并限制在最小、最大值之间）
+ * @param h   直方图
+ * @param pct 百分位（1~100）
+ * @retval 微秒
+ */
+static uint32_t latency_hist_percentile(const latency_hist *h, int pct)
+{
+  if (h->count == 0)
+    return 0;
+  uint32_t rank = (h->count * pct + 99) / 100, seen = 0;
+  int b = 0;
+  for (; b < REACT_BUCKETS - 1; b++)
+  {
+    seen += h->buckets[b];
+    if (seen >= rank)
+      break;
+  }
+  uint32_t us = (uint32_t)(b + 1) * REACT_BUCKET_MS * 1000;
+  if (us > h->max_us)
+    us = h->max_us;
+  if (us < h->min_us)
+    us = h->min_us;
+  return us;
+}
+
+static void latency_hist_report(const char *name, const latency_hist *h)
+{
+  if (h->count == 0)
+    return;
+  PPP_LOG("[react] %-8s n=%lu min=%lums med=%lums p95=%lums max=%lums "
+          "avg=%lums\r\n",
+          name, (unsigned long)h->count, (unsigned long)(h->min_us / 1000),
+          (unsigned long)(latency_hist_percentile(h, 50) / 1000),
+          (unsigned long)(latency_hist_percentile(h, 95) / 1000),
+          (unsigned long)(h->max_us / 1000),
+          (unsigned long)(h->sum_us / h->count / 1000));
+}
+
+/**
+ * @brief 新一轮地鼠生成
+ * @param r       统计
+ * @param targets 地鼠位图
+ */
+static void react_spawn(react_stats *r, uint16_t targets)
+{
+  uint32_t now = sys_now_us();
+  for (int k = 1; k <= TARGET_MAX; k++)
+  {
+    if (targets & (1u << k))
+      r->spawn_us[k] = now;
+  }
+  r->pending = targets;
+  r->shown = 0;
+  r->round++;
+}
+
+/**
+ * @brief 数码管刷新完成（栅栏作业的回调），记录其中新出现的地鼠
+ * @note  job->data 为新出现的地鼠位图和提交时的轮次
+ */
+static void react_shown(const i2c_job *job, void *arg)
+{
+  react_stats *r = arg;
+  uint16_t fresh, round;
+  memcpy(&fresh, &job->data[0], sizeof(fresh));
+  memcpy(&round, &job->data[2], sizeof(round));
+  if (round != r->round)
+    return; // 刷新完成前已进入下一轮
+  uint32_t now = sys_now_us();
+  for (int k = 1; k <= TARGET_MAX; k++)
+  {
+    if (fresh & (1u << k))
+    {
+      r->shown_us[k] = now;
+      latency_hist_add(&r->render, now - r->spawn_us[k]);
+    }
+  }
+  r->shown |= fresh;
+}
+
+/**
+ * @brief 画面已提交显示：在数码管的总线上跟一个栅栏作业，刷新完成时记录
+ *        其中新出现的地鼠
+ * @param r       统计
+ * @param tube    数码管
+ * @param targets 本次显示的地鼠位图
+ */
+static void react_display(react_stats *r, i2c_slave_info tube,
+                          uint16_t targets)
+{
+  uint16_t fresh = r->pending & targets;
+  if (!fresh)
+    return;
+  r->pending &= ~fresh;
+  i2c_job job = {.info = tube, .type = I2C_JOB_CALL}; // 栅栏，不计字节
+  memcpy(&job.data[0], &fresh, sizeof(fresh));
+  memcpy(&job.data[2], &r->round, sizeof(r->round));
+  job.done = react_shown;
+  job.arg = r;
+  i2c_submit(&job);
+}
+
+/**
+ * @brief 处理一次按下事件的时间
+ * @param r   统计
+ * @param ev  按键事件
+ * @param hit 是否击中（击中时事件中的键对应的地鼠已显示才计入反应时间）
+ */
+static void react_press(react_stats *r, const key_event *ev, int hit)
+{
+  if (ev->player < KEY_PLAYER_MAX)
+  {
+    uint32_t input_us = sys_now_us() - ev->sample_us;
+    latency_hist_add(&r->input[ev->player], input_us);
+#ifdef PPP_HOST
+    static const char *const INPUT_EVENT[KEY_PLAYER_MAX] = {"input1", "input2",
+                                                            "input3", "input4"};
+    PPP_SIM_EVENT(INPUT_EVENT[ev->player], (int)input_us);
+#endif
+  }
+  unsigned int k = (unsigned int)(ev->key - '0');
+  if (!hit || k < 1 || k > TARGET_MAX || !(r->shown & (1u << k)))
+    return; // 按错或地鼠尚未显示（猜中）
+  r->shown &= ~(1u << k);
+  uint32_t us = ev->time_us - r->shown_us[k];
+  if ((int32_t)us < 0)
+    return; // 采样早于显示：按下时地鼠还没出现，同样算猜中
+  PPP_SIM_EVENT("react", (int)us);
+  if (ev->player < KEY_PLAYER_MAX)
+    latency_hist_add(&r->react[ev->player], us);
+}
+
+/**
+ * @brief 输出各玩家反应时间与延迟统计
+ * @param r       统计
+ * @param players 玩家数
+ */
+void react_report(const react_stats *r, int players)
+{
+  for (int p = 0; p < players && p < KEY_PLAYER_MAX; p++)
+  {
+    char name[12];
+    sprintf(name, "p%d", p + 1);
+    latency_hist_report(name, &r->react[p]);
+  }
+  latency_hist_report("render", &r->render);
+  for (int p = 0; p < players && p < KEY_PLAYER_MAX; p++)
+  {
+    char name[12];
+    sprintf(name, "input%d", p + 1);
+    latency_hist_report(name, &r->input[p]);
+  }
+}
+
+// 4.5 事件录制
+// 每局开始记录随机数状态和模式，游戏中记录送入游戏逻辑的按键、刷卡事件（相对
+// 开局的时间），结束时记录结果。游戏结果只取决于随机数状态和事件顺序，回放时
+// 把事件按顺序送回同一套游戏逻辑即可逐位复现，不需要等待真实时间。
+// 事件存放在 RAM 环形缓冲中，保留最近 REC_RING 个。定义转存区后每写满
+// REC_FLASH_CHUNK 个事件转存一次，回放时环形缓冲中已被覆盖的事件从转存区读回，
+// 单人长局也能完整回放：
+//   REC_FLASH_SIZE 转存区字节数（REC_FLASH_CHUNK 个事件大小的整数倍），循环使用
+//   REC_FLASH_WRITE(addr, buf, len) 写入，addr 为转存区内的偏移
+//   REC_FLASH_READ(addr, buf, len)  读出
+// 主机仿真使用仿真器提供的转存区；板上未定义时只能回放不超过 REC_RING 个事件的局。
+#ifndef REC_RING
+#define REC_RING 256 // 环形缓冲容量（REC_FLASH_CHUNK 的整数倍）
+#endif
+#define REC_FLASH_CHUNK 32 // 转存块大小（事件数）
+
+#if defined(PPP_HOST) && !defined(REC_FLASH_WRITE)
+#define REC_FLASH_SIZE SIM_REC_SIZE
+#define REC_FLASH_WRITE(addr, buf, len) sim_rec_write(addr, buf, len)
+#define REC_FLASH_READ(addr, buf, len) sim_rec_read(addr, buf, len)
+#endif
+
+enum
+{
+  REC_GAME,  // 开局
+  REC_KEY,   // 按下按键
+  REC_NFC,   // 放上卡片
+  REC_SCORE, // 结束时一名玩家的分数（多人模式）
+  REC_END,   // 结束
 };
 
-// 数码管数字段码定义
-const static unsigned char NUM_CODE[10] = {
-    SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F,         // 0
-    SEG_B | SEG_C,                                         // 1
-    SEG_A | SEG_B | SEG_D | SEG_E | SEG_G,                 // 2
-    SEG_A | SEG_B | SEG_C | SEG_D | SEG_G,                 // 3
-    SEG_B | SEG_C | SEG_F | SEG_G,                         // 4
-    SEG_A | SEG_C | SEG_D | SEG_F | SEG_G,                 // 5
-    SEG_A | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,         // 6
-    SEG_A | SEG_B | SEG_C,                                 // 7
-    SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G, // 8
-    SEG_A | SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,         // 9
-};
+// 录制事件，8字节
+typedef struct
+{
+  uint32_t us;    // REC_GAME:随机数状态 REC_KEY/REC_NFC:时间 REC_END:结果
+  uint8_t type;   // REC_GAME 等
+  uint8_t arg;    // REC_GAME:玩家数 REC_KEY/REC_SCORE:玩家 REC_END:最终分数
+  uint16_t value; // REC_GAME:模式 REC_KEY:按键值 REC_NFC:卡号 REC_SCORE:分数
+} rec_event;
+
+#ifdef REC_FLASH_WRITE
+#define REC_KEEP (REC_FLASH_SIZE / sizeof(rec_event)) // 可回读的事件数
+#else
+#define REC_KEEP REC_RING
+#endif
+
+static PPP_TLS struct
+{
+  rec_event ring[REC_RING];
+  uint32_t head;     // 已写入的事件总数
+  uint32_t start_us; // 本局开始时间
+  uint32_t game;     // 本局 REC_GAME 事件的序号
+  uint32_t last_first; // 最近一局完整录制的 REC_GAME 序号
+  uint32_t last_end;   // 最近一局完整录制的 REC_END 序号
+  int last_valid;      // 已有完整录制
+} rec;
+
+static void rec_put(uint8_t type, uint8_t arg, uint16_t value, uint32_t us)
+{
+  rec_event *e = &rec.ring[rec.head % REC_RING];
+  e->us = us;
+  e->type = type;
+  e->arg = arg;
+  e->value = value;
+  rec.head++;
+#ifdef REC_FLASH_WRITE
+  if (rec.head % REC_FLASH_CHUNK == 0)
+  {
+    uint32_t first = rec.head - REC_FLASH_CHUNK;
+    REC_FLASH_WRITE(first % REC_KEEP * sizeof(rec_event),
+                    &rec.ring[first % REC_RING],
+                    REC_FLASH_CHUNK * sizeof(rec_event));
+  }
+#endif
+}
+
+/**
+ * @brief 读出序号为 i 的事件，环形缓冲中已被覆盖时从转存区读
+ * @note  调用者保证 rec.head - i 不超过 REC_KEEP
+ */
+static void rec_get(uint32_t i, rec_event *e)
+{
+#ifdef REC_FLASH_READ
+  if (rec.head - i > REC_RING)
+  {
+    REC_FLASH_READ(i % REC_KEEP * sizeof(rec_event), e, sizeof(*e));
+    return;
+  }
+#endif
+  *e = rec.ring[i % REC_RING];
+}
+
+/**
+ * @brief 记录开局：模式、玩家数和当前随机数状态
+ */
+void rec_game_begin(int mode, int players)
+{
+  rec.start_us = sys_now_us();
+  rec.game = rec.head;
+  rec_put(REC_GAME, players, mode, prng_state);
+}
+
+/**
+ * @brief 记录一次按下事件
+ */
+void rec_key(const key_event *ev)
+{
+  rec_put(REC_KEY, ev->player, (uint8_t)ev->key, ev->time_us - rec.start_us);
+}
 
 /**
- * @brief  这是一个自定义的数码管显示函数，可以显示单个数码管
- * @param  info     I2C 从设备信息结构体
- * @param  bit      数码管位（1~4）
- * @param  seg_mask 段选择掩码（比如 SEG_A|SEG_B|SEG_DP）
- * @retval 无
- * @note   可任意组合段，见SEG_A等定义
+ * @brief 记录一次放卡
  */
-void e1_tube_bit_set(i2c_slave_info info, int bit, uint8_t seg_mask)
+void rec_nfc(int card)
 {
-  // asd
-  unsigned char low = 0, high = 0;
-  if (seg_mask & SEG_A)
-    low |= 0x08;
-  if (seg_mask & SEG_B)
-    low |= 0x10;
-  if (seg_mask & SEG_C)
-    low |= 0x20;
-  if (seg_mask & SEG_D)
-    low |= 0x40;
-  if (seg_mask & SEG_E)
-    low |= 0x80;
-  if (seg_mask & SEG_F)
-    high |= 0x01;
-  if (seg_mask & SEG_G)
-    high |= 0x02;
-  if (seg_mask & SEG_DP)
-    high |= 0x04;
+  rec_put(REC_NFC, 0, card, sys_now_us() - rec.start_us);
+}
 
-  if (bit >= 1 && bit <= 4)
+/**
+ * @brief 记录结束
+ * @param result  结果（单人为轮数，多人为胜者）
+ * @param score   最终分数
+ * @param scores  每名玩家的分数，单人为 NULL
+ * @param players scores 的项数
+ */
+void rec_game_end(int result, int score, const int *scores, int players)
+{
+  for (int p = 0; scores && p < players; p++)
   {
-    i2c_reg_byte_write(info, TUBE_ADDR[bit - 1][0], low);
-    i2c_reg_byte_write(info, TUBE_ADDR[bit - 1][1], high);
-    i2c_byte_write(info, 0x81); // 更新显示
+    rec_put(REC_SCORE, p, scores[p], 0);
   }
+  rec_put(REC_END, score, 0, result);
+  rec.last_first = rec.game;
+  rec.last_end = rec.head - 1;
+  rec.last_valid = 1;
 }
 
 /**
- * @brief  这是一个自定义的数码管显示函数，可以显示4个数码管
- * @param  info     I2C 从设备信息结构体
- * @param  seg_mask 段选择掩码数组（比如 {SEG_A|SEG_B|SEG_DP,
- * SEG_A|SEG_B|SEG_DP, SEG_A|SEG_B|SEG_DP, SEG_A|SEG_B|SEG_DP}）
- * @retval 无
- * @note   可任意组合段，见SEG_A等定义
+ * @brief 查找最近一局完整的录制
+ * @param first 输出 REC_GAME 事件的序号
+ * @param last  输出 REC_END 事件的序号
+ * @retval 1=找到，0=没有
  */
-void e1_tube_all_set(i2c_slave_info info, uint8_t *seg_mask)
+static int rec_last_game(uint32_t *first, uint32_t *last)
 {
-  for (int i = 0; i < 4; i++)
+  if (!rec.last_valid || rec.head - rec.last_first > REC_KEEP)
   {
-    unsigned char low = 0, high = 0;
-    if (seg_mask[i] & SEG_A)
-      low |= 0x08;
-    if (seg_mask[i] & SEG_B)
-      low |= 0x10;
-    if (seg_mask[i] & SEG_C)
-      low |= 0x20;
-    if (seg_mask[i] & SEG_D)
-      low |= 0x40;
-    if (seg_mask[i] & SEG_E)
-      low |= 0x80;
-    if (seg_mask[i] & SEG_F)
-      high |= 0x01;
-    if (seg_mask[i] & SEG_G)
-      high |= 0x02;
-    if (seg_mask[i] & SEG_DP)
-      high |= 0x04;
-
-    i2c_reg_byte_write(info, TUBE_ADDR[i][0], low);
-    i2c_reg_byte_write(info, TUBE_ADDR[i][1], high);
+    return 0; // 开局已被覆盖
   }
-  i2c_byte_write(info, 0x81); // 更新显示
+  *first = rec.last_first;
+  *last = rec.last_end;
+  return 1;
 }
 
-/**
- * @brief 跑马灯效果，从右边推进，窗口4位，支持小数点
- * @param info I2C 设备信息
- * @param str  原始字符串（如 "Welcome-to-bpu"）
- * @param offset 当前窗口偏移（0 ~ total_window_len-1）
- */
-void e1_tube_marquee_display(i2c_slave_info info, const char *str, int offset)
+// 4.6 排行榜
+// 成绩、反应时间和玩家身份以日志方式追加写入 flash，从不原地修改。存储区
+// 分为 LB_PAGES 个擦除页，每页开头是页头（擦除次数、页序号），之后是定长
+// 32字节的记录，每条带 CRC，掉电写坏的记录扫描时跳过。开机按页序号从旧到新
+// 把所有记录扫描一遍，重建 RAM 中各榜的前 LB_TOP_N 名和玩家身份表，同时
+// 找到写入位置。
+// 写满一页后打开擦除次数最少的空页；空页用完时把最旧一页中仍在榜上的记录
+// 和身份记录搬到当前页，再擦除该页（压缩），各页轮流擦除，磨损均匀。写入
+// 任务不动最后 LB_SPARE 个空页，留给压缩：当前页写满时压缩先打开备用页，
+// 只有两页时，当前页放不下一整个写入队列就压缩当前页本身。
+// 游戏中新记录只进入 RAM 队列，由待机界面的任务每次写一条；擦除和压缩只在
+// 两局之间进行（lb_maintain），不占用游戏节拍。
+
+// flash 后端：地址为排行榜区内的偏移，按字（4字节）编程。GD32F4 使用最后
+// 两个128KB扇区（链接脚本需把它们从程序区中留出）；主机仿真使用 sim.c 的
+// 仿真 flash；其余平台没有后端，排行榜只保存在 RAM 中
+#if defined(GD32F450) || defined(GD32F470)
+#ifndef LB_FLASH_BASE
+#define LB_FLASH_BASE 0x080C0000 // 扇区10起（1MB 型号）
+#endif
+#define LB_PAGE_SIZE 0x20000
+#define LB_PAGES 2
+#define LB_FMC_FLAGS                                                           \
+  (FMC_FLAG_END | FMC_FLAG_OPERR | FMC_FLAG_WPERR | FMC_FLAG_PGMERR |          \
+   FMC_FLAG_PGSERR)
+static const uint32_t LB_SECTORS[LB_PAGES] = {CTL_SECTOR_NUMBER_10,
+                                              CTL_SECTOR_NUMBER_11};
+
+static void lb_flash_read(uint32_t addr, void *buf, uint32_t len)
 {
-  int str_len = strlen(str);
-  int window = 4;
+  memcpy(buf, (const void *)(uintptr_t)(LB_FLASH_BASE + addr), len);
+}
 
-  // 只在前面补window个'-'
-  char pad_str[64] = {0};
-  memset(pad_str, '-', window);  // 前补
-  strcpy(pad_str + window, str); // 中间
-  // 不补后缀'-'
+static int lb_flash_program(uint32_t addr, const void *buf, uint32_t len)
+{
+  const uint32_t *w = buf;
+  int ok = 1;
+  fmc_unlock();
+  fmc_flag_clear(LB_FMC_FLAGS);
+  for (uint32_t i = 0; ok && i < len / 4; i++)
+    ok = fmc_word_program(LB_FLASH_BASE + addr + i * 4, w[i]) == FMC_READY;
+  fmc_lock();
+  return ok ? 0 : -1;
+}
 
-  char disp_buf[8] = {0};
-  int buf_i = 0;
+static int lb_flash_erase(int page)
+{
+  fmc_unlock();
+  fmc_flag_clear(LB_FMC_FLAGS);
+  int ok = fmc_sector_erase(LB_SECTORS[page]) == FMC_READY;
+  fmc_lock();
+  return ok ? 0 : -1;
+}
+#elif defined(PPP_HOST)
+#define LB_PAGE_SIZE SIM_FLASH_PAGE_SIZE
+#define LB_PAGES SIM_FLASH_PAGES
+#define lb_flash_read sim_flash_read
+#define lb_flash_program sim_flash_program
+#define lb_flash_erase sim_flash_erase
+#else
+#define LB_PAGE_SIZE 4096
+#define LB_PAGES 2
 
-  for (int i = 0; i < window && buf_i < 7; i++)
-  {
-    disp_buf[buf_i++] = pad_str[offset + i];
-    // 支持小数点
-    if (pad_str[offset + i + 1] == '.' && buf_i < 7)
-    {
-      disp_buf[buf_i++] = '.';
-      i++;
-    }
-  }
-  disp_buf[buf_i] = '\0';
+static void lb_flash_read(uint32_t addr, void *buf, uint32_t len)
+{
+  (void)addr;
+  memset(buf, 0xFF, len); // 读出全空
+}
 
-  e1_tube_str_set(info, disp_buf);
+static int lb_flash_program(uint32_t addr, const void *buf, uint32_t len)
+{
+  (void)addr;
+  (void)buf;
+  (void)len;
+  return -1;
 }
 
-/**
- * @brief 加载动画，从左到右依次点亮数码管
- * @param info I2C 设备信息
- * @param round 轮数
- */
-void loading(i2c_slave_info info, int round)
+static int lb_flash_erase(int page)
 {
-  uint8_t nothing[4] = {0, 0, 0, 0}; // 初始化段掩码数组
-  int delay = 60;                    // 延时60ms
-  while (round--)
-  {
-    e1_tube_bit_set(info, 1, SEG_A);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+  (void)page;
+  return -1;
+}
+#endif
+
+#define LB_TOP_N 8           // 每个榜保留的名次
+#define LB_PLAYER_MAX 16     // 玩家身份表容量
+#define LB_QUEUE 8           // 待写入记录队列
+#define LB_SPARE 1           // 留给压缩的空页数
+#define LB_REACT_MIN 5       // 反应时间样本数达到该值才上榜
+#define LB_HEAD_SIZE 16      // 页头
+#define LB_REC_SIZE 32       // 记录
+#define LB_SLOTS ((LB_PAGE_SIZE - LB_HEAD_SIZE) / LB_REC_SIZE) // 每页记录数
+#define LB_PAGE_MAGIC 0x424C5050u // "PPLB"
+#define LB_REC_MAGIC 0xA5
+#define LB_QUEUED 0xFF // 记录还在 RAM 队列中，尚未写入任何页
 
-    e1_tube_bit_set(info, 2, SEG_A);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+enum
+{
+  LB_REC_SCORE = 1, // 一局的成绩
+  LB_REC_REACT,     // 一局中一名玩家的反应时间
+  LB_REC_PLAYER,    // 玩家身份（NFC 卡号）
+};
 
-    e1_tube_bit_set(info, 3, SEG_A);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+enum
+{
+  LB_BOARD_SOLO,  // 单人轮数，越多越好
+  LB_BOARD_MULTI, // 多人胜者领先第二名的分差，越大越好
+  LB_BOARD_REACT, // 反应时间中位数，越小越好
+  LB_BOARD_NUM,
+};
 
-    e1_tube_bit_set(info, 4, SEG_A);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+// 压缩时最多搬移的记录数
+#define LB_LIVE_MAX (LB_BOARD_NUM * LB_TOP_N + LB_PLAYER_MAX)
 
-    e1_tube_bit_set(info, 4, SEG_B);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+// 页头，16字节
+typedef struct
+{
+  uint32_t erases; // 擦除次数，擦除后先写入
+  uint32_t magic;  // LB_PAGE_MAGIC，随后写入，表示擦除已完成
+  uint32_t seq;    // 页序号，打开时写入，越大越新；空页为全1
+  uint32_t check;  // 前三项的 CRC，与页序号一起写入
+} lb_page_head;
 
-    e1_tube_bit_set(info, 4, SEG_C);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+// 记录，32字节，按字编程，第一个字含 magic，写了一半的记录 CRC 不符
+typedef struct
+{
+  uint8_t magic;   // LB_REC_MAGIC，0xFF 表示空位
+  uint8_t type;    // LB_REC_SCORE 等
+  uint16_t player; // 玩家身份（0=匿名）
+  uint32_t seq;    // 记录序号，全局递增，压缩搬移时不变
+  uint16_t value;  // 上榜数值，见 LB_BOARD_SOLO 等
+  uint8_t mode;    // LB_REC_SCORE:模式（1=单人 2=多人） LB_REC_REACT:按键器
+  uint8_t pad;
+  union
+  {
+    struct
+    {
+      int16_t scores[PLAYER_MAX]; // 各玩家最终分数
+      uint8_t players;            // 玩家数
+      uint8_t winner;             // 胜者（1起，单人为1）
+    } score;
+    struct
+    {
+      uint16_t count;  // 样本数
+      uint16_t min_ms; // 最短
+      uint16_t p95_ms; // 95百分位
+    } react;
+    uint8_t uid[4]; // 卡号
+    uint8_t raw[16];
+  } u;
+  uint32_t crc; // 前28字节的 CRC-32
+} lb_record;
 
-    e1_tube_bit_set(info, 4, SEG_D);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+typedef char lb_record_size_check[sizeof(lb_record) == LB_REC_SIZE ? 1 : -1];
+// 压缩时当前页刚打开，即使上次压缩中途掉电、页中已有一份副本，也放得下
+typedef char lb_page_size_check[LB_LIVE_MAX * 3 <= LB_SLOTS ? 1 : -1];
 
-    e1_tube_bit_set(info, 3, SEG_D);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+// 榜上的一条记录
+typedef struct
+{
+  uint32_t seq;    // 记录序号
+  uint16_t value;  // 上榜数值
+  uint16_t player; // 玩家身份
+  uint8_t page;    // 记录所在页，LB_QUEUED=尚未写入
+} lb_entry;
 
-    e1_tube_bit_set(info, 2, SEG_D);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+// 身份表中的一名玩家
+typedef struct
+{
+  uint8_t uid[4];
+  uint16_t id;
+  uint8_t page;
+  uint32_t seq;
+} lb_player;
 
-    e1_tube_bit_set(info, 1, SEG_D);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+enum
+{
+  LB_PAGE_DIRTY, // 需要擦除：从未格式化、擦除中途掉电或页头损坏
+  LB_PAGE_FREE,  // 已擦除，可以打开
+  LB_PAGE_USED,  // 已打开，有记录
+};
 
-    e1_tube_bit_set(info, 1, SEG_E);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+static PPP_TLS struct
+{
+  lb_entry top[LB_BOARD_NUM][LB_TOP_N]; // 各榜，按名次排序
+  int top_count[LB_BOARD_NUM];
+  lb_player players[LB_PLAYER_MAX];
+  int player_count;
+  uint8_t page_state[LB_PAGES];
+  uint32_t page_seq[LB_PAGES];
+  uint32_t page_erases[LB_PAGES];
+  int head;               // 当前写入页，-1=没有
+  uint32_t head_off;      // 下一条记录在页内的偏移
+  uint32_t next_seq;      // 下一条记录的序号
+  uint32_t next_page_seq; // 下一个打开的页的序号
+  lb_record queue[LB_QUEUE]; // 待写入的记录
+  int queue_head;
+  int queue_count;
+  // 统计
+  uint32_t records;     // 开机扫描到的有效记录
+  uint32_t bad;         // 校验失败跳过的记录
+  uint32_t written;     // 写入的新记录
+  uint32_t moved;       // 压缩搬移的记录
+  uint32_t erases;      // 擦除的页
+  uint32_t compactions; // 压缩次数
+  uint32_t dropped;     // 队列已满或写入失败丢弃的记录
+  uint32_t boot_us;     // 开机扫描耗时
+} lb;
 
-    e1_tube_bit_set(info, 1, SEG_F);
-    delay_ms(delay);
-    e1_tube_all_set(info, nothing);
+/**
+ * @brief CRC-32（IEEE 802.3），半字节查表
+ */
+static uint32_t lb_crc32(const void *buf, uint32_t len)
+{
+  static const uint32_t T[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+      0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+      0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  const uint8_t *p = buf;
+  uint32_t c = 0xFFFFFFFF;
+  while (len--)
+  {
+    c ^= *p++;
+    c = (c >> 4) ^ T[c & 15];
+    c = (c >> 4) ^ T[c & 15];
   }
+  return ~c;
 }
 
-/**
- * @brief 将HSV颜色转换为RGB颜色
- * @param h 色相（0-360度）
- * @param s 饱和度（0-255）
- * @param v 明度（0-255）
- * @param r 输出红色分量（0-255）
- * @param g 输出绿色分量（0-255）
- * @param b 输出蓝色分量（0-255）
- */
-void HSV2RGB(int h, int s, int v, unsigned char *r, unsigned char *g,
-             unsigned char *b)
-{
-  int i = h / 60;
-  int f = h % 60;
-  int p = v * (255 - s) / 255;
-  int q = v * (255 - s * f / 60) / 255;
-  int t = v * (255 - s * (60 - f) / 60) / 255;
-  switch (i)
-  {
-  case 0:
-    *r = v;
-    *g = t;
-    *b = p;
-    break;
-  case 1:
-    *r = q;
-    *g = v;
-    *b = p;
-    break;
-  case 2:
-    *r = p;
-    *g = v;
-    *b = t;
-    break;
-  case 3:
-    *r = p;
-    *g = q;
-    *b = v;
-    break;
-  case 4:
-    *r = t;
-    *g = p;
-    *b = v;
-    break;
-  case 5:
-  default:
-    *r = v;
-    *g = p;
-    *b = q;
-    break;
-  }
+static int lb_record_valid(const lb_record *r)
+{
+  return r->magic == LB_REC_MAGIC && r->crc == lb_crc32(r, LB_REC_SIZE - 4);
 }
 
 /**
- * @brief 欢迎界面，彩灯和数码管跑马灯
- * @param tube_info 数码管信息
- * @param led_info 彩灯信息
- * @param key_info 按键信息
+ * @brief 记录所属的榜，不上榜返回-1
  */
-void welcome(i2c_slave_info tube_info, i2c_slave_info led_info,
-             i2c_slave_info key_info)
+static int lb_board_of(const lb_record *r)
 {
-  const char *msg = "Welcome-to-PPP2025----";
-  int window = 4;
-  int msg_len = 15;
-  int total_steps = msg_len + window;
-  int offset = 0;
-
-  unsigned char r, g, b;
-  int color_steps = 10;                // 200ms内彩灯变色次数
-  int color_delay = 200 / color_steps; // 每次变色间隔ms
+  if (r->type == LB_REC_SCORE)
+    return r->mode == 1 ? LB_BOARD_SOLO : LB_BOARD_MULTI;
+  if (r->type == LB_REC_REACT && r->u.react.count >= LB_REACT_MIN)
+    return LB_BOARD_REACT;
+  return -1;
+}
 
-  int hue_base = 0;
+/**
+ * @brief a 是否排在 b 前面；同值时先上榜（序号小）的在前
+ */
+static int lb_better(int board, const lb_entry *a, const lb_entry *b)
+{
+  if (a->value != b->value)
+    return board == LB_BOARD_REACT ? a->value < b->value : a->value > b->value;
+  return (int32_t)(a->seq - b->seq) < 0;
+}
 
-  for (int i = 0;; i++)
+/**
+ * @brief 把一条记录计入 RAM 索引；同一序号的记录再次出现时只更新所在页
+ * @param r    记录
+ * @param page 记录所在页（LB_QUEUED=尚未写入）
+ * @retval 在榜上的名次（1起），未上榜为0
+ * @note   扫描、写入和压缩搬移都经过这里，压缩中途掉电留下的两份副本
+ *         以后出现的为准
+ */
+static int lb_index(const lb_record *r, uint8_t page)
+{
+  if (r->type == LB_REC_PLAYER)
   {
-    e1_tube_marquee_display(tube_info, msg, offset);
-
-    // 这200ms内彩灯快速变color_steps次
-    for (int j = 0; j < color_steps; j++)
+    for (int i = 0; i < lb.player_count; i++)
     {
-      int hue = (hue_base + j * (360 / color_steps)) % 360;
-      HSV2RGB(hue, 255, 128, &r, &g, &b);
-      e1_led_rgb_set(led_info, r, g, b);
-      delay_ms(color_delay);
-      if (s1_key_value_get(key_info) != 0)
+      if (memcmp(lb.players[i].uid, r->u.uid, 4) == 0)
       {
-        e1_led_rgb_set(led_info, 0, 0, 0); // 熄灭
-        e1_tube_str_set(tube_info, "");    // 显示结束信息
-        return;
+        lb.players[i].page = page;
+        lb.players[i].seq = r->seq;
+        return 0;
       }
     }
-    hue_base = (hue_base + 30) % 360; // 每步整体推进色相
-    offset = (offset + 1) % total_steps;
+    if (lb.player_count < LB_PLAYER_MAX)
+    {
+      lb_player *pl = &lb.players[lb.player_count++];
+      memcpy(pl->uid, r->u.uid, 4);
+      pl->id = r->player;
+      pl->page = page;
+      pl->seq = r->seq;
+    }
+    return 0;
+  }
+
+  int b = lb_board_of(r);
+  if (b < 0)
+    return 0;
+  lb_entry *top = lb.top[b];
+  int n = lb.top_count[b];
+  for (int i = 0; i < n; i++)
+  {
+    if (top[i].seq == r->seq)
+    {
+      top[i].page = page;
+      return i + 1;
+    }
   }
+  lb_entry e = {r->seq, r->value, r->player, page};
+  int i = n;
+  if (n < LB_TOP_N)
+    lb.top_count[b]++;
+  else if (lb_better(b, &e, &top[n - 1]))
+    i = n - 1; // 挤掉最后一名
+  else
+    return 0;
+  for (; i > 0 && lb_better(b, &e, &top[i - 1]); i--)
+    top[i] = top[i - 1];
+  top[i] = e;
+  return i + 1;
 }
 
-// 2. 按键
+/**
+ * @brief 页中的记录是否仍然有效（在榜上或是身份记录，且索引指向该页）
+ */
+static int lb_live(const lb_record *r, int page)
+{
+  if (r->type == LB_REC_PLAYER)
+  {
+    for (int i = 0; i < lb.player_count; i++)
+    {
+      if (lb.players[i].seq == r->seq)
+        return lb.players[i].page == page;
+    }
+    return 0;
+  }
+  int b = lb_board_of(r);
+  for (int i = 0; b >= 0 && i < lb.top_count[b]; i++)
+  {
+    if (lb.top[b][i].seq == r->seq)
+      return lb.top[b][i].page == page;
+  }
+  return 0;
+}
 
-// 双按键器结构体
-typedef struct
+/**
+ * @brief 扫描一页的记录并计入索引
+ * @retval 第一个空位的页内偏移
+ */
+static uint32_t lb_scan_page(int p)
 {
-  i2c_slave_info key1;
-  i2c_slave_info key2;
-  int count;
-} dual_key_info;
+  uint32_t off = LB_HEAD_SIZE;
+  for (; off + LB_REC_SIZE <= LB_PAGE_SIZE; off += LB_REC_SIZE)
+  {
+    lb_record r;
+    lb_flash_read(p * LB_PAGE_SIZE + off, &r, sizeof(r));
+    if (r.magic == 0xFF)
+      break; // 记录按顺序写入，之后都是空位
+    if (!lb_record_valid(&r))
+    {
+      lb.bad++;
+      continue;
+    }
+    lb.records++;
+    if ((int32_t)(r.seq - lb.next_seq) >= 0)
+      lb.next_seq = r.seq + 1;
+    lb_index(&r, p);
+  }
+  return off;
+}
 
 /**
- * @brief 初始化双按键器，返回双按键器结构体
- * @param 无
- * @retval 双按键器结构体
- * @note   双按键器结构体包含两个按键器信息和计数器
+ * @brief 开机扫描：读出所有页头，再按页序号从旧到新扫描一遍记录，重建索引
+ *        并找到写入位置
  */
-dual_key_info s1_multi_key_init(void)
+void lb_boot(void)
 {
-  dual_key_info dual_info;
-  dual_info.count = 0;
-// S1按键传感器地址
-#if defined(GD32F450) || defined(GD32F470)
-  const static unsigned char S1_HT16K33_ADDR[] = {0xE8, 0xEA, 0xEC, 0xEE};
-#else
-  const static unsigned char S1_HT16K33_ADDR[] = {0x74, 0x75, 0x76, 0x77};
-#endif
-  i2c_init();
-  for (int i = 0; i < sizeof(I2C_PERIPH_NUM) / sizeof(unsigned int); i++)
+  uint32_t t0 = sys_now_us();
+  memset(&lb, 0, sizeof(lb));
+  lb.head = -1;
+
+  int order[LB_PAGES]; // 已打开的页，按页序号排序
+  int used = 0;
+  uint32_t max_erases = 0;
+  for (int p = 0; p < LB_PAGES; p++)
   {
-    for (int j = 0; j < sizeof(S1_HT16K33_ADDR) / sizeof(unsigned char); j++)
+    lb_page_head h;
+    lb_flash_read(p * LB_PAGE_SIZE, &h, sizeof(h));
+    lb.page_state[p] = LB_PAGE_DIRTY;
+    if (h.magic != LB_PAGE_MAGIC)
     {
-      i2c_slave_info info =
-          i2c_slave_detect(I2C_PERIPH_NUM[i], S1_HT16K33_ADDR[j]);
-      if (info.flag && dual_info.count < 2)
-      {
-        // 初始化传感器（按照官方驱动）
-        i2c_byte_write(info, 0x21);
+      lb.page_erases[p] = 0xFFFFFFFF; // 擦除次数未知，稍后按最多的算
+      continue;
+    }
+    lb.page_erases[p] = h.erases;
+    if (h.erases > max_erases)
+      max_erases = h.erases;
+    if (h.seq == 0xFFFFFFFF && h.check == 0xFFFFFFFF)
+    {
+      lb.page_state[p] = LB_PAGE_FREE;
+    }
+    else if (h.check == lb_crc32(&h, 12))
+    {
+      lb.page_state[p] = LB_PAGE_USED;
+      lb.page_seq[p] = h.seq;
+      int i = used++;
+      for (; i > 0 && lb.page_seq[order[i - 1]] > h.seq; i--)
+        order[i] = order[i - 1];
+      order[i] = p;
+      if (h.seq >= lb.next_page_seq)
+        lb.next_page_seq = h.seq + 1;
+    }
+  }
+  for (int p = 0; p < LB_PAGES; p++)
+  {
+    if (lb.page_erases[p] == 0xFFFFFFFF)
+      lb.page_erases[p] = max_erases;
+  }
 
-        // 存储到对应位置
-        if (dual_info.count == 0)
-        {
-          dual_info.key1 = info;
-        }
-        else if (dual_info.count == 1)
-        {
-          dual_info.key2 = info;
-        }
-        dual_info.count++;
-      }
+  for (int i = 0; i < used; i++)
+  {
+    uint32_t off = lb_scan_page(order[i]);
+    if (i == used - 1)
+    {
+      lb.head = order[i]; // 最新的页继续写入
+      lb.head_off = off;
     }
   }
-  return dual_info;
+  lb.boot_us = sys_now_us() - t0;
+  PPP_SIM_EVENT("lb_boot", (int)lb.boot_us);
+}
+
+static int lb_free_pages(void)
+{
+  int n = 0;
+  for (int p = 0; p < LB_PAGES; p++)
+    n += lb.page_state[p] == LB_PAGE_FREE;
+  return n;
+}
+
+static int lb_room_for(int n)
+{
+  return lb.head >= 0 && lb.head_off + n * LB_REC_SIZE <= LB_PAGE_SIZE;
+}
+
+static int lb_room(void)
+{
+  return lb_room_for(1);
 }
 
 /**
- * @brief 分别获取两个玩家的按键值
- * @param dual_info 双传感器结构体
- * @param player 玩家编号（1或2）
- * @retval 按键值
- * @note   如果玩家编号大于双传感器数量，返回SWN
+ * @brief 打开擦除次数最少的空页作为当前页（只写页头，不擦除）
+ * @retval 1=成功，0=没有空页或写入失败
  */
-char get_player_key(dual_key_info dual_info, int player)
+static int lb_open_page(void)
 {
-  if (player == 1 && dual_info.count >= 1)
+  int best = -1;
+  for (int i = 1; i <= LB_PAGES; i++)
   {
-    return s1_key_value_get(dual_info.key1);
+    int p = (lb.head + i + LB_PAGES) % LB_PAGES; // 同样次数时沿环形顺序
+    if (lb.page_state[p] == LB_PAGE_FREE &&
+        (best < 0 || lb.page_erases[p] < lb.page_erases[best]))
+      best = p;
   }
-  else if (player == 2 && dual_info.count >= 2)
+  if (best < 0)
+    return 0;
+
+  lb_page_head h = {lb.page_erases[best], LB_PAGE_MAGIC, lb.next_page_seq, 0};
+  h.check = lb_crc32(&h, 12);
+  if (lb_flash_program(best * LB_PAGE_SIZE + 8, &h.seq, 8) != 0)
   {
-    return s1_key_value_get(dual_info.key2);
+    lb.page_state[best] = LB_PAGE_DIRTY;
+    return 0;
   }
-  return SWN;
+  lb.page_state[best] = LB_PAGE_USED;
+  lb.page_seq[best] = lb.next_page_seq++;
+  lb.head = best;
+  lb.head_off = LB_HEAD_SIZE;
+  return 1;
 }
 
 /**
- * @brief 测试按键
+ * @brief 在当前页末尾写入一条记录并更新索引
+ * @retval 0=成功，-1=失败（本页不再写入）
  */
-void test_button()
+static int lb_append(const lb_record *r)
 {
-  i2c_slave_info s1_key = s1_key_init();
-  i2c_slave_info e1_tube = e1_tube_init();
-  char str[8]; // 足够大
+  if (!lb_room())
+    return -1;
+  int p = lb.head;
+  if (lb_flash_program(p * LB_PAGE_SIZE + lb.head_off, r, LB_REC_SIZE) != 0)
+  {
+    lb.head_off = LB_PAGE_SIZE; // 可能留下半条记录，下次打开新页
+    return -1;
+  }
+  lb.head_off += LB_REC_SIZE;
+  lb_index(r, p);
+  return 0;
+}
 
-  char i = s1_key_value_get(s1_key); // 读取按键值
-  sprintf(str, "%d", i);             // 转成字符串
+/**
+ * @brief 擦除一页并写入新的擦除次数和 magic
+ * @retval 1=成功，0=失败（仍需擦除）
+ */
+static int lb_erase_page(int p)
+{
+  uint32_t erases = lb.page_erases[p] + 1;
+  uint32_t magic = LB_PAGE_MAGIC;
+  lb.page_state[p] = LB_PAGE_DIRTY;
+  if (lb_flash_erase(p) != 0)
+    return 0;
+  lb.page_erases[p] = erases;
+  lb.erases++;
+  if (lb_flash_program(p * LB_PAGE_SIZE, &erases, 4) != 0 ||
+      lb_flash_program(p * LB_PAGE_SIZE + 4, &magic, 4) != 0)
+    return 0;
+  lb.page_state[p] = LB_PAGE_FREE;
+  return 1;
+}
+
+/**
+ * @brief 压缩最旧的一页：把其中仍有效的记录搬到当前页，再擦除该页
+ * @note  当前页放不下一整个写入队列时也可压缩当前页（只有两页时），
+ *        此时先打开备用空页
+ * @retval 1=腾出一个空页，0=无法压缩
+ */
+static int lb_compact(void)
+{
+  int victim = -1;
+  for (int p = 0; p < LB_PAGES; p++)
+  {
+    if (lb.page_state[p] == LB_PAGE_USED && (p != lb.head || !lb_room_for(LB_QUEUE)) &&
+        (victim < 0 || (int32_t)(lb.page_seq[p] - lb.page_seq[victim]) < 0))
+      victim = p;
+  }
+  if (victim < 0)
+    return 0;
+  if ((victim == lb.head || !lb_room()) && !lb_open_page())
+  {
+    // 备用页被用掉（旧版本写入的镜像或掉电），记录无处可搬
+    PPP_LOG("[lb] compact page %d: no free page\r\n", victim);
+    PPP_SIM_EVENT("lb_compact_fail", victim);
+    return 0;
+  }
 
-  e1_tube_str_set(e1_tube, str); // 显示
+  int moved = 0;
+  for (uint32_t off = LB_HEAD_SIZE; off + LB_REC_SIZE <= LB_PAGE_SIZE;
+       off += LB_REC_SIZE)
+  {
+    lb_record r;
+    lb_flash_read(victim * LB_PAGE_SIZE + off, &r, sizeof(r));
+    if (r.magic == 0xFF)
+      break;
+    if (!lb_record_valid(&r) || !lb_live(&r, victim))
+      continue;
+    if (lb_append(&r) != 0 && (!lb_open_page() || lb_append(&r) != 0))
+    {
+      PPP_LOG("[lb] compact page %d failed\r\n", victim);
+      PPP_SIM_EVENT("lb_compact_fail", victim);
+      return 0; // 旧页保留，下次再试
+    }
+    moved++;
+  }
+  lb.moved += moved;
+  lb.compactions++;
+  PPP_SIM_EVENT("lb_compact", moved);
+  return lb_erase_page(victim);
 }
 
-// 3. NFC
+/**
+ * @brief 两局之间整理 flash：擦除需要擦除的页，除备用页外没有空页时压缩
+ *        最旧的一页
+ * @note  擦除会阻塞（GD32F4 擦除一个128KB扇区约1秒），不能在游戏中调用
+ */
+void lb_maintain(void)
+{
+  for (int p = 0; p < LB_PAGES; p++)
+  {
+    if (lb.page_state[p] == LB_PAGE_DIRTY)
+      lb_erase_page(p);
+  }
+  while (lb_free_pages() <= LB_SPARE && lb_compact())
+    ;
+}
 
-// 卡ID
-const unsigned char CARD0_ID[4] = {0x93, 0x71, 0xAF, 0x95}; // card0: 9371AF95
-const unsigned char CARD1_ID[4] = {0x63, 0x93, 0xBE, 0x95}; // card1: 6393BE95
-// 卡类型
-unsigned char CardType[2] = {0};
-// 识别到的卡ID
-unsigned char CardID[4] = {0};
+/**
+ * @brief 写入任务：每次把队列中的一条记录写入 flash，从不擦除
+ * @param arg 未使用
+ * @note  当前页写满时打开一个空页，但不动备用页；没有可用的空页时等待
+ *        lb_maintain 压缩
+ */
+void lb_task(void *arg)
+{
+  (void)arg;
+  if (lb.queue_count == 0 ||
+      (!lb_room() && (lb_free_pages() <= LB_SPARE || !lb_open_page())))
+    return;
+  if (lb_append(&lb.queue[lb.queue_head]) == 0)
+  {
+    lb.written++;
+  }
+  else
+  {
+    lb.dropped++;
+    PPP_SIM_EVENT("lb_drop", lb.queue[lb.queue_head].type);
+  }
+  lb.queue_head = (lb.queue_head + 1) % LB_QUEUE;
+  lb.queue_count--;
+}
 
-// 比较两个卡ID是否一致
-int compare_card_id(const unsigned char *id1, const unsigned char *id2)
+/**
+ * @brief 待写入的记录数
+ */
+int lb_pending(void)
 {
-  for (int i = 0; i < 4; i++)
+  return lb.queue_count;
+}
+
+/**
+ * @brief 封装记录并放入写入队列，同时计入 RAM 索引
+ * @retval 在榜上的名次（1起），未上榜或队列已满为0
+ */
+static int lb_submit(lb_record *r)
+{
+  if (lb.queue_count == LB_QUEUE)
   {
-    if (id1[i] != id2[i])
-      return 0;
+    lb.dropped++;
+    PPP_SIM_EVENT("lb_drop", r->type);
+    return 0;
+  }
+  r->magic = LB_REC_MAGIC;
+  r->seq = lb.next_seq++;
+  r->crc = lb_crc32(r, LB_REC_SIZE - 4);
+  lb.queue[(lb.queue_head + lb.queue_count++) % LB_QUEUE] = *r;
+  return lb_index(r, LB_QUEUED);
+}
+
+/**
+ * @brief 记录一局的成绩
+ * @param mode    1=单人 2=多人
+ * @param player  玩家身份（0=匿名）
+ * @param value   上榜数值（单人为轮数，多人为胜者领先第二名的分差）
+ * @param scores  各玩家最终分数
+ * @param players 玩家数
+ * @param winner  胜者（1起，单人为1）
+ * @retval 在榜上的名次（1起），未上榜为0
+ */
+int lb_add_score(int mode, uint16_t player, int value, const int *scores,
+                 int players, int winner)
+{
+  lb_record r;
+  memset(&r, 0, sizeof(r));
+  r.type = LB_REC_SCORE;
+  r.player = player;
+  r.value = value < 0 ? 0 : value > 0xFFFF ? 0xFFFF : value;
+  r.mode = mode;
+  for (int p = 0; p < players && p < PLAYER_MAX; p++)
+    r.u.score.scores[p] = scores[p];
+  r.u.score.players = players;
+  r.u.score.winner = winner;
+  return lb_submit(&r);
+}
+
+/**
+ * @brief 记录一局中一名玩家的反应时间
+ * @param player 玩家身份（0=匿名）
+ * @param slot   按键器（0起）
+ * @param count  样本数
+ * @param med_ms 中位数（上榜数值）
+ * @param min_ms 最短
+ * @param p95_ms 95百分位
+ * @retval 在榜上的名次（1起），未上榜为0
+ */
+int lb_add_react(uint16_t player, int slot, uint16_t count, uint16_t med_ms,
+                 uint16_t min_ms, uint16_t p95_ms)
+{
+  lb_record r;
+  memset(&r, 0, sizeof(r));
+  r.type = LB_REC_REACT;
+  r.player = player;
+  r.value = med_ms;
+  r.mode = slot;
+  r.u.react.count = count;
+  r.u.react.min_ms = min_ms;
+  r.u.react.p95_ms = p95_ms;
+  return lb_submit(&r);
+}
+
+/**
+ * @brief 按卡号查找玩家身份，新卡登记一个新身份
+ * @param uid 卡号（4字节）
+ * @retval 玩家身份（1起），身份表或队列已满时为0（匿名）
+ */
+uint16_t lb_player_id(const unsigned char *uid)
+{
+  uint16_t id = 0;
+  for (int i = 0; i < lb.player_count; i++)
+  {
+    if (memcmp(lb.players[i].uid, uid, 4) == 0)
+      return lb.players[i].id;
+    if (lb.players[i].id > id)
+      id = lb.players[i].id;
   }
+  if (lb.player_count == LB_PLAYER_MAX)
+    return 0;
+
+  lb_record r;
+  memset(&r, 0, sizeof(r));
+  r.type = LB_REC_PLAYER;
+  r.player = id + 1;
+  memcpy(r.u.uid, uid, 4);
+  int n = lb.player_count;
+  lb_submit(&r);
+  return lb.player_count > n ? r.player : 0;
+}
+
+/**
+ * @brief 读取榜上的一名
+ * @param board LB_BOARD_SOLO 等
+ * @param rank  名次（1起）
+ * @param value 输出上榜数值
+ * @param player 输出玩家身份
+ * @retval 1=有，0=该名次为空
+ */
+int lb_top_get(int board, int rank, uint16_t *value, uint16_t *player)
+{
+  if (board < 0 || board >= LB_BOARD_NUM || rank < 1 ||
+      rank > lb.top_count[board])
+    return 0;
+  const lb_entry *e = &lb.top[board][rank - 1];
+  *value = e->value;
+  *player = e->player;
   return 1;
 }
 
 /**
- * @brief 返回当前卡号：0=card0，1=card1，-1=没有卡，-2=不是这两张卡
- * @param s5_nfc NFC信息
- * @retval 当前卡号
+ * @brief 输出存储状态和各榜
  */
-int get_current_card_number(i2c_slave_info s5_nfc)
+void lb_report(void)
 {
-  if (s5_nfc_request(s5_nfc, PICC_REQIDL, CardType) == MI_OK &&
-      s5_nfc_anticoll(s5_nfc, CardID) == MI_OK)
+  static const char *const BOARD_NAME[LB_BOARD_NUM] = {"solo", "multi",
+                                                       "react"};
+  uint32_t emin = lb.page_erases[0], emax = 0;
+  for (int p = 0; p < LB_PAGES; p++)
   {
-    if (compare_card_id(CardID, CARD0_ID))
-    {
-      return 0;
-    }
-    else if (compare_card_id(CardID, CARD1_ID))
-    {
-      return 1;
-    }
-    else
+    if (lb.page_erases[p] < emin)
+      emin = lb.page_erases[p];
+    if (lb.page_erases[p] > emax)
+      emax = lb.page_erases[p];
+  }
+  PPP_LOG("[lb] pages=%d free=%d erases=%lu~%lu records=%lu bad=%lu "
+          "boot=%luus\r\n",
+          LB_PAGES, lb_free_pages(), (unsigned long)emin, (unsigned long)emax,
+          (unsigned long)lb.records, (unsigned long)lb.bad,
+          (unsigned long)lb.boot_us);
+  PPP_LOG("[lb] written=%lu moved=%lu erased=%lu compactions=%lu "
+          "dropped=%lu players=%d\r\n",
+          (unsigned long)lb.written, (unsigned long)lb.moved,
+          (unsigned long)lb.erases, (unsigned long)lb.compactions,
+          (unsigned long)lb.dropped, lb.player_count);
+  for (int b = 0; b < LB_BOARD_NUM; b++)
+  {
+    for (int i = 0; i < lb.top_count[b]; i++)
     {
-      return -2;
+      PPP_LOG("[lb] %-5s #%d %u p%u\r\n", BOARD_NAME[b], i + 1,
+              lb.top[b][i].value, lb.top[b][i].player);
     }
   }
-  return -1;
 }
 
 /**
- * @brief 测试NFC
+ * @brief 成绩上榜时显示名次"TOPn"一秒
  * @param e1_tube 数码管信息
- * @param e1_led 彩灯信息
- * @param s1_key 按键信息
- * @param s5_nfc NFC信息
+ * @param rank    名次（0=未上榜，不显示）
  */
-void nfc_test(i2c_slave_info e1_tube, i2c_slave_info e1_led,
-              i2c_slave_info s1_key, i2c_slave_info s5_nfc)
+void lb_show_rank(i2c_slave_info e1_tube, int rank)
 {
-  unsigned char CardID[4] = {0};
-  char buf[10] = {0};
-
-  e1_tube_str_set(e1_tube, "nfc");
-  delay_ms(500);
-
-  while (1)
-  {
-    int pos = 0;
-    if (s1_key_value_get(s1_key) != 0)
-    {
-      pos = 1;
-    }
-    if (s5_nfc_request(s5_nfc, 0x26, NULL) == MI_OK &&
-        s5_nfc_anticoll(s5_nfc, CardID) == MI_OK)
-    {
-      sprintf(buf, "%02x%02x", CardID[0 + 2 * pos], CardID[1 + 2 * pos]);
-      e1_tube_str_set(e1_tube, buf);
-      if (compare_card_id(CardID, CARD0_ID))
-      {
-        e1_led_rgb_set(e1_led, 0, 100, 0);
-      }
-      else if (compare_card_id(CardID, CARD1_ID))
-      {
-        e1_led_rgb_set(e1_led, 0, 0, 100);
-      }
-      else
-      {
-        e1_led_rgb_set(e1_led, 100, 100, 0);
-      }
-    }
-    else
-    {
-      e1_led_rgb_set(e1_led, 100, 100, 0);
-    }
-  }
+  if (rank <= 0)
+    return;
+  char str[16];
+  sprintf(str, "TOP%d", rank);
+  tube_str_set(e1_tube, str);
+  sys_delay_ms(1000);
 }
 
-// 4. 游戏代码
-
-// 4.1 游戏代码与显示
+// 4.7 游戏任务
 
-// 游戏代码结构体定义
-struct game_code
+// 单人与多人游戏共用的运行状态
+typedef struct
 {
-  int fan;
-  int fan_unsolved;
-  int tube_1;
-  int tube_2;
-  int tube_3;
-  int unsolved;
-  int oops;
+  i2c_slave_info e1_tube;
+  i2c_slave_info e1_led;
+  i2c_slave_info e2_fan;
+  i2c_slave_info e3_curtain;
+  i2c_slave_info s1_key;
+  multi_key_info s1_multi_key;
+  i2c_slave_info s5_nfc;
+  game_rules rules;    // 分数、轮次与游戏代码
+  key_input input;     // 按键采样器与事件队列
+  nfc_reader nfc;      // NFC读卡状态机
+  int led_lit;         // 反馈灯是否亮着
+  uint32_t led_off_us; // 反馈灯熄灭时间
+  anim_player flash;   // 提示动画，播放期间不刷新游戏画面
+  react_stats react;   // 反应时间统计
+  uint16_t player;     // 刷卡登记的玩家身份（0=匿名）
+  // 多人抢答仲裁
+  uint16_t taken;                     // 上次刷新画面后被击中、仍在显示的地鼠
+  uint8_t taken_by[TARGET_MAX + 1];   // 击中者（1起）
+  uint32_t ties;                      // 同一次采样中两人都按下的次数
+  uint32_t contested[KEY_PLAYER_MAX]; // 抢慢一步、不计分的次数
+} game_state;
+
+// 按错提示：红灯和"OOPS"一个游戏节拍，熄灯后文字再停留50ms
+#define OOPS_SEG                                                               \
+  {SEG_ALL & ~SEG_G, SEG_ALL & ~SEG_G, SEG_A | SEG_B | SEG_E | SEG_F | SEG_G,  \
+   SEG_A | SEG_C | SEG_D | SEG_F | SEG_G}
+static const anim_frame OOPS_ANIM[] = {
+    {OOPS_SEG, {255, 0, 0}, ANIM_TUBE | ANIM_LED, GAME_TICK_MS},
+    {OOPS_SEG, {0, 0, 0}, ANIM_TUBE | ANIM_LED, 50},
 };
 
 /**
- * @brief 显示当前游戏代码状态
- * @param tube_info 数码管信息
- * @param fan_info 风扇信息
- * @param code 游戏代码
+ * @brief 点亮反馈灯，一个游戏节拍后由彩灯任务熄灭
  */
-void display_code(i2c_slave_info tube_info, i2c_slave_info fan_info,
-                  struct game_code code)
+static void game_led_flash(game_state *st, unsigned char r, unsigned char g,
+                           unsigned char b)
 {
-  // 显示风扇
-  if (code.fan == 0)
-  {
-    e2_fan_speed_set(fan_info, 0);
-  }
-  else
+  led_rgb_set(st->e1_led, r, g, b);
+  st->led_lit = 1;
+  st->led_off_us = sys_now_us() + GAME_TICK_MS * 1000;
+}
+
+static void game_sample_task(void *arg)
+{
+  game_state *st = arg;
+  key_input_sample(&st->input);
+}
+
+static void game_render_task(void *arg)
+{
+  game_state *st = arg;
+  if (anim_update(&st->flash))
   {
-    e2_fan_speed_set(fan_info, 100);
+    return; // 提示动画播放中
   }
-  uint8_t seg_mask[4] = {0};
+  display_code(st->e1_tube, &st->rules.code);
+  react_display(&st->react, st->e1_tube, st->rules.code.targets);
+  st->taken = 0; // 被击中的地鼠已从画面上消失
+}
 
-  // 处理所有tube值，如果有相同的%3值，则在同一位置累加段掩码
-  int tubes[3] = {code.tube_1, code.tube_2, code.tube_3};
+static void game_actuator_task(void *arg)
+{
+  game_state *st = arg;
+  fan_speed_set(st->e2_fan, st->rules.code.fan == 0 ? 0 : 100);
+  curtain_position_set(st->e3_curtain, st->rules.score);
+}
 
-  for (int tube_idx = 0; tube_idx < 3; tube_idx++)
+static void game_led_task(void *arg)
+{
+  game_state *st = arg;
+  if (st->led_lit && (int32_t)(sys_now_us() - st->led_off_us) >= 0)
   {
-    if (tubes[tube_idx] > 0) // 只处理非零值
-    {
-      int position = (tubes[tube_idx] - 1) % 3 + 1; // 数码管位置 (1-3)
-      int segment_type = (tubes[tube_idx] - 1) / 3; // 段类型 (0-2)
-
-      // 根据段类型设置对应的段，使用按位或来合并
-      switch (segment_type)
-      {
-      case 0:
-        seg_mask[position] |= SEG_A;
-        break;
-      case 1:
-        seg_mask[position] |= SEG_G;
-        break;
-      case 2:
-        seg_mask[position] |= SEG_D;
-        break;
-      }
-    }
+    led_rgb_set(st->e1_led, 0, 0, 0);
+    st->led_lit = 0;
   }
-  // 显示unsolved
-  seg_mask[0] = NUM_CODE[code.unsolved] + SEG_DP;
-  e1_tube_all_set(tube_info, seg_mask);
 }
 
-// 4.2 游戏代码随机生成
-
 /**
- * @brief 生成随机数 1~1000
- * @param temp_humi_info 温湿度传感器信息
- * @retval 随机数
- * @note   使用温度和湿度生成一个伪随机数
+ * @brief 运行游戏，直到某个任务调用 sched_stop
+ * @param st    游戏状态
+ * @param input 输入任务（取空按键事件队列）
+ * @param logic 附加逻辑任务，如NFC（可为NULL）
  */
-int random(i2c_slave_info temp_humi_info)
+static void game_run(game_state *st, void (*input)(void *),
+                     void (*logic)(void *))
 {
-  s2_ths_t t = s2_ths_value_get(temp_humi_info);
-  // 使用温度和湿度生成一个伪随机数
-  int seed = (int)(t.temp * 100) + (int)(t.humi * 100);
-  seed = (seed * 1103515245 + 12345) & 0x7fffffff; // 线性同余生成器
-  return seed % 1000;                              // 返回0-99之间的伪随机数
+  sched_task tasks[6];
+  int n = 0;
+  // 输入任务与采样同周期、排在采样之后：每次处理上一次采样读到的事件，所有
+  // 按键器的读作业在一个采样周期内完成时，每名玩家的输入延迟都是一个采样
+  // 周期，与读取位次和玩家数无关
+  sched_task_init(&tasks[n++], "sample", game_sample_task, st,
+                  st->input.period_us / 1000);
+  sched_task_init(&tasks[n++], "input", input, st,
+                  st->input.period_us / 1000);
+  if (logic)
+    sched_task_init(&tasks[n++], "logic", logic, st, NFC_TASK_PERIOD_MS);
+  sched_task_init(&tasks[n++], "led", game_led_task, st, LED_PERIOD_MS);
+  sched_task_init(&tasks[n++], "render", game_render_task, st,
+                  RENDER_PERIOD_MS);
+  sched_task_init(&tasks[n++], "actuator", game_actuator_task, st,
+                  ACTUATOR_PERIOD_MS);
+  scheduler s = {tasks, n, 0};
+  sched_run(&s);
+  led_rgb_set(st->e1_led, 0, 0, 0);
+  i2c_queue_drain();
+  sched_report(&s);
+  i2c_queue_report();
+  i2c_trace_dump();
+  actuator_cache_report();
+  key_input_report(&st->input);
+  react_report(&st->react, st->input.count);
 }
 
 /**
- * @brief 随机生成游戏代码
- * @param temp_humi_info 温湿度传感器信息
- * @param code 游戏代码
+ * @brief 规则判定之后：新一轮开始时记录地鼠生成，游戏结束时停止调度器
+ * @param st    游戏状态
+ * @param round 判定前的轮次
  */
-void random_game_code(i2c_slave_info temp_humi_info, struct game_code *code)
+static void game_after_rules(game_state *st, int round)
 {
-  int random_num = random(temp_humi_info) % 1000; // 确保在0-999之间
+  if (st->rules.round != round)
+    react_spawn(&st->react, st->rules.code.targets);
+  if (rules_over(&st->rules))
+    sched_stop();
+}
 
-  code->fan = random_num % 2; // 随机风扇状态
-  code->fan_unsolved = 1;
-  code->tube_1 = random_num / 100;     // 随机管道编号
-  code->tube_2 = random_num / 10 % 10; // 随机管道编号
-  code->tube_3 = random_num % 10;      // 随机管道编号
+/**
+ * @brief 开局：生成第一轮
+ * @param st      游戏状态
+ * @param players 玩家数（1=单人模式）
+ */
+static void game_start(game_state *st, int players)
+{
+  rules_start(&st->rules, players, GAME_TARGETS, &prng_state);
+  game_after_rules(st, 0);
+}
 
-  // 保证tube_1, tube_2, tube_3 不重复
-  while (code->tube_1 == code->tube_2 || code->tube_1 == code->tube_3 ||
-         code->tube_2 == code->tube_3)
+// 单人游戏：一轮全部解决后开始下一轮，分数归零时结束
+static void solo_hit(game_state *st, const key_event *ev)
+{
+  // 按键被按下，检查是否击中地鼠
+  int round = st->rules.round;
+  int result = solo_rules_key(&st->rules, ev->key, &prng_state);
+  if (result == 0)
+    return; // 游戏已结束
+  react_press(&st->react, ev, result > 0);
+  if (result > 0)
   {
-    int random_num = random(temp_humi_info) % 1000; // 确保在0-999之间
-
-    code->fan = random_num % 2;          // 随机风扇状态
-    code->tube_1 = random_num / 100;     // 随机管道编号
-    code->tube_2 = random_num / 10 % 10; // 随机管道编号
-    code->tube_3 = random_num % 10;      // 随机管道编号
+    game_led_flash(st, 0, 255, 0);
+  }
+  else
+  {
+    anim_play(&st->flash, OOPS_ANIM, 2, 1, st->e1_tube, st->e1_led);
+    st->led_lit = 0; // 彩灯交给提示动画
+    anim_update(&st->flash); // 立即显示第一帧
   }
-  code->unsolved = 1 + (code->tube_1 > 0) + (code->tube_2 > 0) +
-                   (code->tube_3 > 0); // 随机未解答数量
-  code->oops = 0;
+  game_after_rules(st, round);
 }
 
-// 多人游戏专用的游戏代码生成（无风扇和NFC）
-void random_multi_game_code(i2c_slave_info temp_humi_info,
-                            struct game_code *code)
+static void solo_input_task(void *arg)
 {
-  int random_num = random(temp_humi_info) % 1000; // 确保在0-999之间
-
-  // 多人模式不使用风扇和NFC
-  code->fan = 0;
-  code->fan_unsolved = 0;
-  code->tube_1 = random_num / 100;     // 随机管道编号
-  code->tube_2 = random_num / 10 % 10; // 随机管道编号
-  code->tube_3 = random_num % 10;      // 随机管道编号
-
-  // 保证tube_1, tube_2, tube_3 不重复
-  while (code->tube_1 == code->tube_2 || code->tube_1 == code->tube_3 ||
-         code->tube_2 == code->tube_3)
+  game_state *st = arg;
+  key_event ev;
+  while (key_queue_pop(&st->input.queue, &ev))
   {
-    int random_num = random(temp_humi_info) % 1000; // 确保在0-999之间
-    code->tube_1 = random_num / 100;                // 随机管道编号
-    code->tube_2 = random_num / 10 % 10;            // 随机管道编号
-    code->tube_3 = random_num % 10;                 // 随机管道编号
+    if (!ev.pressed)
+      continue;
+    rec_key(&ev);
+    solo_hit(st, &ev);
   }
-  code->unsolved = (code->tube_1 > 0) + (code->tube_2 > 0) +
-                   (code->tube_3 > 0); // 只计算tube数量
-  code->oops = 0;
 }
 
-// 4.3 游戏核心函数
-
-/**
- * @brief 保证score不小于0 不大于100
- * @param score 分数
- * @param add 增加的分数
- */
-void score_add(int *score, int add)
+// 检查放上的卡片是否是正确的卡片
+static void solo_card(game_state *st, int card_number)
 {
-  if (*score + add < 0) // 如果score+add小于0，则score=0
+  int round = st->rules.round;
+  int result = solo_rules_card(&st->rules, card_number, &prng_state);
+  if (result == 0)
   {
-    *score = 0;
+    return; // 不需要刷卡
   }
-  else if (*score + add > 100) // 如果score+add大于100，则score=100
+  if (result > 0)
   {
-    *score = 100;
+    game_led_flash(st, 0, 255, 0);
   }
-  else // 否则score+add
+  else
   {
-    *score += add;
+    game_led_flash(st, 255, 0, 0);
   }
+  game_after_rules(st, round);
 }
 
-/**
- * @brief 初始化所有设备
- */
-void init_all(i2c_slave_info e1_tube, i2c_slave_info e1_led,
-              i2c_slave_info e2_fan, i2c_slave_info e3_curtain)
+static void solo_nfc_task(void *arg)
 {
-  e1_tube_str_set(e1_tube, "");
-  e1_led_rgb_set(e1_led, 0, 0, 0);
-  e2_fan_speed_set(e2_fan, 0);
-  e3_curtain_position_set(e3_curtain, 100);
-  loading(e1_tube, 1);
+  game_state *st = arg;
+  nfc_reader_demand(&st->nfc, st->rules.code.fan_unsolved);
+  nfc_reader_poll(&st->nfc);
+
+  // 只在新卡放上时检查
+  int card_number = nfc_reader_take_arrival(&st->nfc);
+  if (card_number == -2)
+  {
+    // 不是游戏卡：当作玩家自己的卡登记身份，不参与判定
+    st->player = lb_player_id(st->nfc.uid);
+    game_led_flash(st, 255, 255, 255);
+  }
+  else if (card_number != -1)
+  {
+    rec_nfc(card_number);
+    solo_card(st, card_number);
+  }
 }
 
 /**
- * @brief 选择模式(单人/多人/测试多按键)
- * @param e1_tube 数码管信息
- * @param e1_led 彩灯信息
- * @param s1_key 按键信息
- * @retval 模式
+ * @brief 把一局的成绩和每名玩家的反应时间放入排行榜写入队列
+ * @param st     游戏状态
+ * @param mode   1=单人 2=多人
+ * @param value  上榜数值（单人为轮数，多人为胜者领先第二名的分差）
+ * @param winner 胜者（1起，单人为1）
+ * @retval 成绩在榜上的名次（1起），未上榜为0
  */
-int chose_mode(i2c_slave_info e1_tube, i2c_slave_info e1_led,
-               i2c_slave_info s1_key)
+static int game_save(const game_state *st, int mode, int value, int winner)
 {
-
-  const char *msg = "CHOOSE-MODE----";
-  int window = 4;
-  int msg_len = 12;
-  int total_steps = msg_len + window;
-  int offset = 0;
-
-  unsigned char r, g, b;
-  int color_steps = 10;                // 200ms内彩灯变色次数
-  int color_delay = 200 / color_steps; // 每次变色间隔ms
-
-  int hue_base = 0;
-
-  for (int i = 0;; i++)
+  int players = st->rules.players;
+  const int *scores = mode == 1 ? &st->rules.score : st->rules.scores;
+  int rank = lb_add_score(mode, st->player, value, scores, players, winner);
+  for (int p = 0; p < players && p < KEY_PLAYER_MAX; p++)
   {
-    e1_tube_marquee_display(e1_tube, msg, offset);
-
-    // 这200ms内彩灯快速变color_steps次
-    for (int j = 0; j < color_steps; j++)
-    {
-      int hue = (hue_base + j * (360 / color_steps)) % 360;
-      HSV2RGB(hue, 255, 128, &r, &g, &b);
-      e1_led_rgb_set(e1_led, r, g, b);
-      delay_ms(color_delay);
-      int key = s1_key_value_get(s1_key);
-      if (key != 0)
-      {
-        e1_led_rgb_set(e1_led, 0, 0, 0); // 熄灭
-        e1_tube_str_set(e1_tube, "");    // 显示结束信息
-        if (key == '1')
-        {
-          return 1;
-        }
-        else if (key == '2')
-        {
-          return 2;
-        }
-        else if (key == '3')
-        {
-          return 3;
-        }
-      }
-    }
-    hue_base = (hue_base + 30) % 360; // 每步整体推进色相
-    offset = (offset + 1) % total_steps;
+    const latency_hist *h = &st->react.react[p];
+    if (h->count == 0)
+      continue;
+    lb_add_react(mode == 1 ? st->player : 0, p,
+                 h->count > 0xFFFF ? 0xFFFF : h->count,
+                 latency_hist_percentile(h, 50) / 1000, h->min_us / 1000,
+                 latency_hist_percentile(h, 95) / 1000);
   }
+  return rank;
 }
 
 /**
@@ -744,91 +4801,126 @@ int chose_mode(i2c_slave_info e1_tube, i2c_slave_info e1_led,
  * @param e2_fan 风扇信息
  * @param e3_curtain 窗帘信息
  * @param s1_key 按键信息
- * @param s2_imu 惯性传感器信息
- * @param s2_temp_humi 温湿度传感器信息
  * @param s5_nfc NFC信息
+ * @param rank 输出成绩在排行榜上的名次（0=未上榜，可为NULL）
  * @retval 轮数
  */
 int solo_game(i2c_slave_info e1_tube, i2c_slave_info e1_led,
               i2c_slave_info e2_fan, i2c_slave_info e3_curtain,
-              i2c_slave_info s1_key, i2c_slave_info s2_imu,
-              i2c_slave_info s2_temp_humi, i2c_slave_info s5_nfc)
+              i2c_slave_info s1_key, i2c_slave_info s5_nfc, int *rank)
 {
-  int score = 100;
-  int round = 0;
-  struct game_code code;
-  int delay_time = 200;
+  game_state st;
+  memset(&st, 0, sizeof(st));
+  st.e1_tube = e1_tube;
+  st.e1_led = e1_led;
+  st.e2_fan = e2_fan;
+  st.e3_curtain = e3_curtain;
+  st.s1_key = s1_key;
+  st.s5_nfc = s5_nfc;
+  key_input_init(&st.input, &s1_key, 1, KEY_SAMPLE_PERIOD_MS);
 
-  // 主循环
-  while (score > 0)
-  {
-    // 每次轮次
-    round++;
-    random_game_code(s2_temp_humi, &code);
+  rec_game_begin(1, 1);
+  game_start(&st, 1); // 第一轮
+  nfc_reader_init(&st.nfc, s5_nfc);
+  game_run(&st, solo_input_task, solo_nfc_task);
+  nfc_reader_report(&st.nfc);
+  rec_game_end(st.rules.round, st.rules.score, NULL, 0);
+  int r = game_save(&st, 1, st.rules.round, 1);
+  if (rank)
+    *rank = r;
+  return st.rules.round;
+}
 
-    while (code.unsolved != 0 && score > 0)
-    {
-      // 显示tube、fan和unsolved
-      display_code(e1_tube, e2_fan, code);
-      e3_curtain_position_set(e3_curtain, score);
+// 多人游戏：2~PLAYER_MAX 名玩家各自计分，有人到达 MULTI_SCORE_WIN 时结束
+/**
+ * @brief 处理一个玩家的按键
+ * @param st     游戏状态
+ * @param player 玩家（1起）
+ * @param ev     按键事件
+ * @retval 1=得分，-1=失分，0=游戏已结束
+ */
+static int multi_hit(game_state *st, int player, const key_event *ev)
+{
+  int round = st->rules.round;
+  int result = multi_rules_key(&st->rules, player, ev->key, &prng_state);
+  if (result == 0)
+    return 0;
+  react_press(&st->react, ev, result > 0);
+  game_after_rules(st, round);
+  return result;
+}
 
-      // 按键被按下，检查是否击中地鼠
-      int key = s1_key_value_get(s1_key);
-      if (key != 0)
-      {
-        key = key - '0';
-        if (key == code.tube_1)
-        {
-          score_add(&score, 5);
-          e1_led_rgb_set(e1_led, 0, 255, 0);
-          code.unsolved--;
-          code.tube_1 = 0;
-        }
-        else if (key == code.tube_2)
-        {
-          score_add(&score, 5);
-          e1_led_rgb_set(e1_led, 0, 255, 0);
-          code.unsolved--;
-          code.tube_2 = 0;
-        }
-        else if (key == code.tube_3)
-        {
-          score_add(&score, 5);
-          e1_led_rgb_set(e1_led, 0, 255, 0);
-          code.unsolved--;
-          code.tube_3 = 0;
-        }
-        else
-        {
-          score_add(&score, -10);
-          e1_led_rgb_set(e1_led, 255, 0, 0);
-          e1_tube_str_set(e1_tube, "00P5"); // 显示错误信息
-          delay_ms(50);
-        }
-      }
+/**
+ * @brief 按键事件是否先于另一个事件（采样序号先后，同一次采样按读取位次）
+ * @note  同一次采样中两个按键器都读到按下，说明两人都在这次采样的第一个读取
+ *        之前按下，无法分出真实先后；读取位次每次采样轮流交换，保证公平
+ */
+static int key_event_before(const key_event *a, const key_event *b)
+{
+  int16_t d = (int16_t)(a->seq - b->seq);
+  return d < 0 || (d == 0 && a->rank < b->rank);
+}
 
-      // 检查nfc 是否是正确的卡片
-      if (code.fan_unsolved == 1)
-      {
-        int card_number = get_current_card_number(s5_nfc);
-        if (card_number == code.fan)
-        {
-          code.unsolved--;
-          code.fan_unsolved = 0;
-          e1_led_rgb_set(e1_led, 0, 255, 0);
-        }
-        else
-        {
-          score_add(&score, -1);
-          e1_led_rgb_set(e1_led, 255, 0, 0);
-        }
-      }
+/**
+ * @brief 是否是抢慢一步的按键：该地鼠已被对方击中，但画面上还在显示
+ */
+static int multi_contested(const game_state *st, int player, char key)
+{
+  unsigned int k = (unsigned int)(key - '0');
+  return k >= 1 && k <= TARGET_MAX && (st->taken & (1u << k)) &&
+         !(st->rules.code.targets & (1u << k)) && st->taken_by[k] != player;
+}
+
+static void multi_input_task(void *arg)
+{
+  game_state *st = arg;
+  int results[PLAYER_MAX] = {0}; // 本批每名玩家最后一次按键的结果
+  key_event evs[KEY_EVENT_RING];
+  int n = 0;
+
+  // 取空队列后按按下的先后排序（插入排序，事件很少），而不是按完成回调的顺序
+  key_event ev;
+  while (key_queue_pop(&st->input.queue, &ev))
+  {
+    if (!ev.pressed)
+      continue;
+    int i = n++;
+    for (; i > 0 && key_event_before(&ev, &evs[i - 1]); i--)
+      evs[i] = evs[i - 1];
+    evs[i] = ev;
+  }
 
-      delay_ms(delay_time);
-      e1_led_rgb_set(e1_led, 0, 0, 0);
+  for (int i = 0; i < n; i++)
+  {
+    const key_event *e = &evs[i];
+    int player = e->player + 1;
+    if (i > 0 && evs[i - 1].seq == e->seq && evs[i - 1].player != e->player)
+      st->ties++;
+    // 同一只地鼠只判给先按下的玩家，后按下的不算按错
+    if (multi_contested(st, player, e->key))
+    {
+      st->contested[e->player]++;
+      continue;
     }
+    rec_key(e);
+    int result = multi_hit(st, player, e);
+    if (result == 0)
+    {
+      continue; // 游戏已结束
+    }
+    if (result > 0)
+    {
+      unsigned int k = (unsigned int)(e->key - '0');
+      st->taken |= 1u << k;
+      st->taken_by[k] = player;
+    }
+    results[e->player] = result;
   }
-  return round;
+
+  // 根据得分情况设置LED颜色
+  rgb_color c = player_feedback_color(results, st->rules.players);
+  if (c.r || c.g || c.b)
+    game_led_flash(st, c.r, c.g, c.b);
 }
 
 /**
@@ -837,157 +4929,124 @@ int solo_game(i2c_slave_info e1_tube, i2c_slave_info e1_led,
  * @param e1_led 彩灯信息
  * @param e2_fan 风扇信息
  * @param e3_curtain 窗帘信息
- * @param s1_multi_key 多按键信息
- * @param s2_imu 惯性传感器信息
- * @param s2_temp_humi 温湿度传感器信息
+ * @param s1_multi_key 每名玩家的按键器
  * @param s5_nfc NFC信息
- * @retval 轮数
+ * @param scores 输出每名玩家的最终分数（PLAYER_MAX 项，可为NULL）
+ * @param rank 输出胜者分差在排行榜上的名次（0=未上榜，可为NULL）
+ * @retval 获胜玩家（1起）
  */
 int multi_game(i2c_slave_info e1_tube, i2c_slave_info e1_led,
                i2c_slave_info e2_fan, i2c_slave_info e3_curtain,
-               dual_key_info s1_multi_key, i2c_slave_info s2_imu,
-               i2c_slave_info s2_temp_humi, i2c_slave_info s5_nfc)
+               multi_key_info s1_multi_key, i2c_slave_info s5_nfc,
+               int *scores, int *rank)
 {
 
-  delay_ms(1000);
-  int score = 50; // player2胜率，50=平衡，0=player1胜，100=player2胜
-  struct game_code code;
-  int delay_time = 200;
+  sys_delay_ms(1000);
+  game_state st;
+  memset(&st, 0, sizeof(st));
+  st.e1_tube = e1_tube;
+  st.e1_led = e1_led;
+  st.e2_fan = e2_fan;
+  st.e3_curtain = e3_curtain;
+  st.s1_multi_key = s1_multi_key;
+  st.s5_nfc = s5_nfc;
+  int players = s1_multi_key.count;
+  key_input_init(&st.input, s1_multi_key.keys, players, KEY_SAMPLE_PERIOD_MS);
 
-  // 主循环
-  int round = 0;
-  char key1 = 0, key2 = 0;
-  while (score > 0 && score < 100)
+  rec_game_begin(2, players);
+  game_start(&st, players); // 第一轮，每名玩家从0分开始
+  game_run(&st, multi_input_task, NULL);
+  PPP_LOG("[multi] players=%d ties=%lu\r\n", players, (unsigned long)st.ties);
+  for (int p = 0; p < players; p++)
   {
-    round++;
-    // 每次轮次生成新的游戏代码（无风扇和NFC）
-    random_multi_game_code(s2_temp_humi, &code);
-
-    while (code.unsolved != 0 && score > 0 && score < 100)
-    {
-      // 显示tube状态和当前score
-      display_code(e1_tube, e2_fan, code);
-      e3_curtain_position_set(e3_curtain, score);
-
-      // 同时检查两个玩家的按键，确保公平
-      // 偶数轮次，player1先按，奇数轮次，player2先按
-      if (round % 2 == 0)
-      {
-        key1 = get_player_key(s1_multi_key, 1);
-        key2 = get_player_key(s1_multi_key, 2);
-      }
-      else
-      {
-        key2 = get_player_key(s1_multi_key, 2);
-        key1 = get_player_key(s1_multi_key, 1);
-      }
-
-      int player1_scored = 0, player2_scored = 0;
+    PPP_LOG("[multi] p%d score=%d contested=%lu\r\n", p + 1,
+            st.rules.scores[p], (unsigned long)st.contested[p]);
+    if (scores)
+      scores[p] = st.rules.scores[p];
+  }
 
-      // 处理player1按键
-      if (key1 != SWN)
-      {
-        key1 = key1 - '0';
-        if (key1 == code.tube_1)
-        {
-          score_add(&score, -5); // player1正确，score减少（对player2不利）
-          player1_scored = 1;
-          code.tube_1 = 0;
-          code.unsolved--;
-        }
-        else if (key1 == code.tube_2)
-        {
-          score_add(&score, -5);
-          player1_scored = 1;
-          code.tube_2 = 0;
-          code.unsolved--;
-        }
-        else if (key1 == code.tube_3)
-        {
-          score_add(&score, -5);
-          player1_scored = 1;
-          code.tube_3 = 0;
-          code.unsolved--;
-        }
-        else
-        {
-          score_add(&score, 3); // player1错误，score增加（对player2有利）
-          player1_scored = -1;
-        }
-      }
+  // 返回获胜玩家
+  int winner = multi_rules_winner(&st.rules);
+  rec_game_end(winner, st.rules.score, st.rules.scores, players);
+  int second = 0; // 第二名的分数
+  for (int p = 1; p <= players; p++)
+  {
+    if (p != winner && st.rules.scores[p - 1] > second)
+      second = st.rules.scores[p - 1];
+  }
+  int r = game_save(&st, 2, st.rules.scores[winner - 1] - second, winner);
+  if (rank)
+    *rank = r;
+  return winner;
+}
 
-      // 处理player2按键
-      if (key2 != SWN)
-      {
-        key2 = key2 - '0';
-        if (key2 == code.tube_1 && code.tube_1 != 0) // 确保目标还存在
-        {
-          score_add(&score, 5); // player2正确，score增加（对player2有利）
-          player2_scored = 1;
-          code.tube_1 = 0;
-          code.unsolved--;
-        }
-        else if (key2 == code.tube_2 && code.tube_2 != 0)
-        {
-          score_add(&score, 5);
-          player2_scored = 1;
-          code.tube_2 = 0;
-          code.unsolved--;
-        }
-        else if (key2 == code.tube_3 && code.tube_3 != 0)
-        {
-          score_add(&score, 5);
-          player2_scored = 1;
-          code.tube_3 = 0;
-          code.unsolved--;
-        }
-        else
-        {
-          score_add(&score, -3); // player2错误，score减少（对player2不利）
-          player2_scored = -1;
-        }
-      }
+/**
+ * @brief 回放 RAM 中最近一局录制，检查结果与录制时是否一致
+ * @param e1_tube 数码管信息
+ * @param e1_led  彩灯信息
+ * @retval 1=一致，0=不一致，-1=没有可回放的录制
+ * @note  事件按录制顺序直接送入游戏逻辑，不等待原来的时间间隔；
+ *        回放结束后恢复随机数状态，不影响之后的游戏
+ */
+int game_replay(i2c_slave_info e1_tube, i2c_slave_info e1_led)
+{
+  uint32_t first = 0, last = 0;
+  if (!rec_last_game(&first, &last))
+  {
+    return -1;
+  }
+  rec_event begin, end;
+  rec_get(first, &begin);
+  rec_get(last, &end);
+  int mode = begin.value;
+  int players = mode == 1 ? 1 : begin.arg;
 
-      // 根据得分情况设置LED颜色
-      if (player1_scored == 1 && player2_scored == 1)
-      {
-        e1_led_rgb_set(e1_led, 255, 255, 255); // 白色：双方都得分
-      }
-      else if (player1_scored == 1)
-      {
-        e1_led_rgb_set(e1_led, 0, 255, 0); // 绿色：player1得分
-      }
-      else if (player2_scored == 1)
-      {
-        e1_led_rgb_set(e1_led, 0, 0, 255); // 蓝色：player2得分
-      }
-      else if (player1_scored == -1 && player2_scored == -1)
-      {
-        e1_led_rgb_set(e1_led, 255, 0, 255); // 紫色：双方都失分
-      }
-      else if (player1_scored == -1)
-      {
-        e1_led_rgb_set(e1_led, 255, 0, 0); // 红色：player1失分
-      }
-      else if (player2_scored == -1)
-      {
-        e1_led_rgb_set(e1_led, 255, 255, 0); // 黄色：player2失分
-      }
+  game_state st;
+  memset(&st, 0, sizeof(st));
+  st.e1_tube = e1_tube;
+  st.e1_led = e1_led;
+  uint32_t saved = prng_state;
+  prng_seed(begin.us);
 
-      delay_ms(delay_time);
-      e1_led_rgb_set(e1_led, 0, 0, 0); // 熄灭LED
+  int scores[PLAYER_MAX] = {0}; // 录制的每名玩家分数
+  uint32_t t0 = sys_now_us();
+  game_start(&st, players); // 第一轮
+  for (uint32_t i = first + 1; i < last; i++)
+  {
+    rec_event e;
+    rec_get(i, &e);
+    key_event ev = {.time_us = e.us, .player = e.arg,
+                    .key = (char)e.value, .pressed = 1};
+    if (e.type == REC_SCORE)
+    {
+      if (e.arg < PLAYER_MAX)
+        scores[e.arg] = e.value;
     }
+    else if (e.type == REC_NFC)
+      solo_card(&st, e.value);
+    else if (mode == 1)
+      solo_hit(&st, &ev);
+    else
+      multi_hit(&st, ev.player + 1, &ev);
   }
+  uint32_t elapsed = sys_now_us() - t0;
 
-  // 返回获胜玩家
-  if (score <= 50)
-  {
-    return 1; // player1胜利
-  }
-  else
+  int result = mode == 1 ? st.rules.round : multi_rules_winner(&st.rules);
+  int match = result == (int)end.us && st.rules.score == end.arg;
+  for (int p = 0; mode != 1 && p < players; p++)
   {
-    return 2; // player2胜利
+    if (st.rules.scores[p] != scores[p])
+      match = 0;
   }
+  led_rgb_set(e1_led, 0, 0, 0);
+  i2c_queue_drain();
+  prng_seed(saved);
+  PPP_LOG("[rec] replay mode=%d events=%lu result=%d/%lu score=%d/%d "
+          "match=%d time=%luus\r\n",
+          mode, (unsigned long)(last - first - 1), result,
+          (unsigned long)end.us, st.rules.score, end.arg, match,
+          (unsigned long)elapsed);
+  return match;
 }
 
 /**
@@ -996,97 +5055,161 @@ int multi_game(i2c_slave_info e1_tube, i2c_slave_info e1_led,
  * @retval 无
  * @note   初始化所有设备，进入欢迎界面，选择模式，进入游戏
  */
+#ifdef PPP_HOST
+/**
+ * @brief 恢复上电时的全局状态，同一线程依次运行多台仿真游戏机时在开机前调用
+ * @note  待机彩虹帧只依赖常量，保留已生成的内容
+ */
+void ppp_host_reset(void)
+{
+  sys_clock_us = 0;
+#ifdef SYS_CLOCK_DWT
+  sys_clock_cyc = 0;
+#endif
+  sched_current = NULL;
+#ifdef I2C_TRACE
+  memset(i2c_sites, 0, sizeof(i2c_sites));
+  i2c_site_count = 0;
+  memset(i2c_devices, 0, sizeof(i2c_devices));
+  i2c_device_count = 0;
+  i2c_ring_head = 0;
+#endif
+  memset(i2c_q, 0, sizeof(i2c_q));
+  memset(act_cache, 0, sizeof(act_cache));
+  memset(&dev_reg, 0, sizeof(dev_reg));
+  memset(&tube_fb, 0, sizeof(tube_fb));
+  prng_state = 1;
+  memset(&rec, 0, sizeof(rec));
+  memset(&lb, 0, sizeof(lb));
+}
+
+#define main ppp_main // 主机仿真时由仿真器调用
+#endif
 int main()
 {
 
   // init
-  i2c_slave_info e1_tube = e1_tube_init();
-  i2c_slave_info e1_led = e1_led_init();
-  i2c_slave_info e2_fan = e2_fan_init();
-  i2c_slave_info e3_curtain = e3_curtain_init();
-  i2c_slave_info s1_key = s1_key_init();
-  i2c_slave_info s2_imu = s2_imu_init();
-  i2c_slave_info s2_temp_humi = s2_ths_init();
-  i2c_slave_info s5_nfc = s5_nfc_init();
+  sys_clock_init();
+  dev_registry_boot();
+  dev_registry_report();
+  i2c_slave_info e1_tube = dev_registry_get(DEV_TUBE, 0);
+  i2c_slave_info e1_led = dev_registry_get(DEV_LED, 0);
+  i2c_slave_info e2_fan = dev_registry_get(DEV_FAN, 0);
+  i2c_slave_info e3_curtain = dev_registry_get(DEV_CURTAIN, 0);
+  i2c_slave_info s1_key = dev_registry_get(DEV_KEY, 0);
+  i2c_slave_info s2_temp_humi = dev_registry_get(DEV_THS, 0);
+  i2c_slave_info s5_nfc = dev_registry_get(DEV_NFC, 0);
+  prng_seed_from_sensor(s2_temp_humi);
+  lb_boot();
+  lb_report();
 
   // 如果按键被按下，则进入nfc测试模式
   if (s1_key_value_get(s1_key) != 0)
   {
-    e1_led_rgb_set(e1_led, 100, 100, 0);
+    led_rgb_set(e1_led, 100, 100, 0);
     nfc_test(e1_tube, e1_led, s1_key, s5_nfc);
   }
   // 否则进入游戏模式
   // init
   while (1)
   {
+    lb_maintain(); // 两局之间擦除、压缩 flash，上一局的记录由待机界面写入
     init_all(e1_tube, e1_led, e2_fan, e3_curtain);
+    PPP_SIM_EVENT("welcome", 0);
     welcome(e1_tube, e1_led, s1_key);
-    delay_ms(1000);
+    sys_delay_ms(1000);
+    PPP_SIM_EVENT("chose_mode", 0);
     int mode = chose_mode(e1_tube, e1_led, s1_key);
     if (mode == 1)
     {
-      e1_tube_str_set(e1_tube, "SOLO");
-      delay_ms(1000);
-      int round = solo_game(e1_tube, e1_led, e2_fan, e3_curtain, s1_key, s2_imu,
-                            s2_temp_humi, s5_nfc);
+      tube_str_set(e1_tube, "SOLO");
+      sys_delay_ms(1000);
+      PPP_SIM_EVENT("solo", 0);
+      int rank = 0;
+      int round = solo_game(e1_tube, e1_led, e2_fan, e3_curtain, s1_key, s5_nfc,
+                            &rank);
+      PPP_SIM_EVENT("solo_end", round);
       char round_str[8];
       sprintf(round_str, "%d", round);
-      e1_tube_str_set(e1_tube, round_str);
-      delay_ms(2000);
+      tube_str_set(e1_tube, round_str);
+      sys_delay_ms(2000);
+      lb_show_rank(e1_tube, rank);
     }
     else if (mode == 2)
     {
-      e1_tube_str_set(e1_tube, "MULT");
-      delay_ms(1000);
-      dual_key_info s1_multi_key = s1_multi_key_init();
-      if (s1_multi_key.count != 2)
+      tube_str_set(e1_tube, "MULT");
+      sys_delay_ms(1000);
+      multi_key_info s1_multi_key = s1_multi_key_init();
+      if (s1_multi_key.count < 2)
       {
-        e1_tube_str_set(e1_tube, "ERR");
-        e1_led_rgb_set(e1_led, 255, 0, 0);
-        delay_ms(1000);
+        tube_str_set(e1_tube, "ERR");
+        led_rgb_set(e1_led, 255, 0, 0);
+        sys_delay_ms(1000);
         continue;
       }
 
+      PPP_SIM_EVENT("multi", s1_multi_key.count);
+      int scores[PLAYER_MAX];
+      int rank = 0;
       int winner = multi_game(e1_tube, e1_led, e2_fan, e3_curtain, s1_multi_key,
-                              s2_imu, s2_temp_humi, s5_nfc);
-      if (winner == 1)
-      {
-        e1_led_rgb_set(e1_led, 0, 255, 0);
-        e1_tube_str_set(e1_tube, "P1");
-      }
-      else if (winner == 2)
+                              s5_nfc, scores, &rank);
+      PPP_SIM_EVENT("multi_end", winner);
+      // 结算：依次显示每名玩家的分数，最后显示胜者
+      led_group leds;
+      led_group_init(&leds, e1_led);
+      for (int p = 1; p <= s1_multi_key.count; p++)
       {
-        e1_led_rgb_set(e1_led, 0, 0, 255);
-        e1_tube_str_set(e1_tube, "P2");
+        player_show(e1_tube, &leds, p, scores[p - 1]);
+        sys_delay_ms(1000);
       }
-      delay_ms(2000);
+      player_show(e1_tube, &leds, winner, -1);
+      led_group_fade(&leds, PLAYER_COLOR[winner - 1], COLOR_OFF,
+                     2000); // 胜者颜色渐灭
+      lb_show_rank(e1_tube, rank);
+    }
+    else if (mode == 4) // 回放上一局
+    {
+      PPP_SIM_EVENT("replay", 0);
+      int match = game_replay(e1_tube, e1_led);
+      PPP_SIM_EVENT("replay_end", match);
+      tube_str_set(e1_tube, match == 1 ? "PASS" : match == 0 ? "FAIL" : "NONE");
+      sys_delay_ms(2000);
     }
     else if (mode == 3)
     {
-      dual_key_info s1_multi_key = s1_multi_key_init();
-      if (s1_multi_key.count != 2)
+      multi_key_info s1_multi_key = s1_multi_key_init();
+      if (s1_multi_key.count < 2)
       {
-        e1_tube_str_set(e1_tube, "ERR");
-        e1_led_rgb_set(e1_led, 255, 0, 0);
-        delay_ms(1000);
+        tube_str_set(e1_tube, "ERR");
+        led_rgb_set(e1_led, 255, 0, 0);
+        sys_delay_ms(1000);
         continue;
       }
 
+      // 按键测试：显示按键的玩家和键值，彩灯为该玩家的颜色；
+      // 键值RAM按 S1_KEY_MAP 译出的键与厂商键值不同时显示 "E"，彩灯为红色
       while (1)
       {
-        char key = s1_key_value_get(s1_multi_key.key1);
-        if (key != 0)
-        {
-          e1_led_rgb_set(e1_led, 0, 255, 0);
-          e1_tube_str_set(e1_tube, &key);
-        }
-        key = s1_key_value_get(s1_multi_key.key2);
-        if (key != 0)
+        for (int p = 1; p <= s1_multi_key.count; p++)
         {
-          e1_led_rgb_set(e1_led, 0, 0, 255);
-          e1_tube_str_set(e1_tube, &key);
+          char key = get_player_key(&s1_multi_key, p);
+          if (key != 0)
+          {
+            rgb_color c = PLAYER_COLOR[p - 1];
+            char str[8];
+            sprintf(str, "P%d %c", p, key);
+#ifdef I2C_REG_BUF_READ
+            if (!s1_key_map_check(s1_multi_key.keys[p - 1], key))
+            {
+              c = (rgb_color){255, 0, 0};
+              str[2] = 'E';
+            }
+#endif
+            led_rgb_set(e1_led, c.r, c.g, c.b);
+            tube_str_set(e1_tube, str);
+          }
         }
-        delay_ms(200);
+        sys_delay_ms(200);
       }
     }
   }